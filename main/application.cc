@@ -12,6 +12,7 @@
 
 #include <cstring>
 #include <esp_log.h>
+#include <esp_app_desc.h>
 #include <cJSON.h>
 #include <driver/gpio.h>
 #include <arpa/inet.h>
@@ -19,6 +20,32 @@
 
 #define TAG "Application"
 
+// A firmware downloaded in the background is applied after the device was idle this long
+#define BACKGROUND_UPGRADE_IDLE_SECONDS 30
+
+// Display frame rate caps, lower while the AFE and the decoder need the CPU, most on single core chips
+#ifndef DISPLAY_FPS_IDLE
+#define DISPLAY_FPS_IDLE 30
+#endif
+#ifndef DISPLAY_FPS_LISTENING
+#if CONFIG_FREERTOS_UNICORE
+#define DISPLAY_FPS_LISTENING 10
+#else
+#define DISPLAY_FPS_LISTENING 20
+#endif
+#endif
+#ifndef DISPLAY_FPS_SPEAKING
+#if CONFIG_FREERTOS_UNICORE
+#define DISPLAY_FPS_SPEAKING 15
+#else
+#define DISPLAY_FPS_SPEAKING 30
+#endif
+#endif
+
+// Milliseconds since power-on for each boot stage, to track time to wake word ready
+static void LogBootPhase(const char* phase) {
+    ESP_LOGI(TAG, "Boot phase: %s at %d ms", phase, int(esp_timer_get_time() / 1000));
+}
 
 Application::Application() {
     event_group_ = xEventGroupCreate();
@@ -59,11 +86,13 @@ bool Application::SetDeviceState(DeviceState state) {
 }
 
 void Application::Initialize() {
+    LogBootPhase("initialize");
     auto& board = Board::GetInstance();
     SetDeviceState(kDeviceStateStarting);
 
     // Setup the display
     auto display = board.GetDisplay();
+    LogBootPhase("board ready");
 
     // Print board name/version info
     display->SetChatMessage("system", SystemInfo::GetUserAgent().c_str());
@@ -84,6 +113,18 @@ void Application::Initialize() {
         xEventGroupSetBits(event_group_, MAIN_EVENT_VAD_CHANGE);
     };
     audio_service_.SetCallbacks(callbacks);
+    LogBootPhase("audio service started");
+
+    // Apply the assets before the network is up so the wake word model and theme are ready
+    // early. A pending download replaces the partition, so it is applied after the download.
+    {
+        auto& assets = Assets::GetInstance();
+        Settings settings("assets");
+        if (assets.partition_valid() && settings.GetString("download_url").empty()) {
+            assets.Apply();
+            LogBootPhase("assets applied");
+        }
+    }
 
     // Add state change listeners
     state_machine_.AddStateChangeListener([this](DeviceState old_state, DeviceState new_state) {
@@ -158,6 +199,7 @@ void Application::Initialize() {
 
     // Start network asynchronously
     board.StartNetwork();
+    LogBootPhase("network started");
 
     // Update the status bar immediately to show the network state
     display->UpdateStatusBar(true);
@@ -182,6 +224,11 @@ void Application::Run() {
     while (true) {
         auto bits = xEventGroupWaitBits(event_group_, ALL_EVENTS, pdTRUE, pdFALSE, portMAX_DELAY);
 
+        // State transitions and audio control go before everything else
+        if (bits & MAIN_EVENT_SCHEDULE) {
+            main_tasks_.RunPending(kSchedulePriorityAudio);
+        }
+
         if (bits & MAIN_EVENT_ERROR) {
             SetDeviceState(kDeviceStateIdle);
             Alert(Lang::Strings::ERROR, last_error_message_.c_str(), "circle_xmark", Lang::Sounds::OGG_EXCLAMATION);
@@ -235,12 +282,7 @@ void Application::Run() {
         }
 
         if (bits & MAIN_EVENT_SCHEDULE) {
-            std::unique_lock<std::mutex> lock(mutex_);
-            auto tasks = std::move(main_tasks_);
-            lock.unlock();
-            for (auto& task : tasks) {
-                task();
-            }
+            main_tasks_.RunPending();
         }
 
         if (bits & MAIN_EVENT_CLOCK_TICK) {
@@ -252,6 +294,9 @@ void Application::Run() {
             if (clock_ticks_ % 10 == 0) {
                 SystemInfo::PrintHeapStats();
             }
+            if (clock_ticks_ % 60 == 0) {
+                main_tasks_.PrintStats();
+            }
         }
     }
 }
@@ -261,6 +306,7 @@ void Application::HandleNetworkConnectedEvent() {
     auto state = GetDeviceState();
 
     if (state == kDeviceStateStarting || state == kDeviceStateWifiConfiguring) {
+        LogBootPhase("network connected");
         // Network is ready, start activation
         SetDeviceState(kDeviceStateActivating);
         if (activation_task_handle_ != nullptr) {
@@ -299,19 +345,16 @@ void Application::HandleActivationDoneEvent() {
 
     SystemInfo::PrintHeapStats();
     SetDeviceState(kDeviceStateIdle);
-
-    has_server_time_ = ota_->HasServerTime();
+    LogBootPhase("ready");
 
     auto display = Board::GetInstance().GetDisplay();
-    std::string message = std::string(Lang::Strings::VERSION) + ota_->GetCurrentVersion();
+    std::string message = std::string(Lang::Strings::VERSION) + esp_app_get_description()->version;
     display->ShowNotification(message.c_str());
     display->SetChatMessage("system", "");
 
     // Play the success sound to indicate the device is ready
     audio_service_.PlaySound(Lang::Sounds::OGG_SUCCESS);
 
-    // Release OTA object after activation is complete
-    ota_.reset();
     auto& board = Board::GetInstance();
     board.SetPowerSaveLevel(PowerSaveLevel::LOW_POWER);
 }
@@ -320,17 +363,41 @@ void Application::ActivationTask() {
     // Create OTA object for activation process
     ota_ = std::make_unique<Ota>();
 
-    // Check for new assets version
-    CheckAssetsVersion();
+    Settings settings("protocol");
+    if (!settings.GetString("type").empty()) {
+        // Activated before: start the protocol from the saved config so chat is available
+        // right away, and check for a new version in the background
+        InitializeProtocol();
+        xEventGroupSetBits(event_group_, MAIN_EVENT_ACTIVATION_DONE);
+        CheckNewVersion(true);
+    } else {
+        // The first activation needs the server config before the protocol can start
+        CheckNewVersion(false);
+        InitializeProtocol();
+        xEventGroupSetBits(event_group_, MAIN_EVENT_ACTIVATION_DONE);
+    }
+    has_server_time_ = ota_->HasServerTime();
 
-    // Check for new firmware version
-    CheckNewVersion();
+    // Downloads are not needed for chat, run them when the device is idle
+    WaitForIdle();
+    CheckAssetsVersion();
 
-    // Initialize the protocol
-    InitializeProtocol();
+    // Release OTA object after activation is complete
+    ota_.reset();
+}
 
-    // Signal completion to main loop
-    xEventGroupSetBits(event_group_, MAIN_EVENT_ACTIVATION_DONE);
+void Application::WaitForIdle(int idle_seconds) {
+    int idle_count = 0;
+    while (true) {
+        if (CanEnterSleepMode()) {
+            if (idle_count++ >= idle_seconds) {
+                return;
+            }
+        } else {
+            idle_count = 0;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1000));
+    }
 }
 
 void Application::CheckAssetsVersion() {
@@ -353,8 +420,14 @@ void Application::CheckAssetsVersion() {
     // Check if there is a new assets need to be downloaded
     std::string download_url = settings.GetString("download_url");
 
+    if (!download_url.empty() && assets.applied()) {
+        // Set after boot (e.g. by MCP), the partition cannot be replaced under the live UI
+        ESP_LOGI(TAG, "Assets download deferred to the next boot: %s", download_url.c_str());
+        return;
+    }
+
     if (!download_url.empty()) {
-        settings.EraseKey("download_url");
+        std::string download_sha256 = settings.GetString("download_sha256");
 
         char message[256];
         snprintf(message, sizeof(message), Lang::Strings::FOUND_NEW_ASSETS, download_url.c_str());
@@ -362,7 +435,16 @@ void Application::CheckAssetsVersion() {
         
         // Wait for the audio service to be idle for 3 seconds
         vTaskDelay(pdMS_TO_TICKS(3000));
-        SetDeviceState(kDeviceStateUpgrading);
+        if (!state_machine_.TransitionTo(kDeviceStateUpgrading)) {
+            // Woken up meanwhile, the download unmaps the fonts and emoji in use
+            ESP_LOGW(TAG, "Device is busy, assets download deferred to the next boot");
+            DismissAlert();
+            // Keep using the current partition until then
+            if (!assets.applied()) {
+                assets.Apply();
+            }
+            return;
+        }
         board.SetPowerSaveLevel(PowerSaveLevel::PERFORMANCE);
         display->SetChatMessage("system", Lang::Strings::PLEASE_WAIT);
 
@@ -372,7 +454,13 @@ void Application::CheckAssetsVersion() {
                 snprintf(buffer, sizeof(buffer), "%d%% %uKB/s", progress, speed / 1024);
                 display->SetChatMessage("system", buffer);
             }).detach();
-        });
+        }, download_sha256);
+
+        // Keep the url while the download can be resumed, so it continues after a reboot
+        if (success || !assets.download_resumable()) {
+            settings.EraseKey("download_url");
+            settings.EraseKey("download_sha256");
+        }
 
         board.SetPowerSaveLevel(PowerSaveLevel::LOW_POWER);
         vTaskDelay(pdMS_TO_TICKS(1000));
@@ -380,26 +468,33 @@ void Application::CheckAssetsVersion() {
         if (!success) {
             Alert(Lang::Strings::ERROR, Lang::Strings::DOWNLOAD_ASSETS_FAILED, "circle_xmark", Lang::Sounds::OGG_EXCLAMATION);
             vTaskDelay(pdMS_TO_TICKS(2000));
-            SetDeviceState(kDeviceStateActivating);
+            SetDeviceState(kDeviceStateIdle);
             return;
         }
     }
 
-    // Apply assets
-    assets.Apply();
-    display->SetChatMessage("system", "");
-    display->SetEmotion("microchip_ai");
+    // Apply assets, unless they were already applied at boot
+    if (!assets.applied()) {
+        assets.Apply();
+    }
+    if (!download_url.empty()) {
+        display->SetChatMessage("system", "");
+        SetDeviceState(kDeviceStateIdle);
+    }
 }
 
-void Application::CheckNewVersion() {
-    const int MAX_RETRY = 10;
+void Application::CheckNewVersion(bool background) {
+    // In the background the assets check waits for this, give up sooner
+    const int MAX_RETRY = background ? 3 : 10;
     int retry_count = 0;
     int retry_delay = 10; // Initial retry delay in seconds
 
     auto& board = Board::GetInstance();
     while (true) {
         auto display = board.GetDisplay();
-        display->SetStatus(Lang::Strings::CHECKING_NEW_VERSION);
+        if (!background) {
+            display->SetStatus(Lang::Strings::CHECKING_NEW_VERSION);
+        }
 
         esp_err_t err = ota_->CheckVersion();
         if (err != ESP_OK) {
@@ -411,14 +506,17 @@ void Application::CheckNewVersion() {
 
             char error_message[128];
             snprintf(error_message, sizeof(error_message), "code=%d, url=%s", err, ota_->GetCheckVersionUrl().c_str());
-            char buffer[256];
-            snprintf(buffer, sizeof(buffer), Lang::Strings::CHECK_NEW_VERSION_FAILED, retry_delay, error_message);
-            Alert(Lang::Strings::ERROR, buffer, "cloud_slash", Lang::Sounds::OGG_EXCLAMATION);
+            // The device is usable during a background check, retry quietly
+            if (!background) {
+                char buffer[256];
+                snprintf(buffer, sizeof(buffer), Lang::Strings::CHECK_NEW_VERSION_FAILED, retry_delay, error_message);
+                Alert(Lang::Strings::ERROR, buffer, "cloud_slash", Lang::Sounds::OGG_EXCLAMATION);
+            }
 
             ESP_LOGW(TAG, "Check new version failed, retry in %d seconds (%d/%d)", retry_delay, retry_count, MAX_RETRY);
             for (int i = 0; i < retry_delay; i++) {
                 vTaskDelay(pdMS_TO_TICKS(1000));
-                if (GetDeviceState() == kDeviceStateIdle) {
+                if (!background && GetDeviceState() == kDeviceStateIdle) {
                     break;
                 }
             }
@@ -429,7 +527,21 @@ void Application::CheckNewVersion() {
         retry_delay = 10; // Reset retry delay
 
         if (ota_->HasNewVersion()) {
-            if (UpgradeFirmware(ota_->GetFirmwareUrl(), ota_->GetFirmwareVersion())) {
+            bool upgraded;
+#if CONFIG_OTA_BACKGROUND_DOWNLOAD
+            if (background) {
+                upgraded = UpgradeFirmwareInBackground(ota_->GetFirmwareUrl(), ota_->GetFirmwareVersion());
+            } else {
+                upgraded = UpgradeFirmware(ota_->GetFirmwareUrl(), ota_->GetFirmwareVersion());
+            }
+#else
+            if (background) {
+                // Do not interrupt a conversation
+                WaitForIdle();
+            }
+            upgraded = UpgradeFirmware(ota_->GetFirmwareUrl(), ota_->GetFirmwareVersion());
+#endif
+            if (upgraded) {
                 return; // This line will never be reached after reboot
             }
             // If upgrade failed, continue to normal operation
@@ -442,6 +554,14 @@ void Application::CheckNewVersion() {
             break;
         }
 
+        if (background) {
+            // Do not take over the screen while the device is in use, activate on the next boot
+            ESP_LOGW(TAG, "Device needs activation, it will be activated on the next boot");
+            Settings settings("protocol", true);
+            settings.EraseKey("type");
+            break;
+        }
+
         display->SetStatus(Lang::Strings::ACTIVATION);
         // Activation code is shown to the user and waiting for the user to input
         if (ota_->HasActivationCode()) {
@@ -473,12 +593,23 @@ void Application::InitializeProtocol() {
 
     display->SetStatus(Lang::Strings::LOADING_PROTOCOL);
 
-    if (ota_->HasMqttConfig()) {
-        protocol_ = std::make_unique<MqttProtocol>();
-    } else if (ota_->HasWebsocketConfig()) {
+    // Remember the protocol chosen by the server, the next boot starts it before the version check
+    Settings settings("protocol", true);
+    std::string type = settings.GetString("type");
+    if (ota_->HasMqttConfig() || ota_->HasWebsocketConfig()) {
+        std::string server_type = ota_->HasMqttConfig() ? "mqtt" : "websocket";
+        if (type != server_type) {
+            type = server_type;
+            settings.SetString("type", type);
+        }
+    } else if (type.empty()) {
+        ESP_LOGW(TAG, "No protocol specified in the OTA config, using MQTT");
+        type = "mqtt";
+    }
+
+    if (type == "websocket") {
         protocol_ = std::make_unique<WebsocketProtocol>();
     } else {
-        ESP_LOGW(TAG, "No protocol specified in the OTA config, using MQTT");
         protocol_ = std::make_unique<MqttProtocol>();
     }
 
@@ -511,9 +642,11 @@ void Application::InitializeProtocol() {
             auto display = Board::GetInstance().GetDisplay();
             display->SetChatMessage("system", "");
             SetDeviceState(kDeviceStateIdle);
-        });
+        }, kSchedulePriorityState);
     });
     
+    // Everything scheduled for one message goes to the state lane, so the messages are handled in
+    // the order they arrived, e.g. a subtitle is shown before the tts stop that follows it
     protocol_->OnIncomingJson([this, display](const cJSON* root) {
         // Parse JSON data
         auto type = cJSON_GetObjectItem(root, "type");
@@ -523,7 +656,7 @@ void Application::InitializeProtocol() {
                 Schedule([this]() {
                     aborted_ = false;
                     SetDeviceState(kDeviceStateSpeaking);
-                });
+                }, kSchedulePriorityState);
             } else if (strcmp(state->valuestring, "stop") == 0) {
                 Schedule([this]() {
                     if (GetDeviceState() == kDeviceStateSpeaking) {
@@ -533,14 +666,14 @@ void Application::InitializeProtocol() {
                             SetDeviceState(kDeviceStateListening);
                         }
                     }
-                });
+                }, kSchedulePriorityState);
             } else if (strcmp(state->valuestring, "sentence_start") == 0) {
                 auto text = cJSON_GetObjectItem(root, "text");
                 if (cJSON_IsString(text)) {
                     ESP_LOGI(TAG, "<< %s", text->valuestring);
                     Schedule([this, display, message = std::string(text->valuestring)]() {
                         display->SetChatMessage("assistant", message.c_str());
-                    });
+                    }, kSchedulePriorityState);
                 }
             }
         } else if (strcmp(type->valuestring, "stt") == 0) {
@@ -549,14 +682,14 @@ void Application::InitializeProtocol() {
                 ESP_LOGI(TAG, ">> %s", text->valuestring);
                 Schedule([this, display, message = std::string(text->valuestring)]() {
                     display->SetChatMessage("user", message.c_str());
-                });
+                }, kSchedulePriorityState);
             }
         } else if (strcmp(type->valuestring, "llm") == 0) {
             auto emotion = cJSON_GetObjectItem(root, "emotion");
             if (cJSON_IsString(emotion)) {
                 Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
                     display->SetEmotion(emotion_str.c_str());
-                });
+                }, kSchedulePriorityState);
             }
         } else if (strcmp(type->valuestring, "mcp") == 0) {
             auto payload = cJSON_GetObjectItem(root, "payload");
@@ -571,7 +704,7 @@ void Application::InitializeProtocol() {
                     // Do a reboot if user requests a OTA update
                     Schedule([this]() {
                         Reboot();
-                    });
+                    }, kSchedulePriorityState);
                 } else {
                     ESP_LOGW(TAG, "Unknown system command: %s", command->valuestring);
                 }
@@ -592,7 +725,7 @@ void Application::InitializeProtocol() {
             if (cJSON_IsObject(payload)) {
                 Schedule([this, display, payload_str = std::string(cJSON_PrintUnformatted(payload))]() {
                     display->SetChatMessage("system", payload_str.c_str());
-                });
+                }, kSchedulePriorityState);
             } else {
                 ESP_LOGW(TAG, "Invalid custom message format: missing payload");
             }
@@ -638,9 +771,12 @@ void Application::ShowActivationCode(const std::string& code, const std::string&
 void Application::Alert(const char* status, const char* message, const char* emotion, const std::string_view& sound) {
     ESP_LOGW(TAG, "Alert [%s] %s: %s", emotion, status, message);
     auto display = Board::GetInstance().GetDisplay();
-    display->SetStatus(status);
-    display->SetEmotion(emotion);
-    display->SetChatMessage("system", message);
+    {
+        DisplayLockGuard lock(display);
+        display->SetStatus(status);
+        display->SetEmotion(emotion);
+        display->SetChatMessage("system", message);
+    }
     if (!sound.empty()) {
         audio_service_.PlaySound(sound);
     }
@@ -649,6 +785,7 @@ void Application::Alert(const char* status, const char* message, const char* emo
 void Application::DismissAlert() {
     if (GetDeviceState() == kDeviceStateIdle) {
         auto display = Board::GetInstance().GetDisplay();
+        DisplayLockGuard lock(display);
         display->SetStatus(Lang::Strings::STANDBY);
         display->SetEmotion("neutral");
         display->SetChatMessage("system", "");
@@ -801,24 +938,48 @@ void Application::HandleStateChangedEvent() {
     auto display = board.GetDisplay();
     auto led = board.GetLed();
     led->OnStateChanged();
+
+    if (new_state == kDeviceStateListening) {
+        display->SetFrameRateLimit(DISPLAY_FPS_LISTENING);
+    } else if (new_state == kDeviceStateSpeaking) {
+        display->SetFrameRateLimit(DISPLAY_FPS_SPEAKING);
+    } else {
+        display->SetFrameRateLimit(DISPLAY_FPS_IDLE);
+    }
+
+    {
+        // Update the UI in one transaction, so the new state shows up in a single frame
+        DisplayLockGuard lock(display);
+        switch (new_state) {
+            case kDeviceStateUnknown:
+            case kDeviceStateIdle:
+                display->SetStatus(Lang::Strings::STANDBY);
+                display->SetEmotion("neutral");
+                break;
+            case kDeviceStateConnecting:
+                display->SetStatus(Lang::Strings::CONNECTING);
+                display->SetEmotion("neutral");
+                display->SetChatMessage("system", "");
+                break;
+            case kDeviceStateListening:
+                display->SetStatus(Lang::Strings::LISTENING);
+                display->SetEmotion("neutral");
+                break;
+            case kDeviceStateSpeaking:
+                display->SetStatus(Lang::Strings::SPEAKING);
+                break;
+            default:
+                break;
+        }
+    }
     
     switch (new_state) {
         case kDeviceStateUnknown:
         case kDeviceStateIdle:
-            display->SetStatus(Lang::Strings::STANDBY);
-            display->SetEmotion("neutral");
             audio_service_.EnableVoiceProcessing(false);
             audio_service_.EnableWakeWordDetection(true);
             break;
-        case kDeviceStateConnecting:
-            display->SetStatus(Lang::Strings::CONNECTING);
-            display->SetEmotion("neutral");
-            display->SetChatMessage("system", "");
-            break;
         case kDeviceStateListening:
-            display->SetStatus(Lang::Strings::LISTENING);
-            display->SetEmotion("neutral");
-
             // Make sure the audio processor is running
             if (!audio_service_.IsAudioProcessorRunning()) {
                 // Send the start listening command
@@ -834,8 +995,6 @@ void Application::HandleStateChangedEvent() {
             }
             break;
         case kDeviceStateSpeaking:
-            display->SetStatus(Lang::Strings::SPEAKING);
-
             if (listening_mode_ != kListeningModeRealtime) {
                 audio_service_.EnableVoiceProcessing(false);
                 // Only AFE wake word can be detected in speaking mode
@@ -853,11 +1012,8 @@ void Application::HandleStateChangedEvent() {
     }
 }
 
-void Application::Schedule(std::function<void()>&& callback) {
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        main_tasks_.push_back(std::move(callback));
-    }
+void Application::Schedule(MainTask&& callback, SchedulePriority priority) {
+    main_tasks_.Push(std::move(callback), priority);
     xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
 }
 
@@ -939,6 +1095,41 @@ bool Application::UpgradeFirmware(const std::string& url, const std::string& ver
     }
 }
 
+bool Application::UpgradeFirmwareInBackground(const std::string& url, const std::string& version) {
+    ESP_LOGI(TAG, "Downloading firmware %s in background from %s", version.c_str(), url.c_str());
+    background_upgrade_running_ = true;
+    bool upgrade_success = Ota::Upgrade(url, nullptr, CONFIG_OTA_BACKGROUND_RATE_LIMIT * 1024, [this]() {
+        auto state = GetDeviceState();
+        return state == kDeviceStateConnecting || state == kDeviceStateListening || state == kDeviceStateSpeaking;
+    });
+    background_upgrade_running_ = false;
+    if (!upgrade_success) {
+        ESP_LOGE(TAG, "Background firmware download failed");
+        return false;
+    }
+
+    // The new firmware is set to boot, restart into it when nobody is using the device
+    ESP_LOGI(TAG, "Firmware %s downloaded, waiting for an idle window to reboot", version.c_str());
+    auto waiting_task = xTaskGetCurrentTaskHandle();
+    while (true) {
+        WaitForIdle(BACKGROUND_UPGRADE_IDLE_SECONDS);
+        // Reboot in the main task, which owns the protocol and the audio service
+        Schedule([this, waiting_task, version]() {
+            if (!CanEnterSleepMode()) {
+                // The user woke the device in between, wait for the next idle window
+                xTaskNotifyGive(waiting_task);
+                return;
+            }
+            auto display = Board::GetInstance().GetDisplay();
+            std::string message = std::string(Lang::Strings::NEW_VERSION) + version;
+            display->ShowNotification(message.c_str());
+            Reboot();
+        }, kSchedulePriorityState);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        ESP_LOGI(TAG, "Device became active, postponing the reboot into firmware %s", version.c_str());
+    }
+}
+
 void Application::WakeWordInvoke(const std::string& wake_word) {
     if (!protocol_) {
         return;
@@ -975,13 +1166,13 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
     } else if (state == kDeviceStateSpeaking) {
         Schedule([this]() {
             AbortSpeaking(kAbortReasonNone);
-        });
+        }, kSchedulePriorityAudio);
     } else if (state == kDeviceStateListening) {   
         Schedule([this]() {
             if (protocol_) {
                 protocol_->CloseAudioChannel();
             }
-        });
+        }, kSchedulePriorityAudio);
     }
 }
 
@@ -990,6 +1181,10 @@ bool Application::CanEnterSleepMode() {
         return false;
     }
 
+    if (background_upgrade_running_) {
+        return false;
+    }
+
     if (protocol_ && protocol_->IsAudioChannelOpened()) {
         return false;
     }
@@ -1008,7 +1203,7 @@ void Application::SendMcpMessage(const std::string& payload) {
         if (protocol_) {
             protocol_->SendMcpMessage(payload);
         }
-    });
+    }, kSchedulePriorityTool);
 }
 
 void Application::SetAecMode(AecMode mode) {
@@ -1035,7 +1230,7 @@ void Application::SetAecMode(AecMode mode) {
         if (protocol_ && protocol_->IsAudioChannelOpened()) {
             protocol_->CloseAudioChannel();
         }
-    });
+    }, kSchedulePriorityAudio);
 }
 
 void Application::PlaySound(const std::string_view& sound) {
@@ -8,14 +8,15 @@
 
 #include <string>
 #include <mutex>
-#include <deque>
 #include <memory>
+#include <atomic>
 
 #include "protocol.h"
 #include "ota.h"
 #include "audio_service.h"
 #include "device_state.h"
 #include "device_state_machine.h"
+#include "main_task_queue.h"
 
 // Main event bits
 #define MAIN_EVENT_SCHEDULE             (1 << 0)
@@ -74,8 +75,9 @@ public:
 
     /**
      * Schedule a callback to be executed in the main task
+     * Higher priority callbacks run first, see SchedulePriority
      */
-    void Schedule(std::function<void()>&& callback);
+    void Schedule(MainTask&& callback, SchedulePriority priority = kSchedulePriorityUi);
 
     /**
      * Alert with status, message, emotion and optional sound
@@ -124,8 +126,7 @@ private:
     Application();
     ~Application();
 
-    std::mutex mutex_;
-    std::deque<std::function<void()>> main_tasks_;
+    MainTaskQueue main_tasks_;
     std::unique_ptr<Protocol> protocol_;
     EventGroupHandle_t event_group_ = nullptr;
     esp_timer_handle_t clock_timer_handle_ = nullptr;
@@ -139,6 +140,7 @@ private:
     bool has_server_time_ = false;
     bool aborted_ = false;
     bool assets_version_checked_ = false;
+    std::atomic<bool> background_upgrade_running_ = false;
     bool play_popup_on_listening_ = false;  // Flag to play popup sound after state changes to listening
     int clock_ticks_ = 0;
     TaskHandle_t activation_task_handle_ = nullptr;
@@ -156,10 +158,13 @@ private:
 
     // Activation task (runs in background)
     void ActivationTask();
+    // Block until the device could sleep (idle, no audio) for idle_seconds in a row
+    void WaitForIdle(int idle_seconds = 0);
+    bool UpgradeFirmwareInBackground(const std::string& url, const std::string& version);
 
     // Helper methods
     void CheckAssetsVersion();
-    void CheckNewVersion();
+    void CheckNewVersion(bool background = false);
     void InitializeProtocol();
     void ShowActivationCode(const std::string& code, const std::string& message);
     void SetListeningMode(ListeningMode mode);
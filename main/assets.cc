@@ -5,6 +5,10 @@
 #include "lvgl_theme.h"
 #include "emote_display.h"
 #include "expression_emote.h"
+#include "downloader.h"
+#include "assets_updater.h"
+#include "assets_table.h"
+#include "settings.h"
 #if HAVE_LVGL
 #include "display/lcd_display.h"
 #include <spi_flash_mmap.h>
@@ -12,20 +16,15 @@
 
 #include <esp_log.h>
 #include <esp_timer.h>
+#include <esp_rom_crc.h>
 #include <cbin_font.h>
+#include <cstring>
+#include <algorithm>
 
 
 #define TAG "Assets"
 #define PARTITION_LABEL "assets"
 
-struct mmap_assets_table {
-    char asset_name[32];          /*!< Name of the asset */
-    uint32_t asset_size;          /*!< Size of the asset */
-    uint32_t asset_offset;        /*!< Offset of the asset */
-    uint16_t asset_width;         /*!< Width of the asset */
-    uint16_t asset_height;        /*!< Height of the asset */
-};
-
 Assets::Assets() {
 #if HAVE_LVGL
     strategy_ = std::make_unique<Assets::LvglStrategy>();
@@ -50,7 +49,8 @@ bool Assets::FindPartition(Assets* assets) {
 }
 
 bool Assets::Apply() {
-    return strategy_ ? strategy_->Apply(this) : false;
+    applied_ = strategy_ ? strategy_->Apply(this) : false;
+    return applied_;
 }
 
 bool Assets::InitializePartition() {
@@ -58,6 +58,7 @@ bool Assets::InitializePartition() {
 }
 
 void Assets::UnApplyPartition() {
+    applied_ = false;
     if (strategy_) {
         strategy_->UnApplyPartition(this);
     }
@@ -118,17 +119,10 @@ bool Assets::LoadSrmodelsFromIndex(Assets* assets, cJSON* root) {
 }
 
 #if HAVE_LVGL
-uint32_t Assets::LvglStrategy::CalculateChecksum(const char* data, uint32_t length) {
-    uint32_t checksum = 0;
-    for (uint32_t i = 0; i < length; i++) {
-        checksum += data[i];
-    }
-    return checksum & 0xFFFF;
-}
-
 bool Assets::LvglStrategy::InitializePartition(Assets* assets) {
     assets->partition_valid_ = false;
-    assets_.clear();
+    table_files_ = 0;
+    checksum_failed_ = false;
 
     if (!Assets::FindPartition(assets)) {
         return false;
@@ -160,53 +154,162 @@ bool Assets::LvglStrategy::InitializePartition(Assets* assets) {
         return false;
     }
 
+    if (12 + sizeof(mmap_assets_table) * (size_t)stored_files > 12 + (size_t)stored_len) {
+        ESP_LOGE(TAG, "The assets table (%lu files) exceeds the stored length", stored_files);
+        return false;
+    }
+
+    auto table = (const mmap_assets_table*)(mmap_root_ + 12);
+    table_files_ = stored_files;
+    table_sorted_ = AssetsTableSorted(table, stored_files);
+    if (!table_sorted_) {
+        ESP_LOGW(TAG, "The assets table is not sorted, using linear lookup");
+    }
+
+    // Assets packed with a CRC table are verified one by one on first use
+    int crc_index = FindAsset(ASSETS_CRC_TABLE_NAME, strlen(ASSETS_CRC_TABLE_NAME));
+    if (crc_index >= 0 && table[crc_index].asset_size == stored_files * sizeof(uint32_t)) {
+        crc_table_ = mmap_root_ + 12 + sizeof(mmap_assets_table) * stored_files + table[crc_index].asset_offset + 2;
+        crc_verified_.reset(new std::atomic<uint8_t>[stored_files]());
+        crc_verified_[crc_index] = 1;
+    }
+
+    // The header and table identify the image, an image that passed the full checksum
+    // once (or was verified by the downloader) is not checksummed again at boot
+    fingerprint_ = esp_rom_crc32_le(0, (const uint8_t*)mmap_root_, 12 + sizeof(mmap_assets_table) * stored_files);
+    if (assets->partition_verified_) {
+        assets->partition_verified_ = false;
+        SetTrustedFingerprint(fingerprint_);
+        checksum_valid_ = true;
+        return true;
+    }
+    Settings settings("assets");
+    if ((uint32_t)settings.GetInt("trusted") == fingerprint_) {
+        ESP_LOGI(TAG, "The assets partition is trusted, skip checksum");
+        checksum_valid_ = true;
+        return true;
+    }
+
+    // With per-asset CRCs the full checksum is not needed before use, run it in the background
+    if (crc_table_ != nullptr) {
+        verify_cancel_ = false;
+        verify_running_ = true;
+        xTaskCreate([](void* arg) {
+            auto strategy = static_cast<LvglStrategy*>(arg);
+            strategy->VerifyTask();
+            strategy->verify_running_ = false;
+            vTaskDelete(NULL);
+        }, "assets_verify", 3072, this, 1, nullptr);
+        return true;
+    }
+
     auto start_time = esp_timer_get_time();
-    uint32_t calculated_checksum = CalculateChecksum(mmap_root_ + 12, stored_len);
+    uint32_t calculated_checksum = AssetsTableChecksum(mmap_root_ + 12, stored_len);
     auto end_time = esp_timer_get_time();
     ESP_LOGI(TAG, "The checksum calculation time is %d ms", int((end_time - start_time) / 1000));
 
     if (calculated_checksum != stored_chksum) {
         ESP_LOGE(TAG, "The calculated checksum (0x%lx) does not match the stored checksum (0x%lx)", calculated_checksum, stored_chksum);
+        table_files_ = 0;
         return false;
     }
 
     checksum_valid_ = true;
+    SetTrustedFingerprint(fingerprint_);
+    return true;
+}
 
-    for (uint32_t i = 0; i < stored_files; i++) {
-        auto item = (const mmap_assets_table*)(mmap_root_ + 12 + i * sizeof(mmap_assets_table));
-        auto asset = Asset{
-            .size = static_cast<size_t>(item->asset_size),
-            .offset = static_cast<size_t>(12 + sizeof(mmap_assets_table) * stored_files + item->asset_offset)
-        };
-        assets_[item->asset_name] = asset;
+void Assets::LvglStrategy::VerifyTask() {
+    uint32_t stored_chksum = *(const uint32_t*)(mmap_root_ + 4);
+    uint32_t stored_len = *(const uint32_t*)(mmap_root_ + 8);
+    const size_t chunk_size = 64 * 1024;
+
+    auto start_time = esp_timer_get_time();
+    uint32_t checksum = 0;
+    for (size_t offset = 0; offset < stored_len; offset += chunk_size) {
+        if (verify_cancel_) {
+            return;
+        }
+        size_t length = std::min<size_t>(chunk_size, stored_len - offset);
+        checksum += AssetsTableChecksum(mmap_root_ + 12 + offset, length);
+        vTaskDelay(1);
     }
-    return checksum_valid_;
+    checksum &= 0xFFFF;
+    auto end_time = esp_timer_get_time();
+
+    if (checksum != stored_chksum) {
+        // Same as a failed checksum at boot: stop serving assets from this partition, and make sure
+        // it is not trusted, so it is checked again after the next download or reboot
+        ESP_LOGE(TAG, "The calculated checksum (0x%lx) does not match the stored checksum (0x%lx)", checksum, stored_chksum);
+        checksum_failed_ = true;
+        Settings settings("assets", true);
+        settings.EraseKey("trusted");
+        return;
+    }
+    ESP_LOGI(TAG, "The assets checksum is verified in background in %d ms", int((end_time - start_time) / 1000));
+    checksum_valid_ = true;
+    SetTrustedFingerprint(fingerprint_);
+}
+
+void Assets::LvglStrategy::SetTrustedFingerprint(uint32_t fingerprint) {
+    Settings settings("assets", true);
+    settings.SetInt("trusted", (int32_t)fingerprint);
 }
 
 void Assets::LvglStrategy::UnApplyPartition(Assets* assets) {
+    // The background checksum reads the mapped partition, stop it first
+    verify_cancel_ = true;
+    while (verify_running_) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    // Cached GIF frames are keyed by their address in the mapped partition
+    GifFrameCache::GetInstance().Clear();
     if (mmap_handle_ != 0) {
         esp_partition_munmap(mmap_handle_);
         mmap_handle_ = 0;
         mmap_root_ = nullptr;
     }
     checksum_valid_ = false;
-    assets_.clear();
+    checksum_failed_ = false;
+    table_files_ = 0;
+    table_sorted_ = false;
+    crc_table_ = nullptr;
+    crc_verified_.reset();
     (void)assets; // Unused parameter
 }
 
+int Assets::LvglStrategy::FindAsset(const char* name, size_t length) const {
+    if (checksum_failed_) {
+        return -1;
+    }
+    return AssetsTableFind((const mmap_assets_table*)(mmap_root_ + 12), table_files_, table_sorted_, name, length);
+}
+
 bool Assets::LvglStrategy::GetAssetData(Assets* assets, const std::string& name, void*& ptr, size_t& size) {
-    auto asset = assets_.find(name);
-    if (asset == assets_.end()) {
+    int index = FindAsset(name.data(), name.size());
+    if (index < 0) {
         return false;
     }
-    auto data = (const char*)(mmap_root_ + asset->second.offset);
+    auto item = (const mmap_assets_table*)(mmap_root_ + 12) + index;
+    auto data = mmap_root_ + 12 + sizeof(mmap_assets_table) * table_files_ + item->asset_offset;
     if (data[0] != 'Z' || data[1] != 'Z') {
         ESP_LOGE(TAG, "The asset %s is not valid with magic %02x%02x", name.c_str(), data[0], data[1]);
         return false;
     }
 
+    if (crc_table_ != nullptr && !crc_verified_[index]) {
+        uint32_t expected;
+        memcpy(&expected, crc_table_ + index * sizeof(uint32_t), sizeof(expected));
+        uint32_t crc = esp_rom_crc32_le(0, (const uint8_t*)data + 2, item->asset_size);
+        if (crc != expected) {
+            ESP_LOGE(TAG, "The asset %s is corrupted, crc32 0x%08lx != 0x%08lx", name.c_str(), crc, expected);
+            return false;
+        }
+        crc_verified_[index] = 1;
+    }
+
     ptr = static_cast<void*>(const_cast<char*>(data + 2));
-    size = asset->second.size;
+    size = item->asset_size;
     return true;
 }
 
@@ -273,7 +376,7 @@ bool Assets::LvglStrategy::Apply(Assets* assets) {
                         ESP_LOGE(TAG, "Emoji %s image file %s is not found", name->valuestring, file->valuestring);
                         continue;
                     }
-                    custom_emoji_collection->AddEmoji(name->valuestring, new LvglRawImage(ptr, size));
+                    custom_emoji_collection->AddEmoji(name->valuestring, ptr, size);
                 }
             }
         }
@@ -422,126 +525,50 @@ bool Assets::EmoteStrategy::Apply(Assets* assets) {
     return true;
 }
 
-bool Assets::Download(std::string url, std::function<void(int progress, size_t speed)> progress_callback) {
+bool Assets::Download(std::string url, std::function<void(int progress, size_t speed)> progress_callback, const std::string& sha256) {
     ESP_LOGI(TAG, "Downloading new version of assets from %s", url.c_str());
 
-    // 取消当前资源分区的内存映射
+    // 取消当前资源分区的内存映射，分区内容即将改变，清除可信标记
     UnApplyPartition();
-
-    // 下载新的资源文件
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(0);
-    
-    if (!http->Open("GET", url)) {
-        ESP_LOGE(TAG, "Failed to open HTTP connection");
-        return false;
-    }
-
-    if (http->GetStatusCode() != 200) {
-        ESP_LOGE(TAG, "Failed to get assets, status code: %d", http->GetStatusCode());
-        return false;
-    }
-
-    size_t content_length = http->GetBodyLength();
-    if (content_length == 0) {
-        ESP_LOGE(TAG, "Failed to get content length");
-        return false;
-    }
-
-    if (content_length > partition_->size) {
-        ESP_LOGE(TAG, "Assets file size (%u) is larger than partition size (%lu)", content_length, partition_->size);
-        return false;
-    }
-
-    // 定义扇区大小为4KB（ESP32的标准扇区大小）
-    const size_t SECTOR_SIZE = esp_partition_get_main_flash_sector_size();
-    
-    // 计算需要擦除的扇区数量
-    size_t sectors_to_erase = (content_length + SECTOR_SIZE - 1) / SECTOR_SIZE; // 向上取整
-    size_t total_erase_size = sectors_to_erase * SECTOR_SIZE;
-    
-    ESP_LOGI(TAG, "Sector size: %u, content length: %u, sectors to erase: %u, total erase size: %u", 
-             SECTOR_SIZE, content_length, sectors_to_erase, total_erase_size);
-    
-    // 写入新的资源文件到分区，一边erase一边写入
-    char buffer[512];
-    size_t total_written = 0;
-    size_t recent_written = 0;
-    size_t current_sector = 0;
-    auto last_calc_time = esp_timer_get_time();
-    
-    while (true) {
-        int ret = http->Read(buffer, sizeof(buffer));
-        if (ret < 0) {
-            ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
-            return false;
-        }
-
-        if (ret == 0) {
-            break;
-        }
-
-        // 检查是否需要擦除新的扇区
-        size_t write_end_offset = total_written + ret;
-        size_t needed_sectors = (write_end_offset + SECTOR_SIZE - 1) / SECTOR_SIZE;
-        
-        // 擦除需要的新扇区
-        while (current_sector < needed_sectors) {
-            size_t sector_start = current_sector * SECTOR_SIZE;
-            size_t sector_end = (current_sector + 1) * SECTOR_SIZE;
-            
-            // 确保擦除范围不超过分区大小
-            if (sector_end > partition_->size) {
-                ESP_LOGE(TAG, "Sector end (%u) exceeds partition size (%lu)", sector_end, partition_->size);
-                return false;
-            }
-            
-            ESP_LOGD(TAG, "Erasing sector %u (offset: %u, size: %u)", current_sector, sector_start, SECTOR_SIZE);
-            esp_err_t err = esp_partition_erase_range(partition_, sector_start, SECTOR_SIZE);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to erase sector %u at offset %u: %s", current_sector, sector_start, esp_err_to_name(err));
-                return false;
-            }
-            
-            current_sector++;
-        }
-
-        // 写入数据到分区
-        esp_err_t err = esp_partition_write(partition_, total_written, buffer, ret);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to write to assets partition at offset %u: %s", total_written, esp_err_to_name(err));
-            return false;
-        }
-
-        total_written += ret;
-        recent_written += ret;
-
-        // 计算进度和速度
-        if (esp_timer_get_time() - last_calc_time >= 1000000 || total_written == content_length || ret == 0) {
-            size_t progress = total_written * 100 / content_length;
-            size_t speed = recent_written; // 每秒的字节数
-            ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %u B/s, Sectors erased: %u", 
-                     progress, total_written, content_length, speed, current_sector);
-            if (progress_callback) {
-                progress_callback(progress, speed);
+    {
+        Settings settings("assets", true);
+        settings.EraseKey("trusted");
+    }
+
+    // 优先增量更新，只下载有变化的条目；中断的完整下载则继续续传
+    if (!Downloader::HasCheckpoint("assets", url, partition_)) {
+        AssetsUpdater updater(partition_);
+        if (updater.Update(url, progress_callback) &&
+            (sha256.empty() || Downloader::VerifySha256(partition_, updater.total_size(), sha256))) {
+            download_resumable_ = false;
+            // 每个条目的 CRC 已经校验过，启动时无需再做全量校验
+            partition_verified_ = true;
+            bool initialized = InitializePartition();
+            partition_verified_ = false;
+            if (initialized) {
+                return true;
             }
-            last_calc_time = esp_timer_get_time();
-            recent_written = 0; // 重置最近写入的字节数
+            ESP_LOGW(TAG, "Assets partition is not valid after incremental update");
+            UnApplyPartition();
         }
+        ESP_LOGI(TAG, "Falling back to full download");
     }
-    
-    http->Close();
 
-    if (total_written != content_length) {
-        ESP_LOGE(TAG, "Downloaded size (%u) does not match expected size (%u)", total_written, content_length);
+    // 下载新的资源文件，中断后从断点续传
+    Downloader downloader(partition_, "assets");
+    downloader.SetExpectedSha256(sha256);
+    if (!downloader.Download(url, progress_callback)) {
+        download_resumable_ = downloader.resumable();
+        ESP_LOGE(TAG, "Failed to download assets%s", download_resumable_ ? ", will resume next time" : "");
         return false;
     }
+    download_resumable_ = false;
 
-    ESP_LOGI(TAG, "Assets download completed, total written: %u bytes, total sectors erased: %u", 
-             total_written, current_sector);
-
-    // 重新初始化资源分区
-    if (!InitializePartition()) {
+    // 重新初始化资源分区，SHA-256 校验通过的分区直接标记为可信
+    partition_verified_ = !sha256.empty();
+    bool initialized = InitializePartition();
+    partition_verified_ = false;
+    if (!initialized) {
         ESP_LOGE(TAG, "Failed to re-initialize assets partition");
         return false;
     }
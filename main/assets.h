@@ -4,22 +4,18 @@
 #include <string>
 #include <functional>
 #include <memory>
+#include <atomic>
 
 #include <cJSON.h>
 #include <esp_partition.h>
 #include <model_path.h>
-#include <map>
 #include <string>
+#include <vector>
 
 #if HAVE_LVGL
 #include <spi_flash_mmap.h>
 #endif
 
-struct Asset {
-    size_t size;
-    size_t offset;
-};
-
 class Assets {
 public:
     static Assets& GetInstance() {
@@ -28,12 +24,15 @@ public:
     }
     ~Assets();
 
-    bool Download(std::string url, std::function<void(int progress, size_t speed)> progress_callback);
+    bool Download(std::string url, std::function<void(int progress, size_t speed)> progress_callback, const std::string& sha256 = "");
     bool Apply();
     bool GetAssetData(const std::string& name, void*& ptr, size_t& size);
 
     inline bool partition_valid() const { return partition_valid_; }
     inline std::string default_assets_url() const { return default_assets_url_; }
+    // A failed download left a checkpoint, calling Download again with the same url resumes it
+    inline bool download_resumable() const { return download_resumable_; }
+    inline bool applied() const { return applied_; }
 
 private:
     Assets();
@@ -61,11 +60,24 @@ private:
         void UnApplyPartition(Assets* assets) override;
         bool GetAssetData(Assets* assets, const std::string& name, void*& ptr, size_t& size) override;
     private:
-        static uint32_t CalculateChecksum(const char* data, uint32_t length);
-        std::map<std::string, Asset> assets_;
+        int FindAsset(const char* name, size_t length) const;
+        void VerifyTask();
+        static void SetTrustedFingerprint(uint32_t fingerprint);
         esp_partition_mmap_handle_t mmap_handle_ = 0;
         const char* mmap_root_ = nullptr;
-        bool checksum_valid_ = false;
+        // The table is used in place from mmap, binary searched when the packer sorted it
+        uint32_t table_files_ = 0;
+        bool table_sorted_ = false;
+        std::atomic<bool> checksum_valid_ = false;
+        // Set when the background checksum fails, the table is no longer used as after a failed boot check
+        std::atomic<bool> checksum_failed_ = false;
+        // CRC32 of the header and table, stored in NVS once the image passed a full check
+        uint32_t fingerprint_ = 0;
+        std::atomic<bool> verify_running_ = false;
+        std::atomic<bool> verify_cancel_ = false;
+        const char* crc_table_ = nullptr;
+        // Written by every task that looks up assets, one atomic flag per table entry
+        std::unique_ptr<std::atomic<uint8_t>[]> crc_verified_;
     };
     
     class EmoteStrategy : public AssetStrategy {
@@ -82,6 +94,9 @@ private:
 protected:
     const esp_partition_t* partition_ = nullptr;
     bool partition_valid_ = false;
+    bool download_resumable_ = false;
+    bool partition_verified_ = false;   // Set by Download when the new contents were verified
+    bool applied_ = false;
     std::string default_assets_url_;
     srmodel_list_t* models_list_ = nullptr;
 };
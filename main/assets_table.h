@@ -0,0 +1,77 @@
+#ifndef ASSETS_TABLE_H
+#define ASSETS_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Table of the mmap assets partition, as written by scripts/spiffs_assets/assets_table.py
+ *
+ * |total_files 4|checksum 4|data_length 4|table: total_files entries|data|
+ *
+ * The checksum is the 16-bit sum of the table and the data bytes. The packer sorts
+ * the table by the zero padded name, so it can be binary searched in place.
+ */
+#define ASSETS_TABLE_HEADER_SIZE 12
+
+struct mmap_assets_table {
+    char asset_name[32];          /*!< Name of the asset */
+    uint32_t asset_size;          /*!< Size of the asset */
+    uint32_t asset_offset;        /*!< Offset of the asset from the end of the table */
+    uint16_t asset_width;         /*!< Width of the asset */
+    uint16_t asset_height;        /*!< Height of the asset */
+};
+static_assert(sizeof(mmap_assets_table) == 44, "The table entry must match assets_table.py");
+
+// Sum of the bytes, may be added up chunk by chunk and masked to 16 bits at the end
+inline uint32_t AssetsTableChecksum(const char* data, uint32_t length) {
+    uint32_t checksum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        checksum += (uint8_t)data[i];
+    }
+    return checksum & 0xFFFF;
+}
+
+inline bool AssetsTableSorted(const mmap_assets_table* table, uint32_t count) {
+    for (uint32_t i = 1; i < count; i++) {
+        if (memcmp(table[i - 1].asset_name, table[i].asset_name, sizeof(table[i].asset_name)) >= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns the index of the asset, or -1. A table that is not sorted is searched linearly.
+inline int AssetsTableFind(const mmap_assets_table* table, uint32_t count, bool sorted, const char* name, size_t length) {
+    char key[sizeof(mmap_assets_table::asset_name)] = {};
+    if (length > sizeof(key)) {
+        return -1;
+    }
+    memcpy(key, name, length);
+
+    if (!sorted) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (memcmp(table[i].asset_name, key, sizeof(key)) == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    int low = 0, high = (int)count - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        int cmp = memcmp(table[mid].asset_name, key, sizeof(key));
+        if (cmp == 0) {
+            return mid;
+        } else if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return -1;
+}
+
+#endif // ASSETS_TABLE_H
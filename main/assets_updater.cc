@@ -0,0 +1,373 @@
+#include "assets_updater.h"
+#include "assets_table.h"
+#include "board.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_rom_crc.h>
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <unordered_map>
+
+#define TAG "AssetsUpdater"
+
+// Enough for the header and the table of a few hundred entries in one request
+#define ASSETS_FIRST_FETCH_SIZE (16 * 1024)
+// Download regions closer than this are fetched with one request
+#define ASSETS_MERGE_GAP 4096
+#define ASSETS_MAX_REQUESTS 64
+// Above this share of the file a plain download is cheaper
+#define ASSETS_MAX_DOWNLOAD_PERCENT 80
+
+AssetsUpdater::AssetsUpdater(const esp_partition_t* partition) : partition_(partition) {
+    sector_size_ = esp_partition_get_main_flash_sector_size();
+}
+
+AssetsUpdater::~AssetsUpdater() {
+    free(sector_buffer_);
+}
+
+bool AssetsUpdater::Fetch(const std::string& url, size_t offset, size_t size, std::function<bool(const char* data, size_t size)> sink) {
+    auto http = Board::GetInstance().GetNetwork()->CreateHttp(0);
+    http->SetHeader("Range", "bytes=" + std::to_string(offset) + "-" + std::to_string(offset + size - 1));
+    if (!http->Open("GET", url)) {
+        ESP_LOGE(TAG, "Failed to open HTTP connection");
+        return false;
+    }
+    if (http->GetStatusCode() != 206) {
+        ESP_LOGW(TAG, "Range request not supported, status code: %d", http->GetStatusCode());
+        http->Close();
+        return false;
+    }
+
+    size_t remaining = http->GetBodyLength();
+    if (remaining == 0 || remaining > size) {
+        ESP_LOGE(TAG, "Unexpected range length %u for %u bytes at %u", remaining, size, offset);
+        http->Close();
+        return false;
+    }
+    char buffer[1024];
+    while (remaining > 0) {
+        int ret = http->Read(buffer, std::min(sizeof(buffer), remaining));
+        if (ret <= 0) {
+            ESP_LOGE(TAG, "Failed to read HTTP data: %d", ret);
+            http->Close();
+            return false;
+        }
+        if (!sink(buffer, ret)) {
+            http->Close();
+            return false;
+        }
+        remaining -= ret;
+    }
+    http->Close();
+    return true;
+}
+
+bool AssetsUpdater::FetchToString(const std::string& url, size_t offset, size_t size, std::string& data) {
+    data.reserve(data.size() + size);
+    return Fetch(url, offset, size, [&data](const char* buffer, size_t len) {
+        data.append(buffer, len);
+        return true;
+    });
+}
+
+bool AssetsUpdater::ParseTable(const char* table, size_t table_size, uint32_t files, std::vector<Entry>& entries) {
+    if (table_size < files * sizeof(mmap_assets_table)) {
+        return false;
+    }
+    size_t data_start = ASSETS_TABLE_HEADER_SIZE + files * sizeof(mmap_assets_table);
+    entries.clear();
+    entries.reserve(files);
+    for (uint32_t i = 0; i < files; i++) {
+        // The table may not be aligned in the fetched data
+        mmap_assets_table item;
+        memcpy(&item, table + i * sizeof(mmap_assets_table), sizeof(item));
+        entries.push_back(Entry{
+            .name = std::string(item.asset_name, strnlen(item.asset_name, sizeof(item.asset_name))),
+            .offset = data_start + item.asset_offset,
+            .size = item.asset_size,
+            .crc32 = 0,
+            .crc32_valid = false,
+        });
+    }
+    return true;
+}
+
+bool AssetsUpdater::LoadLocalEntries() {
+    uint32_t header[3];
+    if (esp_partition_read(partition_, 0, header, sizeof(header)) != ESP_OK) {
+        return false;
+    }
+    uint32_t files = header[0];
+    size_t table_size = (size_t)files * sizeof(mmap_assets_table);
+    if (files == 0 || files > 0xFFFF || ASSETS_TABLE_HEADER_SIZE + table_size > partition_->size) {
+        ESP_LOGI(TAG, "No valid assets in partition");
+        return false;
+    }
+
+    std::string table(table_size, '\0');
+    if (esp_partition_read(partition_, ASSETS_TABLE_HEADER_SIZE, table.data(), table_size) != ESP_OK ||
+        !ParseTable(table.data(), table_size, files, local_entries_)) {
+        return false;
+    }
+    // Drop entries that point outside the partition
+    local_entries_.erase(std::remove_if(local_entries_.begin(), local_entries_.end(), [this](const Entry& entry) {
+        return entry.offset + 2 + entry.size > partition_->size;
+    }), local_entries_.end());
+    return true;
+}
+
+bool AssetsUpdater::LocalCrc32(Entry& entry) {
+    if (entry.crc32_valid) {
+        return true;
+    }
+    char buffer[1024];
+    if (esp_partition_read(partition_, entry.offset, buffer, 2) != ESP_OK || buffer[0] != 'Z' || buffer[1] != 'Z') {
+        return false;
+    }
+    uint32_t crc = 0;
+    for (size_t pos = 0; pos < entry.size; pos += sizeof(buffer)) {
+        size_t len = std::min(sizeof(buffer), entry.size - pos);
+        if (esp_partition_read(partition_, entry.offset + 2 + pos, buffer, len) != ESP_OK) {
+            return false;
+        }
+        crc = esp_rom_crc32_le(crc, (const uint8_t*)buffer, len);
+    }
+    entry.crc32 = crc;
+    entry.crc32_valid = true;
+    return true;
+}
+
+bool AssetsUpdater::Flush() {
+    if (sector_offset_ == SIZE_MAX) {
+        return true;
+    }
+    esp_err_t err = esp_partition_erase_range(partition_, sector_offset_, sector_size_);
+    if (err == ESP_OK) {
+        err = esp_partition_write(partition_, sector_offset_, sector_buffer_, sector_size_);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write sector at 0x%x: %s", sector_offset_, esp_err_to_name(err));
+        return false;
+    }
+    sector_offset_ = SIZE_MAX;
+    return true;
+}
+
+bool AssetsUpdater::Write(size_t offset, const char* data, size_t size) {
+    while (size > 0) {
+        // Read-modify-write, so bytes outside the updated regions are preserved
+        size_t sector = offset - offset % sector_size_;
+        if (sector != sector_offset_) {
+            if (!Flush()) {
+                return false;
+            }
+            if (esp_partition_read(partition_, sector, sector_buffer_, sector_size_) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to read sector at 0x%x", sector);
+                return false;
+            }
+            sector_offset_ = sector;
+        }
+        size_t n = std::min(size, sector + sector_size_ - offset);
+        memcpy(sector_buffer_ + (offset - sector), data, n);
+        offset += n;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+void AssetsUpdater::ReportProgress(size_t bytes) {
+    downloaded_ += bytes;
+    recent_downloaded_ += bytes;
+    if (esp_timer_get_time() - last_calc_time_ < 1000000 && downloaded_ < download_size_) {
+        return;
+    }
+    size_t progress = download_size_ > 0 ? downloaded_ * 100 / download_size_ : 100;
+    ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %uB/s", progress, downloaded_, download_size_, recent_downloaded_);
+    if (callback_) {
+        callback_(progress, recent_downloaded_);
+    }
+    last_calc_time_ = esp_timer_get_time();
+    recent_downloaded_ = 0;
+}
+
+bool AssetsUpdater::Update(const std::string& url, ProgressCallback callback) {
+    auto start_time = esp_timer_get_time();
+    callback_ = callback;
+
+    // The header and the table of the new file
+    std::string head;
+    if (!FetchToString(url, 0, ASSETS_FIRST_FETCH_SIZE, head) || head.size() < ASSETS_TABLE_HEADER_SIZE) {
+        return false;
+    }
+    uint32_t header[3];
+    memcpy(header, head.data(), sizeof(header));
+    uint32_t files = header[0];
+    total_size_ = ASSETS_TABLE_HEADER_SIZE + header[2];
+    size_t table_end = ASSETS_TABLE_HEADER_SIZE + (size_t)files * sizeof(mmap_assets_table);
+    if (total_size_ > partition_->size || table_end > total_size_) {
+        ESP_LOGE(TAG, "Invalid assets header, size %u", total_size_);
+        return false;
+    }
+    if (head.size() < table_end && !FetchToString(url, head.size(), table_end - head.size(), head)) {
+        return false;
+    }
+    std::vector<Entry> entries;
+    if (!ParseTable(head.data() + ASSETS_TABLE_HEADER_SIZE, head.size() - ASSETS_TABLE_HEADER_SIZE, files, entries)) {
+        return false;
+    }
+
+    // Per-entry CRC32, packed by the build scripts since the incremental format
+    auto crc_entry = std::find_if(entries.begin(), entries.end(), [](const Entry& entry) {
+        return entry.name == ASSETS_CRC_TABLE_NAME;
+    });
+    if (crc_entry == entries.end() || crc_entry->size != files * sizeof(uint32_t)) {
+        ESP_LOGI(TAG, "No CRC table in assets, incremental update is not possible");
+        return false;
+    }
+    std::string crc_table;
+    if (!FetchToString(url, crc_entry->offset + 2, crc_entry->size, crc_table) || crc_table.size() != crc_entry->size) {
+        return false;
+    }
+    for (uint32_t i = 0; i < files; i++) {
+        memcpy(&entries[i].crc32, crc_table.data() + i * sizeof(uint32_t), sizeof(uint32_t));
+        entries[i].crc32_valid = true;
+    }
+
+    // Match the new entries against what is already in flash
+    LoadLocalEntries();
+    std::unordered_map<std::string, size_t> local_by_name;
+    std::unordered_multimap<size_t, size_t> local_by_size;
+    for (size_t i = 0; i < local_entries_.size(); i++) {
+        local_by_name[local_entries_[i].name] = i;
+        local_by_size.emplace(local_entries_[i].size, i);
+    }
+
+    std::vector<Region> regions;
+    regions.push_back(Region{ .offset = 0, .size = table_end, .copy = false, .source = 0 });
+    int kept = 0;
+    for (auto& entry : entries) {
+        Region region = { .offset = entry.offset, .size = entry.size + 2, .copy = false, .source = 0 };
+        if (&entry != &*crc_entry) {
+            auto by_name = local_by_name.find(entry.name);
+            if (by_name != local_by_name.end()) {
+                auto& local = local_entries_[by_name->second];
+                if (local.offset == entry.offset && local.size == entry.size && LocalCrc32(local) && local.crc32 == entry.crc32) {
+                    kept++;
+                    continue;
+                }
+            }
+            // Same content somewhere else in flash
+            auto range = local_by_size.equal_range(entry.size);
+            for (auto it = range.first; it != range.second; ++it) {
+                auto& local = local_entries_[it->second];
+                if (LocalCrc32(local) && local.crc32 == entry.crc32) {
+                    region.copy = true;
+                    region.source = local.offset;
+                    break;
+                }
+            }
+        }
+        regions.push_back(region);
+    }
+    std::sort(regions.begin(), regions.end(), [](const Region& a, const Region& b) {
+        return a.offset < b.offset;
+    });
+
+    // Merge nearby downloads, the bytes in between come from the new file as well
+    std::vector<Region> merged;
+    for (auto& region : regions) {
+        if (!region.copy && !merged.empty() && !merged.back().copy &&
+            region.offset <= merged.back().offset + merged.back().size + ASSETS_MERGE_GAP) {
+            merged.back().size = region.offset + region.size - merged.back().offset;
+            continue;
+        }
+        merged.push_back(region);
+    }
+
+    // A copy is only safe if its source is not overwritten by this update
+    int copied = 0, requests = 0;
+    download_size_ = 0;
+    for (auto& region : merged) {
+        if (region.copy) {
+            bool overlaps = std::any_of(merged.begin(), merged.end(), [&region](const Region& target) {
+                return region.source < target.offset + target.size && target.offset < region.source + region.size;
+            });
+            if (!overlaps) {
+                copied++;
+                continue;
+            }
+            region.copy = false;
+        }
+        download_size_ += region.size;
+        requests++;
+    }
+    ESP_LOGI(TAG, "Incremental update: %d kept, %d copied, %u of %u bytes in %d requests",
+        kept, copied, download_size_, total_size_, requests);
+    if (download_size_ * 100 > total_size_ * ASSETS_MAX_DOWNLOAD_PERCENT || requests > ASSETS_MAX_REQUESTS) {
+        ESP_LOGI(TAG, "Too many changes for an incremental update");
+        return false;
+    }
+
+    sector_buffer_ = (char*)malloc(sector_size_);
+    if (sector_buffer_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate sector buffer");
+        return false;
+    }
+
+    // Regions are applied in partition order, so every sector is erased once
+    downloaded_ = 0;
+    recent_downloaded_ = 0;
+    last_calc_time_ = esp_timer_get_time();
+    for (auto& region : merged) {
+        if (region.copy) {
+            char buffer[1024];
+            for (size_t pos = 0; pos < region.size; pos += sizeof(buffer)) {
+                size_t len = std::min(sizeof(buffer), region.size - pos);
+                if (esp_partition_read(partition_, region.source + pos, buffer, len) != ESP_OK ||
+                    !Write(region.offset + pos, buffer, len)) {
+                    return false;
+                }
+            }
+            continue;
+        }
+
+        size_t position = region.offset;
+        bool ok = Fetch(url, region.offset, region.size, [this, &position](const char* data, size_t len) {
+            if (!Write(position, data, len)) {
+                return false;
+            }
+            position += len;
+            ReportProgress(len);
+            return true;
+        });
+        if (!ok || position != region.offset + region.size) {
+            ESP_LOGE(TAG, "Failed to download %u bytes at %u", region.size, region.offset);
+            Flush();
+            return false;
+        }
+    }
+    if (!Flush()) {
+        return false;
+    }
+
+    // Check every entry in flash against the CRC table
+    for (auto& entry : entries) {
+        if (&entry == &*crc_entry) {
+            continue;
+        }
+        Entry written = entry;
+        written.crc32_valid = false;
+        if (!LocalCrc32(written) || written.crc32 != entry.crc32) {
+            ESP_LOGE(TAG, "Entry %s does not match after update", entry.name.c_str());
+            return false;
+        }
+    }
+
+    ESP_LOGI(TAG, "Incremental update finished in %dms", (int)((esp_timer_get_time() - start_time) / 1000));
+    return true;
+}
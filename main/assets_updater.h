@@ -0,0 +1,77 @@
+#ifndef _ASSETS_UPDATER_H_
+#define _ASSETS_UPDATER_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include <esp_partition.h>
+
+#define ASSETS_CRC_TABLE_NAME "crc32.bin"
+
+/**
+ * Incremental update of the assets partition.
+ *
+ * assets.bin describes itself: the header and table give the offset and size of
+ * every entry, and the crc32.bin entry holds the CRC32 of every entry. The updater
+ * fetches those with HTTP Range requests, keeps entries that are already in flash
+ * at the right place, copies entries that only moved, and downloads the rest.
+ * Sectors shared with unchanged data are read, patched and written back.
+ */
+class AssetsUpdater {
+public:
+    typedef std::function<void(int progress, size_t speed)> ProgressCallback;
+
+    AssetsUpdater(const esp_partition_t* partition);
+    ~AssetsUpdater();
+
+    /**
+     * Returns true if the partition now holds the file at url. On false a full
+     * download is needed, the partition may have been partially updated.
+     */
+    bool Update(const std::string& url, ProgressCallback callback);
+
+    size_t total_size() const { return total_size_; }
+
+private:
+    struct Entry {
+        std::string name;
+        size_t offset;  // Offset of the 0x5A5A prefix in the partition
+        size_t size;    // Size of the file data after the prefix
+        uint32_t crc32;
+        bool crc32_valid;
+    };
+
+    struct Region {
+        size_t offset;
+        size_t size;
+        bool copy;      // Copy from `source` in the same partition instead of downloading
+        size_t source;
+    };
+
+    const esp_partition_t* partition_;
+    size_t sector_size_;
+    size_t total_size_ = 0;
+    char* sector_buffer_ = nullptr;
+    size_t sector_offset_ = SIZE_MAX;
+    std::vector<Entry> local_entries_;
+
+    // Progress
+    size_t download_size_ = 0;
+    size_t downloaded_ = 0;
+    size_t recent_downloaded_ = 0;
+    int64_t last_calc_time_ = 0;
+    ProgressCallback callback_;
+
+    bool Fetch(const std::string& url, size_t offset, size_t size, std::function<bool(const char* data, size_t size)> sink);
+    bool FetchToString(const std::string& url, size_t offset, size_t size, std::string& data);
+    static bool ParseTable(const char* table, size_t table_size, uint32_t files, std::vector<Entry>& entries);
+    bool LoadLocalEntries();
+    bool LocalCrc32(Entry& entry);
+    bool Write(size_t offset, const char* data, size_t size);
+    bool Flush();
+    void ReportProgress(size_t bytes);
+};
+
+#endif // _ASSETS_UPDATER_H_
@@ -3,9 +3,23 @@
 
 #include <string>
 
+// Encoding options for the explain upload, requested by the server in the vision capability
+struct CameraEncodeOptions {
+    int quality = 80;
+    int max_width = 0;      // 0 means no downscale
+    int max_height = 0;
+    size_t max_bytes = 0;   // 0 means fixed quality
+    // Region of interest as fractions of the frame, full frame by default
+    float roi_x = 0.0f;
+    float roi_y = 0.0f;
+    float roi_width = 1.0f;
+    float roi_height = 1.0f;
+};
+
 class Camera {
 public:
     virtual void SetExplainUrl(const std::string& url, const std::string& token) = 0;
+    virtual void SetEncodeOptions(const CameraEncodeOptions& options) {}
     virtual bool Capture() = 0;
     virtual bool SetHMirror(bool enabled) = 0;
     virtual bool SetVFlip(bool enabled) = 0;
@@ -21,6 +21,7 @@
 #include "jpg/jpeg_to_image.h"
 #include "lvgl_display.h"
 #include "mcp_server.h"
+#include "streaming_uploader.h"
 #include "system_info.h"
 
 #ifdef CONFIG_XIAOZHI_ENABLE_CAMERA_DEBUG_MODE
@@ -383,11 +384,11 @@ void Esp32Camera::SetExplainUrl(const std::string& url, const std::string& token
     explain_token_ = token;
 }
 
-bool Esp32Camera::Capture() {
-    if (encoder_thread_.joinable()) {
-        encoder_thread_.join();
-    }
+void Esp32Camera::SetEncodeOptions(const CameraEncodeOptions& options) {
+    encode_options_ = options;
+}
 
+bool Esp32Camera::Capture() {
     if (!streaming_on_ || video_fd_ < 0) {
         return false;
     }
@@ -900,136 +901,55 @@ std::string Esp32Camera::Explain(const std::string& question) {
         throw std::runtime_error("Image explain URL or token is not set");
     }
 
-    // 创建局部的 JPEG 队列, 40 entries is about to store 512 * 40 = 20480 bytes of JPEG data
-    QueueHandle_t jpeg_queue = xQueueCreate(40, sizeof(JpegChunk));
-    if (jpeg_queue == nullptr) {
-        ESP_LOGE(TAG, "Failed to create JPEG queue");
-        throw std::runtime_error("Failed to create JPEG queue");
-    }
-
-    // We spawn a thread to encode the image to JPEG using optimized encoder (cost about 500ms and 8KB SRAM)
-    encoder_thread_ = std::thread([this, jpeg_queue]() {
-        uint16_t w = frame_.width ? frame_.width : 320;
-        uint16_t h = frame_.height ? frame_.height : 240;
-        v4l2_pix_fmt_t enc_fmt = frame_.format;
-        bool ok = image_to_jpeg_cb(
-            frame_.data, frame_.len, w, h, enc_fmt, 80,
+    StreamingUploader uploader;
+    uploader.SetHeader("Device-Id", SystemInfo::GetMacAddress());
+    uploader.SetHeader("Client-Id", Board::GetInstance().GetUuid());
+    if (!explain_token_.empty()) {
+        uploader.SetHeader("Authorization", "Bearer " + explain_token_);
+    }
+    uploader.AddFormField("question", question);
+    uploader.SetFileField("file", "camera.jpg", "image/jpeg");
+
+    uint16_t w = frame_.width ? frame_.width : 320;
+    uint16_t h = frame_.height ? frame_.height : 240;
+    // NaN 按 0 处理，尺寸上限按 uint16_t 截断
+    auto clamp_fraction = [](float v) { return v >= 0.0f ? (v > 1.0f ? 1.0f : v) : 0.0f; };
+    auto clamp_size = [](int v) { return (uint16_t)(v <= 0 ? 0 : (v > UINT16_MAX ? UINT16_MAX : v)); };
+    image_to_jpeg_opts_t opts = {
+        .crop_x = (uint16_t)(clamp_fraction(encode_options_.roi_x) * w),
+        .crop_y = (uint16_t)(clamp_fraction(encode_options_.roi_y) * h),
+        .crop_width = (uint16_t)(clamp_fraction(encode_options_.roi_width) * w),
+        .crop_height = (uint16_t)(clamp_fraction(encode_options_.roi_height) * h),
+        .max_width = clamp_size(encode_options_.max_width),
+        .max_height = clamp_size(encode_options_.max_height),
+        .quality = (uint8_t)(encode_options_.quality >= 1 && encode_options_.quality <= 100 ? encode_options_.quality : 80),
+        .target_bytes = encode_options_.max_bytes,
+    };
+    // Without ROI or scaling the frame is encoded as is. Otherwise the encoder needs at least
+    // one 16x16 block, report a smaller region instead of sending the full frame
+    uint16_t out_w, out_h;
+    if (!image_to_jpeg_output_size(w, h, &opts, &out_w, &out_h)) {
+        ESP_LOGE(TAG, "The region of interest (%ux%u at %u,%u) of the %ux%u frame is too small to encode",
+                 opts.crop_width, opts.crop_height, opts.crop_x, opts.crop_y, w, h);
+        throw std::runtime_error("The region of interest is too small, the encoded image must be at least 16x16 pixels");
+    }
+
+    // The encoder runs on the uploader's producer thread and writes each 16-line block of
+    // JPEG output as it is encoded, so encoding overlaps the connection setup and the upload.
+    // The hardware encoder and a max_bytes budget still hand over the whole JPEG at once
+    std::string result = uploader.Upload(explain_url_, [this, w, h, opts](StreamingUploader& stream) -> bool {
+        return image_to_jpeg_cb_ex(
+            frame_.data, frame_.len, w, h, frame_.format, &opts,
             [](void* arg, size_t index, const void* data, size_t len) -> size_t {
-                auto jpeg_queue = static_cast<QueueHandle_t>(arg);
-                JpegChunk chunk = {.data = nullptr, .len = len};
-                if (index == 0 && data != nullptr && len > 0) {
-                    chunk.data = (uint8_t*)heap_caps_aligned_alloc(16, len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-                    if (chunk.data == nullptr) {
-                        ESP_LOGE(TAG, "Failed to allocate %zu bytes for JPEG chunk", len);
-                        chunk.len = 0;
-                    } else {
-                        memcpy(chunk.data, data, len);
-                    }
-                } else {
-                    chunk.len = 0;  // Sentinel or error
+                auto stream = static_cast<StreamingUploader*>(arg);
+                if (data != nullptr && len > 0 && !stream->Write(data, len)) {
+                    return 0;
                 }
-                xQueueSend(jpeg_queue, &chunk, portMAX_DELAY);
                 return len;
             },
-            jpeg_queue);
-
-        if (!ok) {
-            JpegChunk chunk = {.data = nullptr, .len = 0};
-            xQueueSend(jpeg_queue, &chunk, portMAX_DELAY);
-        }
+            &stream);
     });
-
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(3);
-    // 构造multipart/form-data请求体
-    std::string boundary = "----ESP32_CAMERA_BOUNDARY";
-
-    // 配置HTTP客户端，使用分块传输编码
-    http->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
-    http->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
-    if (!explain_token_.empty()) {
-        http->SetHeader("Authorization", "Bearer " + explain_token_);
-    }
-    http->SetHeader("Content-Type", "multipart/form-data; boundary=" + boundary);
-    http->SetHeader("Transfer-Encoding", "chunked");
-    if (!http->Open("POST", explain_url_)) {
-        ESP_LOGE(TAG, "Failed to connect to explain URL");
-        // Clear the queue
-        encoder_thread_.join();
-        JpegChunk chunk;
-        while (xQueueReceive(jpeg_queue, &chunk, portMAX_DELAY) == pdPASS) {
-            if (chunk.data != nullptr) {
-                heap_caps_free(chunk.data);
-            } else {
-                break;
-            }
-        }
-        vQueueDelete(jpeg_queue);
-        throw std::runtime_error("Failed to connect to explain URL");
-    }
-
-    {
-        // 第一块：question字段
-        std::string question_field;
-        question_field += "--" + boundary + "\r\n";
-        question_field += "Content-Disposition: form-data; name=\"question\"\r\n";
-        question_field += "\r\n";
-        question_field += question + "\r\n";
-        http->Write(question_field.c_str(), question_field.size());
-    }
-    {
-        // 第二块：文件字段头部
-        std::string file_header;
-        file_header += "--" + boundary + "\r\n";
-        file_header += "Content-Disposition: form-data; name=\"file\"; filename=\"camera.jpg\"\r\n";
-        file_header += "Content-Type: image/jpeg\r\n";
-        file_header += "\r\n";
-        http->Write(file_header.c_str(), file_header.size());
-    }
-
-    // 第三块：JPEG数据
-    size_t total_sent = 0;
-    bool saw_terminator = false;
-    while (true) {
-        JpegChunk chunk;
-        if (xQueueReceive(jpeg_queue, &chunk, portMAX_DELAY) != pdPASS) {
-            ESP_LOGE(TAG, "Failed to receive JPEG chunk");
-            break;
-        }
-        if (chunk.data == nullptr) {
-            saw_terminator = true;
-            break;  // The last chunk
-        }
-        http->Write((const char*)chunk.data, chunk.len);
-        total_sent += chunk.len;
-        heap_caps_free(chunk.data);
-    }
-    // Wait for the encoder thread to finish
-    encoder_thread_.join();
-    // 清理队列
-    vQueueDelete(jpeg_queue);
-
-    if (!saw_terminator || total_sent == 0) {
-        ESP_LOGE(TAG, "JPEG encoder failed or produced empty output");
-        throw std::runtime_error("Failed to encode image to JPEG");
-    }
-
-    {
-        // 第四块：multipart尾部
-        std::string multipart_footer;
-        multipart_footer += "\r\n--" + boundary + "--\r\n";
-        http->Write(multipart_footer.c_str(), multipart_footer.size());
-    }
-    // 结束块
-    http->Write("", 0);
-
-    if (http->GetStatusCode() != 200) {
-        ESP_LOGE(TAG, "Failed to upload photo, status code: %d", http->GetStatusCode());
-        throw std::runtime_error("Failed to upload photo");
-    }
-
-    std::string result = http->ReadAll();
-    http->Close();
+    size_t total_sent = uploader.stats().body_bytes;
 
     // Get remain task stack size
     size_t remain_stack_size = uxTaskGetStackHighWaterMark(nullptr);
@@ -3,22 +3,13 @@
 
 #ifndef CONFIG_IDF_TARGET_ESP32
 #include <lvgl.h>
-#include <thread>
 #include <memory>
 #include <vector>
 
-#include <freertos/FreeRTOS.h>
-#include <freertos/queue.h>
-
 #include "camera.h"
 #include "jpg/image_to_jpeg.h"
 #include "esp_video_init.h"
 
-struct JpegChunk {
-    uint8_t* data;
-    size_t len;
-};
-
 class Esp32Camera : public Camera {
 private:
     struct FrameBuffer {
@@ -39,13 +30,14 @@ private:
     std::vector<MmapBuffer> mmap_buffers_;
     std::string explain_url_;
     std::string explain_token_;
-    std::thread encoder_thread_;
+    CameraEncodeOptions encode_options_;
 
 public:
     Esp32Camera(const esp_video_init_config_t& config);
     ~Esp32Camera();
 
     virtual void SetExplainUrl(const std::string& url, const std::string& token);
+    virtual void SetEncodeOptions(const CameraEncodeOptions& options) override;
     virtual bool Capture();
     // 翻转控制函数
     virtual bool SetHMirror(bool enabled) override;
@@ -118,6 +118,8 @@ void SleepTimer::CheckTimer() {
             on_enter_deep_sleep_mode_();
         }
 
+        // Deep sleep does not run shutdown handlers, commit pending settings first
+        Settings::Flush();
         esp_deep_sleep_start();
     }
 }
@@ -24,42 +24,42 @@ void ElectronEmojiDisplay::InitializeElectronEmojis() {
     auto otto_emoji_collection = std::make_shared<EmojiCollection>();
 
     // 中性/平静类表情 -> staticstate
-    otto_emoji_collection->AddEmoji("staticstate", new LvglRawImage((void*)staticstate.data, staticstate.data_size));
-    otto_emoji_collection->AddEmoji("neutral", new LvglRawImage((void*)staticstate.data, staticstate.data_size));
-    otto_emoji_collection->AddEmoji("relaxed", new LvglRawImage((void*)staticstate.data, staticstate.data_size));
-    otto_emoji_collection->AddEmoji("sleepy", new LvglRawImage((void*)staticstate.data, staticstate.data_size));
-    otto_emoji_collection->AddEmoji("idle", new LvglRawImage((void*)staticstate.data, staticstate.data_size));
+    otto_emoji_collection->AddEmoji("staticstate", staticstate.data, staticstate.data_size);
+    otto_emoji_collection->AddEmoji("neutral", staticstate.data, staticstate.data_size);
+    otto_emoji_collection->AddEmoji("relaxed", staticstate.data, staticstate.data_size);
+    otto_emoji_collection->AddEmoji("sleepy", staticstate.data, staticstate.data_size);
+    otto_emoji_collection->AddEmoji("idle", staticstate.data, staticstate.data_size);
 
     // 积极/开心类表情 -> happy
-    otto_emoji_collection->AddEmoji("happy", new LvglRawImage((void*)happy.data, happy.data_size));
-    otto_emoji_collection->AddEmoji("laughing", new LvglRawImage((void*)happy.data, happy.data_size));
-    otto_emoji_collection->AddEmoji("funny", new LvglRawImage((void*)happy.data, happy.data_size));
-    otto_emoji_collection->AddEmoji("loving", new LvglRawImage((void*)happy.data, happy.data_size));
-    otto_emoji_collection->AddEmoji("confident", new LvglRawImage((void*)happy.data, happy.data_size));
-    otto_emoji_collection->AddEmoji("winking", new LvglRawImage((void*)happy.data, happy.data_size));
-    otto_emoji_collection->AddEmoji("cool", new LvglRawImage((void*)happy.data, happy.data_size));
-    otto_emoji_collection->AddEmoji("delicious", new LvglRawImage((void*)happy.data, happy.data_size));
-    otto_emoji_collection->AddEmoji("kissy", new LvglRawImage((void*)happy.data, happy.data_size));
-    otto_emoji_collection->AddEmoji("silly", new LvglRawImage((void*)happy.data, happy.data_size));
+    otto_emoji_collection->AddEmoji("happy", happy.data, happy.data_size);
+    otto_emoji_collection->AddEmoji("laughing", happy.data, happy.data_size);
+    otto_emoji_collection->AddEmoji("funny", happy.data, happy.data_size);
+    otto_emoji_collection->AddEmoji("loving", happy.data, happy.data_size);
+    otto_emoji_collection->AddEmoji("confident", happy.data, happy.data_size);
+    otto_emoji_collection->AddEmoji("winking", happy.data, happy.data_size);
+    otto_emoji_collection->AddEmoji("cool", happy.data, happy.data_size);
+    otto_emoji_collection->AddEmoji("delicious", happy.data, happy.data_size);
+    otto_emoji_collection->AddEmoji("kissy", happy.data, happy.data_size);
+    otto_emoji_collection->AddEmoji("silly", happy.data, happy.data_size);
 
     // 悲伤类表情 -> sad
-    otto_emoji_collection->AddEmoji("sad", new LvglRawImage((void*)sad.data, sad.data_size));
-    otto_emoji_collection->AddEmoji("crying", new LvglRawImage((void*)sad.data, sad.data_size));
+    otto_emoji_collection->AddEmoji("sad", sad.data, sad.data_size);
+    otto_emoji_collection->AddEmoji("crying", sad.data, sad.data_size);
 
     // 愤怒类表情 -> anger
-    otto_emoji_collection->AddEmoji("anger", new LvglRawImage((void*)anger.data, anger.data_size));
-    otto_emoji_collection->AddEmoji("angry", new LvglRawImage((void*)anger.data, anger.data_size));
+    otto_emoji_collection->AddEmoji("anger", anger.data, anger.data_size);
+    otto_emoji_collection->AddEmoji("angry", anger.data, anger.data_size);
 
     // 惊讶类表情 -> scare
-    otto_emoji_collection->AddEmoji("scare", new LvglRawImage((void*)scare.data, scare.data_size));
-    otto_emoji_collection->AddEmoji("surprised", new LvglRawImage((void*)scare.data, scare.data_size));
-    otto_emoji_collection->AddEmoji("shocked", new LvglRawImage((void*)scare.data, scare.data_size));
+    otto_emoji_collection->AddEmoji("scare", scare.data, scare.data_size);
+    otto_emoji_collection->AddEmoji("surprised", scare.data, scare.data_size);
+    otto_emoji_collection->AddEmoji("shocked", scare.data, scare.data_size);
 
     // 思考/困惑类表情 -> buxue
-    otto_emoji_collection->AddEmoji("buxue", new LvglRawImage((void*)buxue.data, buxue.data_size));
-    otto_emoji_collection->AddEmoji("thinking", new LvglRawImage((void*)buxue.data, buxue.data_size));
-    otto_emoji_collection->AddEmoji("confused", new LvglRawImage((void*)buxue.data, buxue.data_size));
-    otto_emoji_collection->AddEmoji("embarrassed", new LvglRawImage((void*)buxue.data, buxue.data_size));
+    otto_emoji_collection->AddEmoji("buxue", buxue.data, buxue.data_size);
+    otto_emoji_collection->AddEmoji("thinking", buxue.data, buxue.data_size);
+    otto_emoji_collection->AddEmoji("confused", buxue.data, buxue.data_size);
+    otto_emoji_collection->AddEmoji("embarrassed", buxue.data, buxue.data_size);
 
     // 将表情集合添加到主题中
     auto& theme_manager = LvglThemeManager::GetInstance();
@@ -32,6 +32,10 @@
 #define DISPLAY_OFFSET_X  0
 #define DISPLAY_OFFSET_Y  0
 
+// LVGL 双缓冲行数，每块 240 * 40 * 2 = 19.2KB，放在内部 RAM
+#define DISPLAY_BUFFER_LINES  40
+#define DISPLAY_BUFFER_SPIRAM false
+
 #define DISPLAY_DC_GPIO     GPIO_NUM_43
 #define DISPLAY_CS_GPIO     GPIO_NUM_44
 #define DISPLAY_CLK_GPIO    GPIO_NUM_21
@@ -0,0 +1,306 @@
+#include "delta_patch.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#define TAG "DeltaPatch"
+
+#define DELTA_BUFFER_SIZE 4096
+
+enum DeltaCommand : uint8_t {
+    kDeltaEnd = 0x00,
+    kDeltaCopy = 0x01,
+    kDeltaInsert = 0x02,
+    kDeltaDiff = 0x03,
+};
+
+DeltaPatch::DeltaPatch(const esp_partition_t* source, esp_ota_handle_t ota_handle, ReadFunction read)
+    : source_(source), ota_handle_(ota_handle), read_(read) {
+    in_buffer_ = (char*)malloc(DELTA_BUFFER_SIZE);
+    src_buffer_ = (char*)malloc(DELTA_BUFFER_SIZE);
+    out_buffer_ = (char*)malloc(DELTA_BUFFER_SIZE);
+    mbedtls_sha256_init(&sha_ctx_);
+}
+
+DeltaPatch::~DeltaPatch() {
+    mbedtls_sha256_free(&sha_ctx_);
+    free(in_buffer_);
+    free(src_buffer_);
+    free(out_buffer_);
+}
+
+bool DeltaPatch::IsPatch(const char* data, size_t size) {
+    return size >= 4 && memcmp(data, DELTA_PATCH_MAGIC, 4) == 0;
+}
+
+bool DeltaPatch::ReadPatch(void* data, size_t size) {
+    auto dst = static_cast<char*>(data);
+    while (size > 0) {
+        if (prefix_size_ > 0) {
+            size_t n = std::min(size, prefix_size_);
+            memcpy(dst, prefix_, n);
+            prefix_ += n;
+            prefix_size_ -= n;
+            dst += n;
+            size -= n;
+            continue;
+        }
+        if (in_pos_ == in_len_) {
+            int ret = read_(in_buffer_, DELTA_BUFFER_SIZE);
+            if (ret <= 0) {
+                ESP_LOGE(TAG, "Patch stream ended unexpectedly");
+                return false;
+            }
+            in_pos_ = 0;
+            in_len_ = ret;
+        }
+        size_t n = std::min(size, in_len_ - in_pos_);
+        memcpy(dst, in_buffer_ + in_pos_, n);
+        in_pos_ += n;
+        dst += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool DeltaPatch::ReadVarint(uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t byte;
+        if (!ReadPatch(&byte, 1)) {
+            return false;
+        }
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    ESP_LOGE(TAG, "Invalid varint");
+    return false;
+}
+
+const uint8_t* DeltaPatch::Source(size_t offset, size_t& available) {
+    if (offset >= old_size_) {
+        return nullptr;
+    }
+    if (offset < src_offset_ || offset >= src_offset_ + src_len_) {
+        // Align the window to flash sectors, the patch mostly reads the old image forward
+        src_offset_ = offset & ~(size_t)(DELTA_BUFFER_SIZE - 1);
+        src_len_ = std::min<size_t>(DELTA_BUFFER_SIZE, old_size_ - src_offset_);
+        if (esp_partition_read(source_, src_offset_, src_buffer_, src_len_) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read source partition at 0x%x", src_offset_);
+            src_len_ = 0;
+            return nullptr;
+        }
+    }
+    available = src_offset_ + src_len_ - offset;
+    return (const uint8_t*)src_buffer_ + (offset - src_offset_);
+}
+
+bool DeltaPatch::VerifySource(const uint8_t* expected_sha256) {
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    size_t offset = 0;
+    while (offset < old_size_) {
+        size_t available;
+        auto data = Source(offset, available);
+        if (data == nullptr) {
+            mbedtls_sha256_free(&ctx);
+            return false;
+        }
+        mbedtls_sha256_update(&ctx, data, available);
+        offset += available;
+    }
+    uint8_t sha256[32];
+    mbedtls_sha256_finish(&ctx, sha256);
+    mbedtls_sha256_free(&ctx);
+    return memcmp(sha256, expected_sha256, sizeof(sha256)) == 0;
+}
+
+bool DeltaPatch::Flush() {
+    if (out_len_ == 0) {
+        return true;
+    }
+    auto err = esp_ota_write(ota_handle_, out_buffer_, out_len_);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write OTA data: %s", esp_err_to_name(err));
+        return false;
+    }
+    out_len_ = 0;
+    return true;
+}
+
+bool DeltaPatch::Output(const void* data, size_t size) {
+    if (written_ + size > new_size_) {
+        ESP_LOGE(TAG, "Patch produces more than %u bytes", new_size_);
+        return false;
+    }
+    mbedtls_sha256_update(&sha_ctx_, (const uint8_t*)data, size);
+    written_ += size;
+
+    auto src = static_cast<const char*>(data);
+    while (size > 0) {
+        size_t n = std::min(size, DELTA_BUFFER_SIZE - out_len_);
+        memcpy(out_buffer_ + out_len_, src, n);
+        out_len_ += n;
+        src += n;
+        size -= n;
+        if (out_len_ == DELTA_BUFFER_SIZE && !Flush()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DeltaPatch::Copy(uint32_t offset, uint32_t length) {
+    while (length > 0) {
+        size_t available;
+        auto data = Source(offset, available);
+        if (data == nullptr) {
+            ESP_LOGE(TAG, "Copy out of source range: 0x%lx", offset);
+            return false;
+        }
+        size_t n = std::min<size_t>(length, available);
+        if (!Output(data, n)) {
+            return false;
+        }
+        offset += n;
+        length -= n;
+    }
+    return true;
+}
+
+bool DeltaPatch::Insert(uint32_t length) {
+    uint8_t chunk[256];
+    while (length > 0) {
+        size_t n = std::min<size_t>(length, sizeof(chunk));
+        if (!ReadPatch(chunk, n) || !Output(chunk, n)) {
+            return false;
+        }
+        length -= n;
+    }
+    return true;
+}
+
+bool DeltaPatch::Diff(uint32_t offset, uint32_t length) {
+    uint8_t chunk[256];
+    while (length > 0) {
+        uint32_t skip, count;
+        if (!ReadVarint(skip) || !ReadVarint(count)) {
+            return false;
+        }
+        if (skip + count > length) {
+            ESP_LOGE(TAG, "Corrupted diff segment");
+            return false;
+        }
+        if (!Copy(offset, skip)) {
+            return false;
+        }
+        offset += skip;
+        length -= skip + count;
+
+        // new = old + delta (mod 256)
+        while (count > 0) {
+            size_t available;
+            auto old = Source(offset, available);
+            if (old == nullptr) {
+                ESP_LOGE(TAG, "Diff out of source range: 0x%lx", offset);
+                return false;
+            }
+            size_t n = std::min<size_t>({count, available, sizeof(chunk)});
+            if (!ReadPatch(chunk, n)) {
+                return false;
+            }
+            for (size_t i = 0; i < n; i++) {
+                chunk[i] += old[i];
+            }
+            if (!Output(chunk, n)) {
+                return false;
+            }
+            offset += n;
+            count -= n;
+        }
+    }
+    return true;
+}
+
+bool DeltaPatch::Apply(const char* prefix, size_t prefix_size) {
+    if (in_buffer_ == nullptr || src_buffer_ == nullptr || out_buffer_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate buffers");
+        return false;
+    }
+    prefix_ = prefix;
+    prefix_size_ = prefix_size;
+
+    Header header;
+    if (!ReadPatch(&header, sizeof(header))) {
+        return false;
+    }
+    if (!IsPatch(header.magic, sizeof(header.magic)) || header.version != DELTA_PATCH_VERSION) {
+        ESP_LOGE(TAG, "Unsupported patch version: %d", header.version);
+        return false;
+    }
+    if (header.old_size > source_->size) {
+        ESP_LOGE(TAG, "Patch base is larger than partition %s", source_->label);
+        return false;
+    }
+    old_size_ = header.old_size;
+    new_size_ = header.new_size;
+
+    auto start_time = esp_timer_get_time();
+    if (!VerifySource(header.old_sha256)) {
+        ESP_LOGE(TAG, "Patch does not match the firmware in partition %s", source_->label);
+        return false;
+    }
+    ESP_LOGI(TAG, "Applying patch to %s: %lu -> %lu bytes (verify %dms)", source_->label,
+        header.old_size, header.new_size, (int)((esp_timer_get_time() - start_time) / 1000));
+
+    mbedtls_sha256_starts(&sha_ctx_, 0);
+    while (true) {
+        uint8_t command;
+        if (!ReadPatch(&command, 1)) {
+            return false;
+        }
+        if (command == kDeltaEnd) {
+            break;
+        }
+
+        uint32_t offset = 0, length = 0;
+        bool ok;
+        switch (command) {
+        case kDeltaCopy:
+            ok = ReadVarint(offset) && ReadVarint(length) && Copy(offset, length);
+            break;
+        case kDeltaInsert:
+            ok = ReadVarint(length) && Insert(length);
+            break;
+        case kDeltaDiff:
+            ok = ReadVarint(offset) && ReadVarint(length) && Diff(offset, length);
+            break;
+        default:
+            ESP_LOGE(TAG, "Unknown patch command: 0x%02x", command);
+            ok = false;
+            break;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    if (!Flush()) {
+        return false;
+    }
+
+    uint8_t sha256[32];
+    mbedtls_sha256_finish(&sha_ctx_, sha256);
+    if (written_ != new_size_ || memcmp(sha256, header.new_sha256, sizeof(sha256)) != 0) {
+        ESP_LOGE(TAG, "Reconstructed image mismatch (%u/%u bytes)", written_, new_size_);
+        return false;
+    }
+    ESP_LOGI(TAG, "Patch applied in %dms", (int)((esp_timer_get_time() - start_time) / 1000));
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef _DELTA_PATCH_H_
+#define _DELTA_PATCH_H_
+
+#include <functional>
+#include <string>
+
+#include <esp_partition.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+
+#define DELTA_PATCH_MAGIC "XZDP"
+#define DELTA_PATCH_VERSION 1
+
+/**
+ * Applies a delta patch produced by scripts/delta_ota/delta_ota.py.
+ *
+ * The patch is consumed as a stream, the old image is read from the source
+ * partition (normally the running one), and the reconstructed image is written
+ * with esp_ota_write. Both the source and the result are checked against the
+ * SHA-256 digests in the patch header, so a mismatched base is rejected before
+ * anything is written, and a corrupted result before the boot partition changes.
+ */
+class DeltaPatch {
+public:
+    // Same contract as Http::Read: bytes read, 0 at end of stream, negative on error
+    typedef std::function<int(char* buffer, size_t size)> ReadFunction;
+
+    DeltaPatch(const esp_partition_t* source, esp_ota_handle_t ota_handle, ReadFunction read);
+    ~DeltaPatch();
+
+    static bool IsPatch(const char* data, size_t size);
+
+    /**
+     * Apply the patch. `prefix` holds bytes already consumed from the stream
+     * (used to sniff the magic), the rest is pulled with the read function.
+     */
+    bool Apply(const char* prefix, size_t prefix_size);
+
+    size_t new_size() const { return new_size_; }
+
+private:
+    struct Header {
+        char magic[4];
+        uint8_t version;
+        uint8_t flags;
+        uint16_t reserved;
+        uint32_t old_size;
+        uint32_t new_size;
+        uint8_t old_sha256[32];
+        uint8_t new_sha256[32];
+    } __attribute__((packed));
+
+    const esp_partition_t* source_;
+    esp_ota_handle_t ota_handle_;
+    ReadFunction read_;
+
+    // Patch stream
+    const char* prefix_ = nullptr;
+    size_t prefix_size_ = 0;
+    char* in_buffer_ = nullptr;
+    size_t in_pos_ = 0;
+    size_t in_len_ = 0;
+
+    // Cached window over the source partition
+    char* src_buffer_ = nullptr;
+    size_t src_offset_ = 0;
+    size_t src_len_ = 0;
+    uint32_t old_size_ = 0;
+
+    // Output buffered to flash sector size
+    char* out_buffer_ = nullptr;
+    size_t out_len_ = 0;
+    size_t new_size_ = 0;
+    size_t written_ = 0;
+    mbedtls_sha256_context sha_ctx_;
+
+    bool ReadPatch(void* data, size_t size);
+    bool ReadVarint(uint32_t& value);
+    const uint8_t* Source(size_t offset, size_t& available);
+    bool VerifySource(const uint8_t* expected_sha256);
+    bool Output(const void* data, size_t size);
+    bool Flush();
+    bool Copy(uint32_t offset, uint32_t length);
+    bool Insert(uint32_t length);
+    bool Diff(uint32_t offset, uint32_t length);
+};
+
+#endif // _DELTA_PATCH_H_
@@ -21,107 +21,152 @@ static const char* const STATE_STRINGS[] = {
     "invalid_state"
 };
 
-DeviceStateMachine::DeviceStateMachine() {
+static constexpr uint32_t StateBit(DeviceState state) {
+    return 1u << state;
 }
 
-const char* DeviceStateMachine::GetStateName(DeviceState state) {
-    if (state >= 0 && state <= kDeviceStateFatalError) {
-        return STATE_STRINGS[state];
-    }
-    return STATE_STRINGS[kDeviceStateFatalError + 1];
-}
+// Valid target states of each state, based on the state diagram
+static constexpr uint32_t VALID_TRANSITIONS[] = {
+    // kDeviceStateUnknown: can only go to starting
+    StateBit(kDeviceStateStarting),
+    // kDeviceStateStarting: can go to wifi configuring or activating
+    StateBit(kDeviceStateWifiConfiguring) | StateBit(kDeviceStateActivating),
+    // kDeviceStateWifiConfiguring: can go to activating (after wifi connected) or audio testing
+    StateBit(kDeviceStateActivating) | StateBit(kDeviceStateAudioTesting),
+    // kDeviceStateIdle: can go to connecting, listening (manual mode), speaking, activating, upgrading, or wifi configuring
+    StateBit(kDeviceStateConnecting) | StateBit(kDeviceStateListening) | StateBit(kDeviceStateSpeaking) |
+        StateBit(kDeviceStateActivating) | StateBit(kDeviceStateUpgrading) | StateBit(kDeviceStateWifiConfiguring),
+    // kDeviceStateConnecting: can go to idle (failed) or listening (success)
+    StateBit(kDeviceStateIdle) | StateBit(kDeviceStateListening),
+    // kDeviceStateListening: can go to speaking or idle
+    StateBit(kDeviceStateSpeaking) | StateBit(kDeviceStateIdle),
+    // kDeviceStateSpeaking: can go to listening or idle
+    StateBit(kDeviceStateListening) | StateBit(kDeviceStateIdle),
+    // kDeviceStateUpgrading: can go to idle (upgrade failed) or activating
+    StateBit(kDeviceStateIdle) | StateBit(kDeviceStateActivating),
+    // kDeviceStateActivating: can go to upgrading, idle, or back to wifi configuring (on error)
+    StateBit(kDeviceStateUpgrading) | StateBit(kDeviceStateIdle) | StateBit(kDeviceStateWifiConfiguring),
+    // kDeviceStateAudioTesting: can go back to wifi configuring
+    StateBit(kDeviceStateWifiConfiguring),
+    // kDeviceStateFatalError: cannot transition out of fatal error
+    0,
+};
+static_assert(sizeof(VALID_TRANSITIONS) / sizeof(VALID_TRANSITIONS[0]) == kDeviceStateFatalError + 1,
+    "VALID_TRANSITIONS must have one entry per state");
 
-bool DeviceStateMachine::IsValidTransition(DeviceState from, DeviceState to) const {
-    // Allow transition to the same state (no-op)
+// The state diagram as it was written before the table, kept to check the table against
+static constexpr bool IsValidTransitionBySwitch(DeviceState from, DeviceState to) {
     if (from == to) {
         return true;
     }
-
-    // Define valid state transitions based on the state diagram
     switch (from) {
         case kDeviceStateUnknown:
-            // Can only go to starting
             return to == kDeviceStateStarting;
-
         case kDeviceStateStarting:
-            // Can go to wifi configuring or activating
             return to == kDeviceStateWifiConfiguring ||
                    to == kDeviceStateActivating;
-
         case kDeviceStateWifiConfiguring:
-            // Can go to activating (after wifi connected) or audio testing
             return to == kDeviceStateActivating ||
                    to == kDeviceStateAudioTesting;
-
         case kDeviceStateAudioTesting:
-            // Can go back to wifi configuring
             return to == kDeviceStateWifiConfiguring;
-
         case kDeviceStateActivating:
-            // Can go to upgrading, idle, or back to wifi configuring (on error)
             return to == kDeviceStateUpgrading ||
                    to == kDeviceStateIdle ||
                    to == kDeviceStateWifiConfiguring;
-
         case kDeviceStateUpgrading:
-            // Can go to idle (upgrade failed) or activating
             return to == kDeviceStateIdle ||
                    to == kDeviceStateActivating;
-
         case kDeviceStateIdle:
-            // Can go to connecting, listening (manual mode), speaking, activating, upgrading, or wifi configuring
             return to == kDeviceStateConnecting ||
                    to == kDeviceStateListening ||
                    to == kDeviceStateSpeaking ||
                    to == kDeviceStateActivating ||
                    to == kDeviceStateUpgrading ||
                    to == kDeviceStateWifiConfiguring;
-
         case kDeviceStateConnecting:
-            // Can go to idle (failed) or listening (success)
             return to == kDeviceStateIdle ||
                    to == kDeviceStateListening;
-
         case kDeviceStateListening:
-            // Can go to speaking or idle
             return to == kDeviceStateSpeaking ||
                    to == kDeviceStateIdle;
-
         case kDeviceStateSpeaking:
-            // Can go to listening or idle
             return to == kDeviceStateListening ||
                    to == kDeviceStateIdle;
-
         case kDeviceStateFatalError:
-            // Cannot transition out of fatal error
             return false;
-
         default:
             return false;
     }
 }
 
+static constexpr bool IsValidTransitionByTable(DeviceState from, DeviceState to) {
+    // Allow transition to the same state (no-op)
+    if (from == to) {
+        return true;
+    }
+    if (from < 0 || from > kDeviceStateFatalError || to < 0 || to > kDeviceStateFatalError) {
+        return false;
+    }
+    return (VALID_TRANSITIONS[from] & StateBit(to)) != 0;
+}
+
+// Every pair of states, including one past the last as an invalid state
+static constexpr bool TransitionTableMatchesSwitch() {
+    for (int from = 0; from <= kDeviceStateFatalError + 1; from++) {
+        for (int to = 0; to <= kDeviceStateFatalError + 1; to++) {
+            if (IsValidTransitionByTable((DeviceState)from, (DeviceState)to) !=
+                IsValidTransitionBySwitch((DeviceState)from, (DeviceState)to)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+static_assert(TransitionTableMatchesSwitch(), "VALID_TRANSITIONS does not match the state diagram");
+
+constexpr bool DeviceStateMachine::IsValidTransition(DeviceState from, DeviceState to) {
+    return IsValidTransitionByTable(from, to);
+}
+
+DeviceStateMachine::DeviceStateMachine() : listeners_(new ListenerList()) {
+}
+
+DeviceStateMachine::~DeviceStateMachine() {
+    delete listeners_.load();
+    for (auto listeners : retired_listeners_) {
+        delete listeners;
+    }
+}
+
+const char* DeviceStateMachine::GetStateName(DeviceState state) {
+    if (state >= 0 && state <= kDeviceStateFatalError) {
+        return STATE_STRINGS[state];
+    }
+    return STATE_STRINGS[kDeviceStateFatalError + 1];
+}
+
 bool DeviceStateMachine::CanTransitionTo(DeviceState target) const {
     return IsValidTransition(current_state_.load(), target);
 }
 
 bool DeviceStateMachine::TransitionTo(DeviceState new_state) {
     DeviceState old_state = current_state_.load();
-    
-    // No-op if already in the target state
-    if (old_state == new_state) {
-        return true;
-    }
+    do {
+        // No-op if already in the target state
+        if (old_state == new_state) {
+            return true;
+        }
 
-    // Validate transition
-    if (!IsValidTransition(old_state, new_state)) {
-        ESP_LOGW(TAG, "Invalid state transition: %s -> %s",
-                 GetStateName(old_state), GetStateName(new_state));
-        return false;
-    }
+        // Validate transition
+        if (!IsValidTransition(old_state, new_state)) {
+            ESP_LOGW(TAG, "Invalid state transition: %s -> %s",
+                     GetStateName(old_state), GetStateName(new_state));
+            return false;
+        }
+        // Perform transition, validate again if another task changed the state meanwhile
+    } while (!current_state_.compare_exchange_weak(old_state, new_state));
 
-    // Perform transition
-    current_state_.store(new_state);
     ESP_LOGI(TAG, "State: %s -> %s",
              GetStateName(old_state), GetStateName(new_state));
 
@@ -130,32 +175,45 @@ bool DeviceStateMachine::TransitionTo(DeviceState new_state) {
     return true;
 }
 
+// Publish a new list, the caller holds mutex_
+void DeviceStateMachine::PublishListeners(const ListenerList* listeners) {
+    retired_listeners_.push_back(listeners_.exchange(listeners));
+    // A notification that could still read a retired list started before the exchange
+    // and is counted, one starting later reads the new list
+    if (active_notifications_.load() == 0) {
+        for (auto retired : retired_listeners_) {
+            delete retired;
+        }
+        retired_listeners_.clear();
+    }
+}
+
 int DeviceStateMachine::AddStateChangeListener(StateCallback callback) {
     std::lock_guard<std::mutex> lock(mutex_);
     int id = next_listener_id_++;
-    listeners_.emplace_back(id, std::move(callback));
+    auto listeners = new ListenerList(*listeners_.load());
+    listeners->emplace_back(id, std::move(callback));
+    PublishListeners(listeners);
     return id;
 }
 
 void DeviceStateMachine::RemoveStateChangeListener(int listener_id) {
     std::lock_guard<std::mutex> lock(mutex_);
-    listeners_.erase(
-        std::remove_if(listeners_.begin(), listeners_.end(),
+    auto listeners = new ListenerList(*listeners_.load());
+    listeners->erase(
+        std::remove_if(listeners->begin(), listeners->end(),
             [listener_id](const auto& p) { return p.first == listener_id; }),
-        listeners_.end());
+        listeners->end());
+    PublishListeners(listeners);
 }
 
 void DeviceStateMachine::NotifyStateChange(DeviceState old_state, DeviceState new_state) {
-    std::vector<StateCallback> callbacks_copy;
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        callbacks_copy.reserve(listeners_.size());
-        for (const auto& [id, cb] : listeners_) {
-            callbacks_copy.push_back(cb);
-        }
-    }
-    
-    for (const auto& cb : callbacks_copy) {
+    // Lock-free: the list is immutable and not freed while this runs.
+    // A listener removed meanwhile may still be called once.
+    active_notifications_++;
+    auto listeners = listeners_.load();
+    for (const auto& [id, cb] : *listeners) {
         cb(old_state, new_state);
     }
+    active_notifications_--;
 }
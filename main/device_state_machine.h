@@ -17,7 +17,7 @@
 class DeviceStateMachine {
 public:
     DeviceStateMachine();
-    ~DeviceStateMachine() = default;
+    ~DeviceStateMachine();
 
     // Delete copy constructor and assignment operator
     DeviceStateMachine(const DeviceStateMachine&) = delete;
@@ -48,7 +48,9 @@ public:
 
     /**
      * Add a state change listener (observer pattern)
-     * Callback is invoked in the context of the caller of TransitionTo()
+     * Callback is invoked in the context of the caller of TransitionTo(), without any lock held.
+     * Keep it short: slow work such as LED and display updates belongs to another task,
+     * e.g. Application only sets an event bit and updates them in the main task.
      * @return listener id for removal
      */
     int AddStateChangeListener(StateCallback callback);
@@ -64,15 +66,23 @@ public:
     static const char* GetStateName(DeviceState state);
 
 private:
+    using ListenerList = std::vector<std::pair<int, StateCallback>>;
+
     std::atomic<DeviceState> current_state_{kDeviceStateUnknown};
-    std::vector<std::pair<int, StateCallback>> listeners_;
+    // Read-copy-update: a change publishes a new list, notifying only reads the pointer
+    std::atomic<const ListenerList*> listeners_;
+    std::atomic<int> active_notifications_{0};
+    // Replaced lists, freed by a later change once no notification is running
+    std::vector<const ListenerList*> retired_listeners_;
     int next_listener_id_{0};
-    std::mutex mutex_;
+    std::mutex mutex_;  // Serializes listener changes
+
+    void PublishListeners(const ListenerList* listeners);
 
     /**
      * Check if transition from source to target is valid
      */
-    bool IsValidTransition(DeviceState from, DeviceState to) const;
+    static constexpr bool IsValidTransition(DeviceState from, DeviceState to);
 
     /**
      * Notify callback of state change
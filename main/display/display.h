@@ -39,6 +39,8 @@ public:
     virtual Theme* GetTheme() { return current_theme_; }
     virtual void UpdateStatusBar(bool update_all = false);
     virtual void SetPowerSaveMode(bool on);
+    // Cap how often the screen is redrawn, invalidations in between are drawn together
+    virtual void SetFrameRateLimit(int fps);
 
     inline int width() const { return width_; }
     inline int height() const { return height_; }
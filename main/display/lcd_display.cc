@@ -11,6 +11,10 @@
 #include <esp_err.h>
 #include <esp_lvgl_port.h>
 #include <esp_psram.h>
+#include <esp_heap_caps.h>
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <cstring>
 
 #include "board.h"
@@ -74,6 +78,12 @@ LcdDisplay::LcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_
     std::string theme_name = settings.GetString("theme", "light");
     current_theme_ = LvglThemeManager::GetInstance().GetTheme(theme_name);
 
+    lv_style_init(&chat_row_style_);
+    lv_style_init(&chat_bubble_style_);
+    lv_style_init(&user_bubble_style_);
+    lv_style_init(&assistant_bubble_style_);
+    lv_style_init(&system_bubble_style_);
+
     // Create a timer to hide the preview image
     esp_timer_create_args_t preview_timer_args = {
         .callback = [](void* arg) {
@@ -89,14 +99,11 @@ LcdDisplay::LcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_
 }
 
 SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
-                           int width, int height, int offset_x, int offset_y, bool mirror_x, bool mirror_y, bool swap_xy)
+                           int width, int height, int offset_x, int offset_y, bool mirror_x, bool mirror_y, bool swap_xy,
+                           const SpiLcdBufferConfig& buffer_config)
     : LcdDisplay(panel_io, panel, width, height) {
 
-    // draw white
-    std::vector<uint16_t> buffer(width_, 0xFFFF);
-    for (int y = 0; y < height_; y++) {
-        esp_lcd_panel_draw_bitmap(panel_, 0, y, width_, y + 1, buffer.data());
-    }
+    ClearScreen();
 
     // Set the display to on
     ESP_LOGI(TAG, "Turning display on");
@@ -132,14 +139,21 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
 #endif
     lvgl_port_init(&port_cfg);
 
-    ESP_LOGI(TAG, "Adding LCD display");
+    int buffer_lines = std::clamp(buffer_config.lines, 1, height_);
+    bool buffer_spiram = buffer_config.spiram;
+#if !CONFIG_SPIRAM
+    buffer_spiram = false;
+#endif
+    ESP_LOGI(TAG, "Adding LCD display, %s %d-line buffer(s) in %s", buffer_config.double_buffer ? "two" : "one",
+        buffer_lines, buffer_spiram ? "PSRAM" : "internal RAM");
     const lvgl_port_display_cfg_t display_cfg = {
         .io_handle = panel_io_,
         .panel_handle = panel_,
         .control_handle = nullptr,
-        .buffer_size = static_cast<uint32_t>(width_ * 20),
-        .double_buffer = false,
-        .trans_size = 0,
+        .buffer_size = static_cast<uint32_t>(width_ * buffer_lines),
+        .double_buffer = buffer_config.double_buffer,
+        // DMA can not read PSRAM on every target, flush PSRAM buffers through an internal one
+        .trans_size = buffer_spiram ? static_cast<uint32_t>(width_ * std::min(buffer_lines, 10)) : 0,
         .hres = static_cast<uint32_t>(width_),
         .vres = static_cast<uint32_t>(height_),
         .monochrome = false,
@@ -150,8 +164,8 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
         },
         .color_format = LV_COLOR_FORMAT_RGB565,
         .flags = {
-            .buff_dma = 1,
-            .buff_spiram = 0,
+            .buff_dma = buffer_spiram ? 0u : 1u,
+            .buff_spiram = buffer_spiram ? 1u : 0u,
             .sw_rotate = 0,
             .swap_bytes = 1,
             .full_refresh = 0,
@@ -172,6 +186,67 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
     SetupUI();
 }
 
+// Called from the ISR, must stay in IRAM when the LCD ISR is IRAM safe
+static bool IRAM_ATTR OnClearTransferDone(esp_lcd_panel_io_handle_t, esp_lcd_panel_io_event_data_t*, void* user_ctx) {
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(static_cast<SemaphoreHandle_t>(user_ctx), &woken);
+    return woken == pdTRUE;
+}
+
+// Fill the panel with white in large DMA bursts instead of one transfer per row
+void SpiLcdDisplay::ClearScreen() {
+    const int max_burst_bytes = 16 * 1024;
+    int lines = std::clamp(max_burst_bytes / (width_ * (int)sizeof(uint16_t)), 1, height_);
+    auto buffer = (uint16_t*)heap_caps_malloc(width_ * lines * sizeof(uint16_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (buffer == nullptr) {
+        ESP_LOGW(TAG, "No DMA memory for clearing the screen, clearing row by row");
+        std::vector<uint16_t> row(width_, 0xFFFF);
+        for (int y = 0; y < height_; y++) {
+            esp_lcd_panel_draw_bitmap(panel_, 0, y, width_, y + 1, row.data());
+        }
+        return;
+    }
+    std::fill(buffer, buffer + width_ * lines, 0xFFFF);
+
+    // Transfers are queued, count their completions before the buffer is freed.
+    // The LVGL port registers its own callback later on.
+    int bursts = (height_ + lines - 1) / lines;
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(bursts, 0);
+    esp_lcd_panel_io_callbacks_t cbs = {
+        .on_color_trans_done = OnClearTransferDone,
+    };
+    bool notified = esp_lcd_panel_io_register_event_callbacks(panel_io_, &cbs, done) == ESP_OK;
+
+    int queued = 0;
+    for (int y = 0; y < height_; y += lines) {
+        if (esp_lcd_panel_draw_bitmap(panel_, 0, y, width_, std::min(y + lines, height_), buffer) == ESP_OK) {
+            queued++;
+        }
+    }
+    bool completed = notified;
+    for (int i = 0; notified && i < queued; i++) {
+        if (xSemaphoreTake(done, pdMS_TO_TICKS(100)) != pdTRUE) {
+            completed = false;
+            break;
+        }
+    }
+
+    if (notified) {
+        esp_lcd_panel_io_callbacks_t no_cbs = {};
+        esp_lcd_panel_io_register_event_callbacks(panel_io_, &no_cbs, nullptr);
+    }
+    if (!completed) {
+        // Transfers may still be reading the buffer and signalling the semaphore,
+        // e.g. a panel driver that never reports completion. Leak both rather than
+        // free memory DMA is using.
+        ESP_LOGW(TAG, "Screen clear did not report completion, keeping its %u byte buffer",
+            (unsigned)(width_ * lines * sizeof(uint16_t)));
+        return;
+    }
+    vSemaphoreDelete(done);
+    heap_caps_free(buffer);
+}
+
 
 // RGB LCD implementation
 RgbLcdDisplay::RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
@@ -338,6 +413,11 @@ LcdDisplay::~LcdDisplay() {
     if (display_ != nullptr) {
         lv_display_delete(display_);
     }
+    lv_style_reset(&chat_row_style_);
+    lv_style_reset(&chat_bubble_style_);
+    lv_style_reset(&user_bubble_style_);
+    lv_style_reset(&assistant_bubble_style_);
+    lv_style_reset(&system_bubble_style_);
 
     if (panel_ != nullptr) {
         esp_lcd_panel_del(panel_);
@@ -469,8 +549,9 @@ void LcdDisplay::SetupUI() {
     lv_obj_set_flex_align(content_, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_START);
     lv_obj_set_style_pad_row(content_, lvgl_theme->spacing(4), 0); // Space between messages
 
-    // We'll create chat messages dynamically in SetChatMessage
+    // Chat rows are created on demand in SetChatMessage and recycled once MAX_MESSAGES is reached
     chat_message_label_ = nullptr;
+    UpdateChatStyles(lvgl_theme);
 
     low_battery_popup_ = lv_obj_create(screen);
     lv_obj_set_scrollbar_mode(low_battery_popup_, LV_SCROLLBAR_MODE_OFF);
@@ -499,43 +580,86 @@ void LcdDisplay::SetupUI() {
 #else
 #define  MAX_MESSAGES 20
 #endif
+// Marks the full-width rows of content_ that hold a text bubble
+static const char CHAT_ROW_TAG[] = "row";
+
+void LcdDisplay::UpdateChatStyles(LvglTheme* theme) {
+    // Transparent full-width row, the bubble is aligned inside it
+    lv_style_set_width(&chat_row_style_, LV_HOR_RES);
+    lv_style_set_height(&chat_row_style_, LV_SIZE_CONTENT);
+    lv_style_set_bg_opa(&chat_row_style_, LV_OPA_TRANSP);
+    lv_style_set_border_width(&chat_row_style_, 0);
+    lv_style_set_pad_all(&chat_row_style_, 0);
+
+    lv_style_set_radius(&chat_bubble_style_, 8);
+    lv_style_set_border_width(&chat_bubble_style_, 0);
+    lv_style_set_border_color(&chat_bubble_style_, theme->border_color());
+    lv_style_set_pad_all(&chat_bubble_style_, theme->spacing(4));
+    lv_style_set_bg_opa(&chat_bubble_style_, LV_OPA_70);
+    lv_style_set_width(&chat_bubble_style_, LV_SIZE_CONTENT);
+    lv_style_set_height(&chat_bubble_style_, LV_SIZE_CONTENT);
+
+    // Labels inherit the text color from their bubble
+    lv_style_set_bg_color(&user_bubble_style_, theme->user_bubble_color());
+    lv_style_set_text_color(&user_bubble_style_, theme->text_color());
+    lv_style_set_bg_color(&assistant_bubble_style_, theme->assistant_bubble_color());
+    lv_style_set_text_color(&assistant_bubble_style_, theme->text_color());
+    lv_style_set_bg_color(&system_bubble_style_, theme->system_bubble_color());
+    lv_style_set_text_color(&system_bubble_style_, theme->system_text_color());
+
+    lv_obj_report_style_change(&chat_bubble_style_);
+    lv_obj_report_style_change(&user_bubble_style_);
+    lv_obj_report_style_change(&assistant_bubble_style_);
+    lv_obj_report_style_change(&system_bubble_style_);
+}
+
+// Take the oldest row when the history is full instead of deleting and creating objects
+lv_obj_t* LcdDisplay::AcquireChatRow() {
+    uint32_t child_count = lv_obj_get_child_cnt(content_);
+    if (child_count >= MAX_MESSAGES) {
+        lv_obj_t* oldest = lv_obj_get_child(content_, 0);
+        if (lv_obj_get_user_data(oldest) == CHAT_ROW_TAG) {
+            lv_obj_move_to_index(oldest, -1);
+            return oldest;
+        }
+        // Preview images are not recycled
+        lv_obj_delete(oldest);
+    }
+
+    lv_obj_t* row = lv_obj_create(content_);
+    lv_obj_remove_style_all(row);
+    lv_obj_add_style(row, &chat_row_style_, 0);
+    lv_obj_remove_flag(row, LV_OBJ_FLAG_SCROLLABLE);
+    lv_obj_set_user_data(row, (void*)CHAT_ROW_TAG);
+
+    lv_obj_t* bubble = lv_obj_create(row);
+    lv_obj_add_style(bubble, &chat_bubble_style_, 0);
+    lv_obj_set_scrollbar_mode(bubble, LV_SCROLLBAR_MODE_OFF);
+    lv_obj_remove_flag(bubble, LV_OBJ_FLAG_SCROLLABLE);
+
+    lv_obj_t* label = lv_label_create(bubble);
+    lv_label_set_long_mode(label, LV_LABEL_LONG_WRAP);
+    return row;
+}
+
 void LcdDisplay::SetChatMessage(const char* role, const char* content) {
     DisplayLockGuard lock(this);
     if (content_ == nullptr) {
         return;
     }
-    
-    // Check if message count exceeds limit
-    uint32_t child_count = lv_obj_get_child_cnt(content_);
-    if (child_count >= MAX_MESSAGES) {
-        // Delete the oldest message (first child object)
-        lv_obj_t* first_child = lv_obj_get_child(content_, 0);
-        lv_obj_t* last_child = lv_obj_get_child(content_, child_count - 1);
-        if (first_child != nullptr) {
-            lv_obj_del(first_child);
-        }
-        // Scroll to the last message immediately
-        if (last_child != nullptr) {
-            lv_obj_scroll_to_view_recursive(last_child, LV_ANIM_OFF);
-        }
-    }
-    
-    // Collapse system messages (if it's a system message, check if the last message is also a system message)
-    if (strcmp(role, "system") == 0) {
-        if (child_count > 0) {
-            // Get the last message container
-            lv_obj_t* last_container = lv_obj_get_child(content_, child_count - 1);
-            if (last_container != nullptr && lv_obj_get_child_cnt(last_container) > 0) {
-                // Get the bubble inside the container
-                lv_obj_t* last_bubble = lv_obj_get_child(last_container, 0);
-                if (last_bubble != nullptr) {
-                    // Check if bubble type is system message
-                    void* bubble_type_ptr = lv_obj_get_user_data(last_bubble);
-                    if (bubble_type_ptr != nullptr && strcmp((const char*)bubble_type_ptr, "system") == 0) {
-                        // If the last message is also a system message, delete it
-                        lv_obj_del(last_container);
-                    }
-                }
+
+    bool is_user = strcmp(role, "user") == 0;
+    bool is_system = strcmp(role, "system") == 0;
+
+    // Collapse system messages: a new system message replaces the previous one in place
+    lv_obj_t* row = nullptr;
+    lv_obj_t* bubble = nullptr;
+    if (is_system) {
+        lv_obj_t* last = lv_obj_get_child(content_, -1);
+        if (last != nullptr && lv_obj_get_user_data(last) == CHAT_ROW_TAG) {
+            lv_obj_t* last_bubble = lv_obj_get_child(last, 0);
+            if (lv_obj_get_user_data(last_bubble) != nullptr && strcmp((const char*)lv_obj_get_user_data(last_bubble), "system") == 0) {
+                row = last;
             }
         }
     } else {
@@ -544,145 +668,57 @@ void LcdDisplay::SetChatMessage(const char* role, const char* content) {
     }
 
     // Avoid empty message boxes
-    if(strlen(content) == 0) {
+    if (strlen(content) == 0) {
+        if (row != nullptr) {
+            if (chat_message_label_ != nullptr && lv_obj_get_parent(chat_message_label_) == lv_obj_get_child(row, 0)) {
+                chat_message_label_ = nullptr;
+            }
+            lv_obj_delete(row);
+        }
         return;
     }
 
-    auto lvgl_theme = static_cast<LvglTheme*>(current_theme_);
-    auto text_font = lvgl_theme->text_font()->font();
-
-    // Create a message bubble
-    lv_obj_t* msg_bubble = lv_obj_create(content_);
-    lv_obj_set_style_radius(msg_bubble, 8, 0);
-    lv_obj_set_scrollbar_mode(msg_bubble, LV_SCROLLBAR_MODE_OFF);
-    lv_obj_set_style_border_width(msg_bubble, 0, 0);
-    lv_obj_set_style_pad_all(msg_bubble, lvgl_theme->spacing(4), 0);
+    if (row == nullptr) {
+        row = AcquireChatRow();
+    }
+    bubble = lv_obj_get_child(row, 0);
+    lv_obj_t* msg_text = lv_obj_get_child(bubble, 0);
+
+    // Role styles are shared, only swap which one is attached
+    lv_obj_remove_style(bubble, &user_bubble_style_, 0);
+    lv_obj_remove_style(bubble, &assistant_bubble_style_, 0);
+    lv_obj_remove_style(bubble, &system_bubble_style_, 0);
+    if (is_user) {
+        lv_obj_add_style(bubble, &user_bubble_style_, 0);
+        lv_obj_set_user_data(bubble, (void*)"user");
+    } else if (is_system) {
+        lv_obj_add_style(bubble, &system_bubble_style_, 0);
+        lv_obj_set_user_data(bubble, (void*)"system");
+    } else {
+        lv_obj_add_style(bubble, &assistant_bubble_style_, 0);
+        lv_obj_set_user_data(bubble, (void*)"assistant");
+    }
 
-    // Create the message text
-    lv_obj_t* msg_text = lv_label_create(msg_bubble);
-    lv_label_set_text(msg_text, content);
-    
-    // Calculate actual text width
+    // Measure the text once, short messages get a bubble that fits them, long ones wrap
+    auto text_font = static_cast<LvglTheme*>(current_theme_)->text_font()->font();
     lv_coord_t text_width = lv_txt_get_width(content, strlen(content), text_font, 0);
-
-    // Calculate bubble width
     lv_coord_t max_width = LV_HOR_RES * 85 / 100 - 16;  // 85% of screen width
-    lv_coord_t min_width = 20;  
-    lv_coord_t bubble_width;
-    
-    // Ensure text width is not less than minimum width
-    if (text_width < min_width) {
-        text_width = min_width;
-    }
+    lv_coord_t min_width = 20;
+    text_width = std::clamp(text_width, min_width, max_width);
+    lv_label_set_text(msg_text, content);
+    lv_obj_set_width(msg_text, text_width);
 
-    // If text width is less than max width, use text width
-    if (text_width < max_width) {
-        bubble_width = text_width; 
+    if (is_user) {
+        lv_obj_align(bubble, LV_ALIGN_RIGHT_MID, -25, 0);
+    } else if (is_system) {
+        lv_obj_align(bubble, LV_ALIGN_CENTER, 0, 0);
     } else {
-        bubble_width = max_width;
+        lv_obj_align(bubble, LV_ALIGN_LEFT_MID, 0, 0);
     }
-    
-    // Set message text width
-    lv_obj_set_width(msg_text, bubble_width);  // Subtract padding
-    lv_label_set_long_mode(msg_text, LV_LABEL_LONG_WRAP);
-
-    // Set bubble width
-    lv_obj_set_width(msg_bubble, bubble_width);
-    lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-
-    // Set alignment and style based on message role
-    if (strcmp(role, "user") == 0) {
-        // User messages are right-aligned with green background
-        lv_obj_set_style_bg_color(msg_bubble, lvgl_theme->user_bubble_color(), 0);
-        lv_obj_set_style_bg_opa(msg_bubble, LV_OPA_70, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, lvgl_theme->text_color(), 0);
-        
-        // Set custom attribute to mark bubble type
-        lv_obj_set_user_data(msg_bubble, (void*)"user");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    } else if (strcmp(role, "assistant") == 0) {
-        // Assistant messages are left-aligned with white background
-        lv_obj_set_style_bg_color(msg_bubble, lvgl_theme->assistant_bubble_color(), 0);
-        lv_obj_set_style_bg_opa(msg_bubble, LV_OPA_70, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, lvgl_theme->text_color(), 0);
-        
-        // Set custom attribute to mark bubble type
-        lv_obj_set_user_data(msg_bubble, (void*)"assistant");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    } else if (strcmp(role, "system") == 0) {
-        // System messages are center-aligned with light gray background
-        lv_obj_set_style_bg_color(msg_bubble, lvgl_theme->system_bubble_color(), 0);
-        lv_obj_set_style_bg_opa(msg_bubble, LV_OPA_70, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, lvgl_theme->system_text_color(), 0);
-        
-        // Set custom attribute to mark bubble type
-        lv_obj_set_user_data(msg_bubble, (void*)"system");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    }
-    
-    // Create a full-width container for user messages to ensure right alignment
-    if (strcmp(role, "user") == 0) {
-        // Create a full-width container
-        lv_obj_t* container = lv_obj_create(content_);
-        lv_obj_set_width(container, LV_HOR_RES);
-        lv_obj_set_height(container, LV_SIZE_CONTENT);
-        
-        // Make container transparent and borderless
-        lv_obj_set_style_bg_opa(container, LV_OPA_TRANSP, 0);
-        lv_obj_set_style_border_width(container, 0, 0);
-        lv_obj_set_style_pad_all(container, 0, 0);
-        
-        // Move the message bubble into this container
-        lv_obj_set_parent(msg_bubble, container);
-        
-        // Right align the bubble in the container
-        lv_obj_align(msg_bubble, LV_ALIGN_RIGHT_MID, -25, 0);
-        
-        // Auto-scroll to this container
-        lv_obj_scroll_to_view_recursive(container, LV_ANIM_ON);
-    } else if (strcmp(role, "system") == 0) {
-        // Create full-width container for system messages to ensure center alignment
-        lv_obj_t* container = lv_obj_create(content_);
-        lv_obj_set_width(container, LV_HOR_RES);
-        lv_obj_set_height(container, LV_SIZE_CONTENT);
-        
-        lv_obj_set_style_bg_opa(container, LV_OPA_TRANSP, 0);
-        lv_obj_set_style_border_width(container, 0, 0);
-        lv_obj_set_style_pad_all(container, 0, 0);
-        
-        lv_obj_set_parent(msg_bubble, container);
-        lv_obj_align(msg_bubble, LV_ALIGN_CENTER, 0, 0);
-        lv_obj_scroll_to_view_recursive(container, LV_ANIM_ON);
-    } else {
-        // For assistant messages
-        // Left align assistant messages
-        lv_obj_align(msg_bubble, LV_ALIGN_LEFT_MID, 0, 0);
 
-        // Auto-scroll to the message bubble
-        lv_obj_scroll_to_view_recursive(msg_bubble, LV_ANIM_ON);
-    }
-    
+    // Only content_ scrolls, no need to walk up the parents
+    lv_obj_scroll_to_view(row, LV_ANIM_ON);
+
     // Store reference to the latest message label
     chat_message_label_ = msg_text;
 }
@@ -697,17 +733,16 @@ void LcdDisplay::SetPreviewImage(std::unique_ptr<LvglImage> image) {
         return;
     }
     
-    auto lvgl_theme = static_cast<LvglTheme*>(current_theme_);
-    // Create a message bubble for image preview
+    // Keep the history within MAX_MESSAGES
+    if (lv_obj_get_child_cnt(content_) >= MAX_MESSAGES) {
+        lv_obj_delete(lv_obj_get_child(content_, 0));
+    }
+
+    // Create a message bubble for image preview, styled like assistant messages
     lv_obj_t* img_bubble = lv_obj_create(content_);
-    lv_obj_set_style_radius(img_bubble, 8, 0);
+    lv_obj_add_style(img_bubble, &chat_bubble_style_, 0);
+    lv_obj_add_style(img_bubble, &assistant_bubble_style_, 0);
     lv_obj_set_scrollbar_mode(img_bubble, LV_SCROLLBAR_MODE_OFF);
-    lv_obj_set_style_border_width(img_bubble, 0, 0);
-    lv_obj_set_style_pad_all(img_bubble, lvgl_theme->spacing(4), 0);
-    
-    // Set image bubble background color (similar to system message)
-    lv_obj_set_style_bg_color(img_bubble, lvgl_theme->assistant_bubble_color(), 0);
-    lv_obj_set_style_bg_opa(img_bubble, LV_OPA_70, 0);
     
     // Set custom attribute to mark bubble type
     lv_obj_set_user_data(img_bubble, (void*)"image");
@@ -982,28 +1017,41 @@ void LcdDisplay::SetEmotion(const char* emotion) {
         return;
     }
 
+    // Emoji are decoded on first use, which needs the LVGL lock
+    DisplayLockGuard lock(this);
     auto emoji_collection = static_cast<LvglTheme*>(current_theme_)->emoji_collection();
     auto image = emoji_collection != nullptr ? emoji_collection->GetEmojiImage(emotion) : nullptr;
     if (image == nullptr) {
         const char* utf8 = font_awesome_get_utf8(emotion);
         if (utf8 != nullptr && emoji_label_ != nullptr) {
-            DisplayLockGuard lock(this);
             lv_label_set_text(emoji_label_, utf8);
             lv_obj_add_flag(emoji_image_, LV_OBJ_FLAG_HIDDEN);
             lv_obj_remove_flag(emoji_label_, LV_OBJ_FLAG_HIDDEN);
         }
         return;
     }
+    emoji_collection->PrefetchNext(emotion);
 
-    DisplayLockGuard lock(this);
     if (image->IsGif()) {
         // Create new GIF controller
         gif_controller_ = std::make_unique<LvglGif>(image->image_dsc());
         
         if (gif_controller_->IsLoaded()) {
-            // Set up frame update callback
+            // Set up frame update callback, redraw only the part of the image that changed
+            gif_controller_->EnableFrameCache();
             gif_controller_->SetFrameCallback([this]() {
-                lv_image_set_src(emoji_image_, gif_controller_->image_dsc());
+                auto img_dsc = gif_controller_->image_dsc();
+                lv_image_cache_drop(img_dsc);
+                if (lv_image_get_scale(emoji_image_) != LV_SCALE_NONE || lv_image_get_rotation(emoji_image_) != 0) {
+                    lv_obj_invalidate(emoji_image_);
+                    return;
+                }
+                lv_area_t content;
+                lv_obj_get_content_coords(emoji_image_, &content);
+                lv_area_t area = gif_controller_->dirty_area();
+                lv_area_move(&area, content.x1 + (lv_area_get_width(&content) - (int32_t)img_dsc->header.w) / 2,
+                    content.y1 + (lv_area_get_height(&content) - (int32_t)img_dsc->header.h) / 2);
+                lv_obj_invalidate_area(emoji_image_, &area);
             });
             
             // Set initial frame and start animation
@@ -1093,70 +1141,8 @@ void LcdDisplay::SetTheme(Theme* theme) {
     // Set content background opacity
     lv_obj_set_style_bg_opa(content_, LV_OPA_TRANSP, 0);
 
-    // Iterate through all children of content (message containers or bubbles)
-    uint32_t child_count = lv_obj_get_child_cnt(content_);
-    for (uint32_t i = 0; i < child_count; i++) {
-        lv_obj_t* obj = lv_obj_get_child(content_, i);
-        if (obj == nullptr) continue;
-        
-        lv_obj_t* bubble = nullptr;
-        
-        // Check if this object is a container or bubble
-        // If it's a container (user or system message), get its child as bubble
-        // If it's a bubble (assistant message), use it directly
-        if (lv_obj_get_child_cnt(obj) > 0) {
-            // Might be a container, check if it's a user or system message container
-            // User and system message containers are transparent
-            lv_opa_t bg_opa = lv_obj_get_style_bg_opa(obj, 0);
-            if (bg_opa == LV_OPA_TRANSP) {
-                // This is a user or system message container
-                bubble = lv_obj_get_child(obj, 0);
-            } else {
-                // This might be an assistant message bubble itself
-                bubble = obj;
-            }
-        } else {
-            // No child elements, might be other UI elements, skip
-            continue;
-        }
-        
-        if (bubble == nullptr) continue;
-        
-        // Use saved user data to identify bubble type
-        void* bubble_type_ptr = lv_obj_get_user_data(bubble);
-        if (bubble_type_ptr != nullptr) {
-            const char* bubble_type = static_cast<const char*>(bubble_type_ptr);
-            
-            // Apply correct color based on bubble type
-            if (strcmp(bubble_type, "user") == 0) {
-                lv_obj_set_style_bg_color(bubble, lvgl_theme->user_bubble_color(), 0);
-            } else if (strcmp(bubble_type, "assistant") == 0) {
-                lv_obj_set_style_bg_color(bubble, lvgl_theme->assistant_bubble_color(), 0); 
-            } else if (strcmp(bubble_type, "system") == 0) {
-                lv_obj_set_style_bg_color(bubble, lvgl_theme->system_bubble_color(), 0);
-            } else if (strcmp(bubble_type, "image") == 0) {
-                lv_obj_set_style_bg_color(bubble, lvgl_theme->system_bubble_color(), 0);
-            }
-            
-            // Update border color
-            lv_obj_set_style_border_color(bubble, lvgl_theme->border_color(), 0);
-            
-            // Update text color for the message
-            if (lv_obj_get_child_cnt(bubble) > 0) {
-                lv_obj_t* text = lv_obj_get_child(bubble, 0);
-                if (text != nullptr) {
-                    // Set text color based on bubble type
-                    if (strcmp(bubble_type, "system") == 0) {
-                        lv_obj_set_style_text_color(text, lvgl_theme->system_text_color(), 0);
-                    } else {
-                        lv_obj_set_style_text_color(text, lvgl_theme->text_color(), 0);
-                    }
-                }
-            }
-        } else {
-            ESP_LOGW(TAG, "child[%lu] Bubble type is not found", i);
-        }
-    }
+    // Message bubbles use the shared chat styles
+    UpdateChatStyles(lvgl_theme);
 #else
     // Simple UI mode - just update the main chat message
     if (chat_message_label_ != nullptr) {
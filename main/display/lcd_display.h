@@ -36,8 +36,17 @@ protected:
     std::unique_ptr<LvglImage> preview_image_cached_ = nullptr;
     bool hide_subtitle_ = false;  // Control whether to hide chat messages/subtitles
 
+    // Chat bubbles share these styles, a theme change only updates them
+    lv_style_t chat_row_style_;
+    lv_style_t chat_bubble_style_;
+    lv_style_t user_bubble_style_;
+    lv_style_t assistant_bubble_style_;
+    lv_style_t system_bubble_style_;
+
     void InitializeLcdThemes();
     void SetupUI();
+    void UpdateChatStyles(LvglTheme* theme);
+    lv_obj_t* AcquireChatRow();
     virtual bool Lock(int timeout_ms = 0) override;
     virtual void Unlock() override;
 
@@ -58,12 +67,28 @@ public:
     void SetHideSubtitle(bool hide);
 };
 
+// Two 10-line buffers take the same internal RAM as the former single 20-line one
+#define SPI_LCD_DEFAULT_BUFFER_LINES 10
+
+// LVGL draw buffers of a SPI panel. With two buffers LVGL renders the next strip
+// while the previous one is still being sent by DMA. Boards can override the
+// defaults from config.h, e.g. { .lines = DISPLAY_BUFFER_LINES, .spiram = true }
+struct SpiLcdBufferConfig {
+    int lines = SPI_LCD_DEFAULT_BUFFER_LINES;   // Height of each buffer
+    bool double_buffer = true;
+    bool spiram = false;    // Buffers in PSRAM, flushed through a small internal DMA buffer
+};
+
 // SPI LCD display
 class SpiLcdDisplay : public LcdDisplay {
 public:
     SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
                   int width, int height, int offset_x, int offset_y,
-                  bool mirror_x, bool mirror_y, bool swap_xy);
+                  bool mirror_x, bool mirror_y, bool swap_xy,
+                  const SpiLcdBufferConfig& buffer_config = SpiLcdBufferConfig());
+
+private:
+    void ClearScreen();
 };
 
 // RGB LCD display
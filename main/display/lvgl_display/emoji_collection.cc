@@ -1,28 +1,176 @@
 #include "emoji_collection.h"
 
 #include <esp_log.h>
-#include <unordered_map>
+#include <esp_heap_caps.h>
+#include <cstring>
 #include <string>
 
 #define TAG "EmojiCollection"
 
+EmojiCollection::EmojiCollection(size_t cache_budget) : cache_budget_(cache_budget) {
+}
+
+EmojiCollection::Entry& EmojiCollection::Replace(const std::string& name) {
+    auto& entry = emoji_collection_[name];
+    delete entry.image;
+    cache_used_ -= entry.bytes;
+    entry = Entry();
+    return entry;
+}
+
 void EmojiCollection::AddEmoji(const std::string& name, LvglImage* image) {
-    emoji_collection_[name] = image;
+    Replace(name).image = image;
+}
+
+void EmojiCollection::AddEmoji(const std::string& name, const lv_img_dsc_t* image_dsc) {
+    Replace(name).source = image_dsc;
+}
+
+void EmojiCollection::AddEmoji(const std::string& name, const void* data, size_t size) {
+    auto& entry = Replace(name);
+    entry.data = data;
+    entry.size = size;
 }
 
 const LvglImage* EmojiCollection::GetEmojiImage(const char* name) {
     auto it = emoji_collection_.find(name);
-    if (it != emoji_collection_.end()) {
-        return it->second;
+    if (it == emoji_collection_.end()) {
+        ESP_LOGW(TAG, "Emoji not found: %s", name);
+        return nullptr;
+    }
+
+    auto& entry = it->second;
+    if (!Load(it->first, entry)) {
+        return nullptr;
+    }
+    if (current_ != nullptr && current_ != &entry) {
+        current_->next = it->first;
+    }
+    current_ = &entry;
+    entry.last_used = ++use_counter_;
+    return entry.image;
+}
+
+void EmojiCollection::PrefetchNext(const char* name) {
+#if EMOJI_CACHE_PREFETCH
+    auto it = emoji_collection_.find(name);
+    if (it == emoji_collection_.end() || it->second.next.empty()) {
+        return;
+    }
+    auto next = emoji_collection_.find(it->second.next);
+    if (next == emoji_collection_.end() || next->second.image != nullptr) {
+        return;
+    }
+    // Not owned by a shared_ptr, the collection may be gone when the call runs
+    auto self = weak_from_this();
+    if (self.expired()) {
+        return;
+    }
+
+    auto request = new std::pair<std::weak_ptr<EmojiCollection>, std::string>(self, next->first);
+    lv_async_call([](void* arg) {
+        auto request = static_cast<std::pair<std::weak_ptr<EmojiCollection>, std::string>*>(arg);
+        auto collection = request->first.lock();
+        if (collection != nullptr) {
+            auto it = collection->emoji_collection_.find(request->second);
+            if (it != collection->emoji_collection_.end() && collection->Load(it->first, it->second)) {
+                it->second.last_used = ++collection->use_counter_;
+            }
+        }
+        delete request;
+    }, request);
+#endif
+}
+
+bool EmojiCollection::Load(const std::string& name, Entry& entry) {
+    if (entry.image != nullptr) {
+        return true;
+    }
+    if (entry.source != nullptr) {
+        entry.image = new LvglSourceImage(entry.source);
+        return true;
+    }
+    if (entry.data == nullptr) {
+        return false;
+    }
+
+    entry.image = Decode(entry.data, entry.size, entry.bytes);
+    cache_used_ += entry.bytes;
+    ESP_LOGD(TAG, "Loaded emoji %s, %u bytes, %u/%u bytes used", name.c_str(), entry.bytes, cache_used_, cache_budget_);
+    return true;
+}
+
+LvglImage* EmojiCollection::Decode(const void* data, size_t size, size_t& bytes) {
+    bytes = 0;
+    auto raw = new LvglRawImage(const_cast<void*>(data), size);
+    // GIF frames are decoded by LvglGif, and without a budget LVGL decodes the file at draw time
+    if (cache_budget_ == 0 || raw->IsGif()) {
+        return raw;
     }
 
-    ESP_LOGW(TAG, "Emoji not found: %s", name);
-    return nullptr;
+    lv_image_decoder_args_t args = {};
+    args.no_cache = true;
+    lv_image_decoder_dsc_t decoder;
+    if (lv_image_decoder_open(&decoder, raw->image_dsc(), &args) != LV_RESULT_OK) {
+        ESP_LOGW(TAG, "Failed to decode emoji image, size: %u", size);
+        return raw;
+    }
+
+    LvglImage* image = raw;
+    const lv_draw_buf_t* decoded = decoder.decoded;
+    if (decoded != nullptr && Reserve(decoded->data_size)) {
+#if CONFIG_SPIRAM
+        void* pixels = heap_caps_malloc(decoded->data_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+        void* pixels = heap_caps_malloc(decoded->data_size, MALLOC_CAP_8BIT);
+#endif
+        if (pixels != nullptr) {
+            memcpy(pixels, decoded->data, decoded->data_size);
+            image = new LvglAllocatedImage(pixels, decoded->data_size, decoded->header.w, decoded->header.h,
+                decoded->header.stride, decoded->header.cf);
+            bytes = decoded->data_size;
+            delete raw;
+        }
+    }
+    lv_image_decoder_close(&decoder);
+    return image;
+}
+
+void EmojiCollection::Unload(Entry& entry) {
+    // LVGL may still cache the decoded file under the address of this descriptor
+    lv_image_cache_drop(entry.image->image_dsc());
+    delete entry.image;
+    entry.image = nullptr;
+    cache_used_ -= entry.bytes;
+    entry.bytes = 0;
+}
+
+// Evict the least recently used decoded emoji, except the one on screen
+bool EmojiCollection::Reserve(size_t bytes) {
+    if (bytes > cache_budget_) {
+        return false;
+    }
+    while (cache_used_ + bytes > cache_budget_) {
+        Entry* victim = nullptr;
+        for (auto& [name, entry] : emoji_collection_) {
+            if (entry.bytes == 0 || &entry == current_) {
+                continue;
+            }
+            if (victim == nullptr || entry.last_used < victim->last_used) {
+                victim = &entry;
+            }
+        }
+        if (victim == nullptr) {
+            return false;
+        }
+        Unload(*victim);
+    }
+    return true;
 }
 
 EmojiCollection::~EmojiCollection() {
     for (auto it = emoji_collection_.begin(); it != emoji_collection_.end(); ++it) {
-        delete it->second;
+        delete it->second.image;
     }
     emoji_collection_.clear();
 }
@@ -51,27 +199,27 @@ extern const lv_image_dsc_t emoji_1f61c_32; // silly
 extern const lv_image_dsc_t emoji_1f644_32; // confused
 
 Twemoji32::Twemoji32() {
-    AddEmoji("neutral", new LvglSourceImage(&emoji_1f636_32));
-    AddEmoji("happy", new LvglSourceImage(&emoji_1f642_32));
-    AddEmoji("laughing", new LvglSourceImage(&emoji_1f606_32));
-    AddEmoji("funny", new LvglSourceImage(&emoji_1f602_32));
-    AddEmoji("sad", new LvglSourceImage(&emoji_1f614_32));
-    AddEmoji("angry", new LvglSourceImage(&emoji_1f620_32));
-    AddEmoji("crying", new LvglSourceImage(&emoji_1f62d_32));
-    AddEmoji("loving", new LvglSourceImage(&emoji_1f60d_32));
-    AddEmoji("embarrassed", new LvglSourceImage(&emoji_1f633_32));
-    AddEmoji("surprised", new LvglSourceImage(&emoji_1f62f_32));
-    AddEmoji("shocked", new LvglSourceImage(&emoji_1f631_32));
-    AddEmoji("thinking", new LvglSourceImage(&emoji_1f914_32));
-    AddEmoji("winking", new LvglSourceImage(&emoji_1f609_32));
-    AddEmoji("cool", new LvglSourceImage(&emoji_1f60e_32));
-    AddEmoji("relaxed", new LvglSourceImage(&emoji_1f60c_32));
-    AddEmoji("delicious", new LvglSourceImage(&emoji_1f924_32));
-    AddEmoji("kissy", new LvglSourceImage(&emoji_1f618_32));
-    AddEmoji("confident", new LvglSourceImage(&emoji_1f60f_32));
-    AddEmoji("sleepy", new LvglSourceImage(&emoji_1f634_32));
-    AddEmoji("silly", new LvglSourceImage(&emoji_1f61c_32));
-    AddEmoji("confused", new LvglSourceImage(&emoji_1f644_32));
+    AddEmoji("neutral", &emoji_1f636_32);
+    AddEmoji("happy", &emoji_1f642_32);
+    AddEmoji("laughing", &emoji_1f606_32);
+    AddEmoji("funny", &emoji_1f602_32);
+    AddEmoji("sad", &emoji_1f614_32);
+    AddEmoji("angry", &emoji_1f620_32);
+    AddEmoji("crying", &emoji_1f62d_32);
+    AddEmoji("loving", &emoji_1f60d_32);
+    AddEmoji("embarrassed", &emoji_1f633_32);
+    AddEmoji("surprised", &emoji_1f62f_32);
+    AddEmoji("shocked", &emoji_1f631_32);
+    AddEmoji("thinking", &emoji_1f914_32);
+    AddEmoji("winking", &emoji_1f609_32);
+    AddEmoji("cool", &emoji_1f60e_32);
+    AddEmoji("relaxed", &emoji_1f60c_32);
+    AddEmoji("delicious", &emoji_1f924_32);
+    AddEmoji("kissy", &emoji_1f618_32);
+    AddEmoji("confident", &emoji_1f60f_32);
+    AddEmoji("sleepy", &emoji_1f634_32);
+    AddEmoji("silly", &emoji_1f61c_32);
+    AddEmoji("confused", &emoji_1f644_32);
 }
 
 
@@ -99,25 +247,25 @@ extern const lv_image_dsc_t emoji_1f61c_64; // silly
 extern const lv_image_dsc_t emoji_1f644_64; // confused
 
 Twemoji64::Twemoji64() {
-    AddEmoji("neutral", new LvglSourceImage(&emoji_1f636_64));
-    AddEmoji("happy", new LvglSourceImage(&emoji_1f642_64));
-    AddEmoji("laughing", new LvglSourceImage(&emoji_1f606_64));
-    AddEmoji("funny", new LvglSourceImage(&emoji_1f602_64));
-    AddEmoji("sad", new LvglSourceImage(&emoji_1f614_64));
-    AddEmoji("angry", new LvglSourceImage(&emoji_1f620_64));
-    AddEmoji("crying", new LvglSourceImage(&emoji_1f62d_64));
-    AddEmoji("loving", new LvglSourceImage(&emoji_1f60d_64));
-    AddEmoji("embarrassed", new LvglSourceImage(&emoji_1f633_64));
-    AddEmoji("surprised", new LvglSourceImage(&emoji_1f62f_64));
-    AddEmoji("shocked", new LvglSourceImage(&emoji_1f631_64));
-    AddEmoji("thinking", new LvglSourceImage(&emoji_1f914_64));
-    AddEmoji("winking", new LvglSourceImage(&emoji_1f609_64));
-    AddEmoji("cool", new LvglSourceImage(&emoji_1f60e_64));
-    AddEmoji("relaxed", new LvglSourceImage(&emoji_1f60c_64));
-    AddEmoji("delicious", new LvglSourceImage(&emoji_1f924_64));
-    AddEmoji("kissy", new LvglSourceImage(&emoji_1f618_64));
-    AddEmoji("confident", new LvglSourceImage(&emoji_1f60f_64));
-    AddEmoji("sleepy", new LvglSourceImage(&emoji_1f634_64));
-    AddEmoji("silly", new LvglSourceImage(&emoji_1f61c_64));
-    AddEmoji("confused", new LvglSourceImage(&emoji_1f644_64));
+    AddEmoji("neutral", &emoji_1f636_64);
+    AddEmoji("happy", &emoji_1f642_64);
+    AddEmoji("laughing", &emoji_1f606_64);
+    AddEmoji("funny", &emoji_1f602_64);
+    AddEmoji("sad", &emoji_1f614_64);
+    AddEmoji("angry", &emoji_1f620_64);
+    AddEmoji("crying", &emoji_1f62d_64);
+    AddEmoji("loving", &emoji_1f60d_64);
+    AddEmoji("embarrassed", &emoji_1f633_64);
+    AddEmoji("surprised", &emoji_1f62f_64);
+    AddEmoji("shocked", &emoji_1f631_64);
+    AddEmoji("thinking", &emoji_1f914_64);
+    AddEmoji("winking", &emoji_1f609_64);
+    AddEmoji("cool", &emoji_1f60e_64);
+    AddEmoji("relaxed", &emoji_1f60c_64);
+    AddEmoji("delicious", &emoji_1f924_64);
+    AddEmoji("kissy", &emoji_1f618_64);
+    AddEmoji("confident", &emoji_1f60f_64);
+    AddEmoji("sleepy", &emoji_1f634_64);
+    AddEmoji("silly", &emoji_1f61c_64);
+    AddEmoji("confused", &emoji_1f644_64);
 }
@@ -9,16 +9,63 @@
 #include <string>
 #include <memory>
 
+/**
+ * Memory budget of emoji decoded from PNG/JPG files, shared by one collection
+ * Boards without PSRAM let LVGL decode the files at draw time instead
+ */
+#ifndef EMOJI_CACHE_BUDGET
+#if CONFIG_SPIRAM
+#define EMOJI_CACHE_BUDGET (512 * 1024)
+#else
+#define EMOJI_CACHE_BUDGET 0
+#endif
+#endif
+
+// Decode the emotion that usually follows the current one in the background
+#ifndef EMOJI_CACHE_PREFETCH
+#define EMOJI_CACHE_PREFETCH (EMOJI_CACHE_BUDGET > 0)
+#endif
+
 
 // Define interface for emoji collection
-class EmojiCollection {
+// Emoji are registered by name and loaded on first use, call with the display lock held
+class EmojiCollection : public std::enable_shared_from_this<EmojiCollection> {
 public:
+    EmojiCollection(size_t cache_budget = EMOJI_CACHE_BUDGET);
+
     virtual void AddEmoji(const std::string& name, LvglImage* image);
+    // Built-in image, wrapped on first use
+    void AddEmoji(const std::string& name, const lv_img_dsc_t* image_dsc);
+    // PNG/JPG/GIF file, e.g. in the assets partition, decoded on first use
+    void AddEmoji(const std::string& name, const void* data, size_t size);
+
     virtual const LvglImage* GetEmojiImage(const char* name);
+    // Load the emotion most likely to be shown after this one, on the next LVGL timer run
+    void PrefetchNext(const char* name);
     virtual ~EmojiCollection();
 
 private:
-    std::map<std::string, LvglImage*> emoji_collection_;
+    struct Entry {
+        const lv_img_dsc_t* source = nullptr;   // Built-in image
+        const void* data = nullptr;             // Encoded file
+        size_t size = 0;
+        LvglImage* image = nullptr;             // Loaded image, or nullptr
+        size_t bytes = 0;                       // Decoded pixels owned by image
+        uint32_t last_used = 0;
+        std::string next;                       // Emotion shown after this one last time
+    };
+
+    std::map<std::string, Entry> emoji_collection_;
+    size_t cache_budget_;
+    size_t cache_used_ = 0;
+    uint32_t use_counter_ = 0;
+    Entry* current_ = nullptr;      // On screen, never evicted
+
+    Entry& Replace(const std::string& name);
+    bool Load(const std::string& name, Entry& entry);
+    LvglImage* Decode(const void* data, size_t size, size_t& bytes);
+    void Unload(Entry& entry);
+    bool Reserve(size_t bytes);
 };
 
 class Twemoji32 : public EmojiCollection {
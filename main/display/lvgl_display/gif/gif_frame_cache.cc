@@ -0,0 +1,136 @@
+#include "gif_frame_cache.h"
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "GifFrameCache"
+
+GifFrameCache::Animation::~Animation() {
+    for (auto& frame : frames) {
+        heap_caps_free(frame.pixels);
+    }
+}
+
+std::shared_ptr<GifFrameCache::Animation> GifFrameCache::Acquire(const void* source, size_t source_size,
+                                                               uint16_t width, uint16_t height) {
+    if (GIF_FRAME_CACHE_BUDGET == 0 || source == nullptr) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& animation : animations_) {
+        if (animation->source == source && animation->source_size == source_size) {
+            animation->last_used = lv_tick_get();
+            return animation;
+        }
+    }
+
+    auto animation = std::make_shared<Animation>();
+    animation->source = source;
+    animation->source_size = source_size;
+    animation->width = width;
+    animation->height = height;
+    animation->last_used = lv_tick_get();
+    animations_.push_back(animation);
+    return animation;
+}
+
+bool GifFrameCache::BeginRecording(Animation& animation, const void* recorder) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (animation.complete || animation.rejected || animation.recorder != nullptr) {
+        return false;
+    }
+    animation.recorder = recorder;
+    return true;
+}
+
+void GifFrameCache::EndRecording(Animation& animation, bool complete) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    animation.recorder = nullptr;
+    if (complete && !animation.rejected) {
+        animation.complete = true;
+        ESP_LOGI(TAG, "Cached %u frames of %ux%u GIF, %u bytes, %u/%u bytes used", animation.frames.size(),
+            animation.width, animation.height, animation.bytes, used_, (size_t)GIF_FRAME_CACHE_BUDGET);
+    } else {
+        ReleaseFrames(animation);
+    }
+}
+
+bool GifFrameCache::AddFrame(Animation& animation, const uint8_t* canvas, const lv_area_t& area, uint32_t delay_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (animation.rejected) {
+        return false;
+    }
+
+    int32_t w = lv_area_get_width(&area);
+    int32_t h = lv_area_get_height(&area);
+    size_t size = w * h * 4;
+    uint8_t* pixels = nullptr;
+    if (Reserve(size, &animation)) {
+#if CONFIG_SPIRAM
+        pixels = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+        pixels = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_8BIT);
+#endif
+    }
+    if (pixels == nullptr) {
+        ESP_LOGW(TAG, "%ux%u GIF does not fit in the frame cache, decoding it live", animation.width, animation.height);
+        ReleaseFrames(animation);
+        animation.rejected = true;
+        return false;
+    }
+
+    const uint8_t* src = canvas + (area.y1 * animation.width + area.x1) * 4;
+    for (int32_t y = 0; y < h; y++) {
+        memcpy(pixels + y * w * 4, src, w * 4);
+        src += animation.width * 4;
+    }
+    animation.frames.push_back({ area, delay_ms, pixels });
+    animation.bytes += size;
+    used_ += size;
+    return true;
+}
+
+void GifFrameCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& animation : animations_) {
+        // Animations still playing keep their frames until released, but no longer count
+        used_ -= animation->bytes;
+        animation->bytes = 0;
+        animation->rejected = true;
+    }
+    animations_.clear();
+}
+
+// Caller holds mutex_
+void GifFrameCache::ReleaseFrames(Animation& animation) {
+    for (auto& frame : animation.frames) {
+        heap_caps_free(frame.pixels);
+    }
+    animation.frames.clear();
+    used_ -= animation.bytes;
+    animation.bytes = 0;
+}
+
+// Evict the least recently used animations nobody is playing, caller holds mutex_
+bool GifFrameCache::Reserve(size_t bytes, const Animation* keep) {
+    while (used_ + bytes > GIF_FRAME_CACHE_BUDGET) {
+        auto victim = animations_.end();
+        for (auto it = animations_.begin(); it != animations_.end(); ++it) {
+            auto& animation = *it;
+            if (animation.get() == keep || !animation->complete || animation->bytes == 0 || animation.use_count() > 1) {
+                continue;
+            }
+            if (victim == animations_.end() || (int32_t)(animation->last_used - (*victim)->last_used) < 0) {
+                victim = it;
+            }
+        }
+        if (victim == animations_.end()) {
+            return false;
+        }
+        ReleaseFrames(**victim);
+        animations_.erase(victim);
+    }
+    return true;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <lvgl.h>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Memory budget of decoded GIF frames, shared by all animations
+ * Boards without PSRAM keep decoding every frame
+ */
+#ifndef GIF_FRAME_CACHE_BUDGET
+#if CONFIG_SPIRAM
+#define GIF_FRAME_CACHE_BUDGET (1024 * 1024)
+#else
+#define GIF_FRAME_CACHE_BUDGET 0
+#endif
+#endif
+
+/**
+ * Decoded frames of looping GIF animations, kept across LvglGif instances
+ * Frame 0 holds the whole canvas, every following frame only the rectangle that
+ * changed since the previous one, so playback is a small copy per frame.
+ */
+class GifFrameCache {
+public:
+    struct Frame {
+        lv_area_t area;         // Rectangle in image coordinates
+        uint32_t delay_ms;      // Time to show this frame
+        uint8_t* pixels;        // ARGB8888, area width * height * 4 bytes
+    };
+
+    struct Animation {
+        const void* source = nullptr;
+        size_t source_size = 0;
+        uint16_t width = 0;
+        uint16_t height = 0;
+        std::vector<Frame> frames;
+        size_t bytes = 0;
+        bool complete = false;
+        bool rejected = false;          // Does not fit in the budget
+        const void* recorder = nullptr; // Instance that is decoding the frames
+        uint32_t last_used = 0;
+
+        ~Animation();
+    };
+
+    static GifFrameCache& GetInstance() {
+        static GifFrameCache instance;
+        return instance;
+    }
+
+    /**
+     * Find the animation of a GIF, or create an empty one
+     * Returns nullptr if caching is disabled
+     */
+    std::shared_ptr<Animation> Acquire(const void* source, size_t source_size, uint16_t width, uint16_t height);
+
+    /**
+     * Copy a rectangle of the canvas as the next frame
+     * Returns false and rejects the animation when the budget is exceeded
+     */
+    bool AddFrame(Animation& animation, const uint8_t* canvas, const lv_area_t& area, uint32_t delay_ms);
+
+    /**
+     * Let one instance decode the frames of an animation
+     * Returns false if it is already complete, rejected or being recorded
+     */
+    bool BeginRecording(Animation& animation, const void* recorder);
+
+    /**
+     * Mark the animation complete, or drop its frames if it could not be completed
+     */
+    void EndRecording(Animation& animation, bool complete);
+
+    /**
+     * Forget all animations, e.g. when the GIF data is unmapped
+     */
+    void Clear();
+
+private:
+    GifFrameCache() = default;
+
+    std::mutex mutex_;
+    size_t used_ = 0;
+    std::vector<std::shared_ptr<Animation>> animations_;
+
+    void ReleaseFrames(Animation& animation);
+    bool Reserve(size_t bytes, const Animation* keep);
+};
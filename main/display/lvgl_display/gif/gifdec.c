@@ -1,6 +1,7 @@
 #include "gifdec.h"
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdbool.h>
 #include <esp_log.h>
@@ -10,21 +11,9 @@
 #define MIN(A, B) ((A) < (B) ? (A) : (B))
 #define MAX(A, B) ((A) > (B) ? (A) : (B))
 
-typedef struct Entry {
-    uint16_t length;
-    uint16_t prefix;
-    uint8_t  suffix;
-} Entry;
-
-typedef struct Table {
-    int bulk;
-    int nentries;
-    Entry * entries;
-} Table;
-
-#if LV_GIF_CACHE_DECODE_DATA
 #define LZW_MAXBITS                 12
 #define LZW_TABLE_SIZE              (1 << LZW_MAXBITS)
+#if LV_GIF_CACHE_DECODE_DATA
 #define LZW_CACHE_SIZE              (LZW_TABLE_SIZE * 4)
 #endif
 
@@ -38,6 +27,30 @@ static void f_gif_close(gd_GIF * gif);
     #include "gifdec_mve.h"
 #endif
 
+/* Canvas pixels are B, G, R, A bytes, i.e. one little-endian ARGB word. */
+static inline uint32_t
+canvas_pixel(const uint8_t * rgb, uint8_t opa)
+{
+    return ((uint32_t) opa << 24) | ((uint32_t) rgb[0] << 16) | ((uint32_t) rgb[1] << 8) | rgb[2];
+}
+
+#ifndef GIFDEC_FILL_BG
+static void
+fill_rect(uint8_t * dst, uint16_t w, uint16_t h, uint16_t stride, const uint8_t * color, uint8_t opa)
+{
+    uint32_t pixel = canvas_pixel(color, opa);
+    uint32_t * row = (uint32_t *) dst;
+    int j, k;
+
+    for(j = 0; j < h; j++) {
+        for(k = 0; k < w; k++) {
+            row[k] = pixel;
+        }
+        row += stride;
+    }
+}
+#endif
+
 static uint16_t
 read_num(gd_GIF * gif)
 {
@@ -152,12 +165,8 @@ static gd_GIF * gif_open(gd_GIF * gif_base)
 #ifdef GIFDEC_FILL_BG
     GIFDEC_FILL_BG(gif->canvas, gif->width * gif->height, 1, gif->width * gif->height, bgcolor, 0x00);
 #else
-    for(int i = 0; i < gif->width * gif->height; i++) {
-        gif->canvas[i * 4 + 0] = *(bgcolor + 2);
-        gif->canvas[i * 4 + 1] = *(bgcolor + 1);
-        gif->canvas[i * 4 + 2] = *(bgcolor + 0);
-        gif->canvas[i * 4 + 3] = 0x00;  // 初始化为透明，让第一帧根据自己的透明度设置来渲染
-    }
+    // 初始化为透明，让第一帧根据自己的透明度设置来渲染
+    fill_rect(gif->canvas, gif->width, gif->height, gif->width, bgcolor, 0x00);
 #endif
     gif->anim_start = f_gif_seek(gif, 0, LV_FS_SEEK_CUR);
     gif->loop_count = -1;
@@ -299,6 +308,7 @@ read_ext(gd_GIF * gif)
     }
 }
 
+#if LV_GIF_CACHE_DECODE_DATA
 static uint16_t
 get_key(gd_GIF *gif, int key_size, uint8_t *sub_len, uint8_t *shift, uint8_t *byte)
 {
@@ -328,7 +338,6 @@ get_key(gd_GIF *gif, int key_size, uint8_t *sub_len, uint8_t *shift, uint8_t *by
     return key;
 }
 
-#if LV_GIF_CACHE_DECODE_DATA
 /* Decompress image pixels.
  * Return 0 on success or -1 on out-of-memory (w.r.t. LZW code table) or parse error. */
 static int
@@ -478,46 +487,53 @@ read_image_data(gd_GIF *gif, int interlace)
     return ret;
 }
 #else
-static Table *
-new_table(int key_size)
+/* Reads LZW codes from the data sub-blocks, a whole sub-block at a time. */
+typedef struct BitReader {
+    gd_GIF * gif;
+    uint32_t bits;
+    int nbits;
+    int block_len;
+    int block_pos;
+    bool end;
+    uint8_t block[255];
+} BitReader;
+
+static bool
+next_sub_block(BitReader * br)
 {
-    int key;
-    int init_bulk = MAX(1 << (key_size + 1), 0x100);
-    Table * table = lv_malloc(sizeof(*table) + sizeof(Entry) * init_bulk);
-    if(table) {
-        table->bulk = init_bulk;
-        table->nentries = (1 << key_size) + 2;
-        table->entries = (Entry *) &table[1];
-        for(key = 0; key < (1 << key_size); key++)
-            table->entries[key] = (Entry) {
-            1, 0xFFF, key
-        };
-    }
-    return table;
+    uint8_t size = 0;
+
+    if(br->end) return false;
+    f_gif_read(br->gif, &size, 1);
+    if(size == 0) {
+        br->end = true;
+        return false;
+    }
+    f_gif_read(br->gif, br->block, size);
+    br->block_len = size;
+    br->block_pos = 0;
+    return true;
 }
 
-/* Add table entry. Return value:
- *  0 on success
- *  +1 if key size must be incremented after this addition
- *  -1 if could not realloc table */
-static int
-add_entry(Table ** tablep, uint16_t length, uint16_t prefix, uint8_t suffix)
+/* Return the next code, or LZW_TABLE_SIZE when the data ends. */
+static inline uint16_t
+read_code(BitReader * br, int key_size)
 {
-    Table * table = *tablep;
-    if(table->nentries == table->bulk) {
-        table->bulk *= 2;
-        table = lv_realloc(table, sizeof(*table) + sizeof(Entry) * table->bulk);
-        if(!table) return -1;
-        table->entries = (Entry *) &table[1];
-        *tablep = table;
-    }
-    table->entries[table->nentries] = (Entry) {
-        length, prefix, suffix
-    };
-    table->nentries++;
-    if((table->nentries & (table->nentries - 1)) == 0)
-        return 1;
-    return 0;
+    uint16_t code;
+
+    if(br->nbits < key_size) {
+        /* Top up to a full word so most codes need no refill. */
+        while(br->nbits <= 24) {
+            if(br->block_pos == br->block_len && !next_sub_block(br)) break;
+            br->bits |= (uint32_t) br->block[br->block_pos++] << br->nbits;
+            br->nbits += 8;
+        }
+        if(br->nbits < key_size) return LZW_TABLE_SIZE;
+    }
+    code = br->bits & ((1 << key_size) - 1);
+    br->bits >>= key_size;
+    br->nbits -= key_size;
+    return code;
 }
 
 /* Compute output index of y-th input line, in frame of height h. */
@@ -542,84 +558,147 @@ interlaced_line_index(int h, int y)
     return y * 2 + 1;
 }
 
+static inline uint8_t *
+frame_row(gd_GIF * gif, int interlace, int y)
+{
+    if(interlace)
+        y = interlaced_line_index((int) gif->fh, y);
+    return &gif->frame[(gif->fy + y) * gif->width + gif->fx];
+}
+
 /* Decompress image pixels.
+ * Strings are written backwards from their last pixel, straight into the frame
+ * when they fit in the current row. Interlacing only matters once per row.
  * Return 0 on success or -1 on out-of-memory (w.r.t. LZW code table) or parse error. */
 static int
 read_image_data(gd_GIF * gif, int interlace)
 {
-    uint8_t sub_len, shift, byte;
-    int init_key_size, key_size, table_is_full = 0;
-    int frm_off, frm_size, str_len = 0, i, p, x, y;
-    uint16_t key, clear, stop;
-    int ret;
-    Table * table;
-    Entry entry = {0};
+    uint8_t byte;
+    int init_key_size, key_size;
+    int frm_off, frm_size, fw, x, y, len, n;
+    uint16_t code, clear, stop, next, prev, c;
+    uint8_t first = 0;
+    uint8_t * row;
+    uint8_t * p;
     size_t start, end;
+    BitReader br;
+    int ret = 0;
 
     f_gif_read(gif, &byte, 1);
-    key_size = (int) byte;
     start = f_gif_seek(gif, 0, LV_FS_SEEK_CUR);
     discard_sub_blocks(gif);
     end = f_gif_seek(gif, 0, LV_FS_SEEK_CUR);
     f_gif_seek(gif, start, LV_FS_SEEK_SET);
-    clear = 1 << key_size;
+    if(byte >= LZW_MAXBITS) {
+        ESP_LOGW(TAG, "invalid LZW code size: %d", byte);
+        f_gif_seek(gif, end, LV_FS_SEEK_SET);
+        return -1;
+    }
+
+    /* Code table plus a buffer for strings that span rows. */
+    uint16_t * prefix = lv_malloc(LZW_TABLE_SIZE * (2 * sizeof(uint16_t) + 2));
+    if(!prefix) {
+        f_gif_seek(gif, end, LV_FS_SEEK_SET);
+        return -1;
+    }
+    uint16_t * length = prefix + LZW_TABLE_SIZE;
+    uint8_t * suffix = (uint8_t *) (length + LZW_TABLE_SIZE);
+    uint8_t * str = suffix + LZW_TABLE_SIZE;
+
+    clear = 1 << byte;
     stop = clear + 1;
-    table = new_table(key_size);
-    key_size++;
-    init_key_size = key_size;
-    sub_len = shift = 0;
-    key = get_key(gif, key_size, &sub_len, &shift, &byte); /* clear code */
+    for(c = 0; c < clear; c++) {
+        prefix[c] = 0;
+        length[c] = 1;
+        suffix[c] = (uint8_t) c;
+    }
+    init_key_size = byte + 1;
+    key_size = init_key_size;
+    next = clear + 2;
+    prev = LZW_TABLE_SIZE;
+
+    memset(&br, 0, offsetof(BitReader, block));
+    br.gif = gif;
+
+    fw = gif->fw;
+    frm_size = fw * gif->fh;
     frm_off = 0;
-    ret = 0;
-    frm_size = gif->fw * gif->fh;
+    x = y = 0;
+    row = frame_row(gif, interlace, 0);
     while(frm_off < frm_size) {
-        if(key == clear) {
+        code = read_code(&br, key_size);
+        if(code == clear) {
             key_size = init_key_size;
-            table->nentries = (1 << (key_size - 1)) + 2;
-            table_is_full = 0;
+            next = clear + 2;
+            prev = LZW_TABLE_SIZE;
+            continue;
         }
-        else if(!table_is_full) {
-            ret = add_entry(&table, str_len + 1, key, entry.suffix);
-            if(ret == -1) {
-                lv_free(table);
-                return -1;
+        if(code == stop || code == LZW_TABLE_SIZE) break;
+
+        if(prev == LZW_TABLE_SIZE) {
+            if(code >= clear) break;
+        }
+        else if(code == next && next < LZW_TABLE_SIZE) {
+            /* The string of the previous code plus its own first pixel. */
+            prefix[next] = prev;
+            length[next] = length[prev] + 1;
+            suffix[next] = first;
+            next++;
+            if(next == (1 << key_size) && key_size < LZW_MAXBITS) key_size++;
+            prev = LZW_TABLE_SIZE;
+        }
+        else if(code >= next) break;
+
+        len = length[code];
+        if(frm_off + len > frm_size) {
+            ESP_LOGW(TAG, "LZW table token overflows the frame buffer");
+            ret = -1;
+            break;
+        }
+
+        /* Expand the string backwards, from its last pixel to its first. */
+        p = (x + len <= fw) ? row + x + len : str + len;
+        c = code;
+        while(c >= clear) {
+            *--p = suffix[c];
+            c = prefix[c];
+        }
+        *--p = (uint8_t) c;
+        first = (uint8_t) c;
+
+        if(x + len <= fw) {
+            x += len;
+            if(x == fw && ++y < gif->fh) {
+                x = 0;
+                row = frame_row(gif, interlace, y);
             }
-            if(table->nentries == 0x1000) {
-                ret = 0;
-                table_is_full = 1;
+        }
+        else {
+            for(n = 0; n < len;) {
+                int count = MIN(fw - x, len - n);
+                memcpy(row + x, str + n, count);
+                n += count;
+                x += count;
+                if(x == fw && ++y < gif->fh) {
+                    x = 0;
+                    row = frame_row(gif, interlace, y);
+                }
             }
         }
-        key = get_key(gif, key_size, &sub_len, &shift, &byte);
-        if(key == clear) continue;
-        if(key == stop || key == 0x1000) break;
-        if(ret == 1) key_size++;
-        entry = table->entries[key];
-        str_len = entry.length;
-	if(frm_off + str_len > frm_size){
-		ESP_LOGW(TAG, "LZW table token overflows the frame buffer");
-		lv_free(table);
-		return -1;
-	}
-        for(i = 0; i < str_len; i++) {
-            p = frm_off + entry.length - 1;
-            x = p % gif->fw;
-            y = p / gif->fw;
-            if(interlace)
-                y = interlaced_line_index((int) gif->fh, y);
-            gif->frame[(gif->fy + y) * gif->width + gif->fx + x] = entry.suffix;
-            if(entry.prefix == 0xFFF)
-                break;
-            else
-                entry = table->entries[entry.prefix];
+        frm_off += len;
+
+        if(prev != LZW_TABLE_SIZE && next < LZW_TABLE_SIZE) {
+            prefix[next] = prev;
+            length[next] = length[prev] + 1;
+            suffix[next] = first;
+            next++;
+            if(next == (1 << key_size) && key_size < LZW_MAXBITS) key_size++;
         }
-        frm_off += str_len;
-        if(key < table->nentries - 1 && !table_is_full)
-            table->entries[table->nentries - 1].suffix = entry.suffix;
+        prev = code;
     }
-    lv_free(table);
-    if(key == stop) f_gif_read(gif, &sub_len, 1);  /* Must be zero! */
+    lv_free(prefix);
     f_gif_seek(gif, end, LV_FS_SEEK_SET);
-    return 0;
+    return ret;
 }
 
 #endif
@@ -666,21 +745,36 @@ render_frame_rect(gd_GIF * gif, uint8_t * buffer)
                         &gif->frame[i], gif->palette->colors,
                         gif->gce.transparency ? gif->gce.tindex : 0x100);
 #else
+    /* One word per palette entry, every index is covered as colors[] always has 256 entries. */
+    uint32_t lut[0x100];
+    const uint8_t * src = &gif->frame[i];
+    uint32_t * dst = (uint32_t *) &buffer[i * 4];
+    int tindex = gif->gce.transparency ? gif->gce.tindex : 0x100;
     int j, k;
-    uint8_t index, * color;
 
+    for(k = 0; k < 0x100; k++) {
+        lut[k] = canvas_pixel(&gif->palette->colors[k * 3], 0xFF);
+    }
     for(j = 0; j < gif->fh; j++) {
-        for(k = 0; k < gif->fw; k++) {
-            index = gif->frame[(gif->fy + j) * gif->width + gif->fx + k];
-            color = &gif->palette->colors[index * 3];
-            if(!gif->gce.transparency || index != gif->gce.tindex) {
-                buffer[(i + k) * 4 + 0] = *(color + 2);
-                buffer[(i + k) * 4 + 1] = *(color + 1);
-                buffer[(i + k) * 4 + 2] = *(color + 0);
-                buffer[(i + k) * 4 + 3] = 0xFF;
+        if(tindex > 0xFF) {
+            for(k = 0; k + 4 <= gif->fw; k += 4) {
+                dst[k + 0] = lut[src[k + 0]];
+                dst[k + 1] = lut[src[k + 1]];
+                dst[k + 2] = lut[src[k + 2]];
+                dst[k + 3] = lut[src[k + 3]];
+            }
+            for(; k < gif->fw; k++) {
+                dst[k] = lut[src[k]];
             }
         }
-        i += gif->width;
+        else {
+            for(k = 0; k < gif->fw; k++) {
+                uint8_t index = src[k];
+                if(index != tindex) dst[k] = lut[index];
+            }
+        }
+        src += gif->width;
+        dst += gif->width;
     }
 #endif
 }
@@ -701,16 +795,7 @@ dispose(gd_GIF * gif)
 #ifdef GIFDEC_FILL_BG
             GIFDEC_FILL_BG(&(gif->canvas[i * 4]), gif->fw, gif->fh, gif->width, bgcolor, opa);
 #else
-            int j, k;
-            for(j = 0; j < gif->fh; j++) {
-                for(k = 0; k < gif->fw; k++) {
-                    gif->canvas[(i + k) * 4 + 0] = *(bgcolor + 2);
-                    gif->canvas[(i + k) * 4 + 1] = *(bgcolor + 1);
-                    gif->canvas[(i + k) * 4 + 2] = *(bgcolor + 0);
-                    gif->canvas[(i + k) * 4 + 3] = opa;
-                }
-                i += gif->width;
-            }
+            fill_rect(&gif->canvas[i * 4], gif->fw, gif->fh, gif->width, bgcolor, opa);
 #endif
             break;
         case 3: /* Restore to previous, i.e., don't update canvas.*/
@@ -5,7 +5,10 @@
 #define TAG "LvglGif"
 
 LvglGif::LvglGif(const lv_img_dsc_t* img_dsc)
-    : gif_(nullptr), timer_(nullptr), last_call_(0), playing_(false), loaded_(false) {
+    : gif_(nullptr), timer_(nullptr), last_call_(0), playing_(false), loaded_(false),
+      frame_delay_ms_(0), source_(nullptr), source_size_(0), recording_(false), cache_index_(0),
+      pass_(0), first_frame_pos_(0) {
+    lv_area_set(&dirty_area_, 0, 0, 0, 0);
     if (!img_dsc || !img_dsc->data) {
         ESP_LOGE(TAG, "Invalid image descriptor");
         return;
@@ -27,6 +30,9 @@ LvglGif::LvglGif(const lv_img_dsc_t* img_dsc)
     img_dsc_.header.stride = gif_->width * 4;
     img_dsc_.data = gif_->canvas;
     img_dsc_.data_size = gif_->width * gif_->height * 4;
+    lv_area_set(&dirty_area_, 0, 0, gif_->width - 1, gif_->height - 1);
+    source_ = img_dsc->data;
+    source_size_ = img_dsc->data_size;
 
     // Render first frame
     if (gif_->canvas) {
@@ -106,6 +112,8 @@ void LvglGif::Stop() {
 
     if (gif_) {
         gd_rewind(gif_);
+        // The next cached frame is the full first one
+        cache_index_ = 0;
         NextFrame();
         ESP_LOGD(TAG, "GIF animation stopped and rewound");
     }
@@ -152,6 +160,23 @@ void LvglGif::SetFrameCallback(std::function<void()> callback) {
     frame_callback_ = callback;
 }
 
+void LvglGif::EnableFrameCache() {
+    if (!loaded_ || !gif_ || cache_) {
+        return;
+    }
+
+    auto& frame_cache = GifFrameCache::GetInstance();
+    cache_ = frame_cache.Acquire(source_, source_size_, gif_->width, gif_->height);
+    if (!cache_ || cache_->complete) {
+        return;
+    }
+    // Someone else is decoding the frames or they do not fit, play live
+    recording_ = frame_cache.BeginRecording(*cache_, this);
+    if (!recording_) {
+        cache_.reset();
+    }
+}
+
 void LvglGif::NextFrame() {
     if (!loaded_ || !gif_ || !playing_) {
         return;
@@ -159,12 +184,30 @@ void LvglGif::NextFrame() {
 
     // Check if enough time has passed for the next frame
     uint32_t elapsed = lv_tick_elaps(last_call_);
-    if (elapsed < gif_->gce.delay * 10) {
+    if (elapsed < frame_delay_ms_) {
         return;
     }
 
     last_call_ = lv_tick_get();
 
+    if (cache_ && cache_->complete) {
+        PlayCachedFrame();
+    } else {
+        DecodeFrame();
+    }
+
+    // Call frame callback if set
+    if (gif_->canvas && frame_callback_) {
+        frame_callback_();
+    }
+}
+
+void LvglGif::DecodeFrame() {
+    // The decoder restores the previous frame to background before drawing the next one
+    bool restore = gif_->gce.disposal == 2 && gif_->fw > 0 && gif_->fh > 0;
+    lv_area_t previous;
+    lv_area_set(&previous, gif_->fx, gif_->fy, gif_->fx + gif_->fw - 1, gif_->fy + gif_->fh - 1);
+
     // Get next frame
     int has_next = gd_get_frame(gif_);
     if (has_next == 0) {
@@ -177,17 +220,96 @@ void LvglGif::NextFrame() {
     }
 
     // Render current frame
-    if (gif_->canvas) {
-        gd_render_frame(gif_, gif_->canvas);
-        
-        // Call frame callback if set
-        if (frame_callback_) {
-            frame_callback_();
+    if (!gif_->canvas) {
+        return;
+    }
+    gd_render_frame(gif_, gif_->canvas);
+    frame_delay_ms_ = gif_->gce.delay * 10;
+
+    if (gif_->fw > 0 && gif_->fh > 0) {
+        lv_area_set(&dirty_area_, gif_->fx, gif_->fy, gif_->fx + gif_->fw - 1, gif_->fy + gif_->fh - 1);
+        if (restore) {
+            dirty_area_.x1 = LV_MIN(dirty_area_.x1, previous.x1);
+            dirty_area_.y1 = LV_MIN(dirty_area_.y1, previous.y1);
+            dirty_area_.x2 = LV_MAX(dirty_area_.x2, previous.x2);
+            dirty_area_.y2 = LV_MAX(dirty_area_.y2, previous.y2);
         }
+    } else {
+        lv_area_set(&dirty_area_, 0, 0, gif_->width - 1, gif_->height - 1);
+    }
+
+    if (recording_ && has_next == 1) {
+        RecordFrame();
     }
 }
 
+void LvglGif::RecordFrame() {
+    // Only endless loops are worth caching
+    if (gif_->loop_count != 0) {
+        StopRecording(false);
+        return;
+    }
+
+    // Data is in memory, the read position identifies the frame
+    uint32_t pos = gif_->f_rw_p;
+    if (first_frame_pos_ == 0) {
+        first_frame_pos_ = pos;
+        pass_ = 1;
+    } else if (pos == first_frame_pos_) {
+        pass_++;
+    }
+
+    // Frames of the first loop still show what was on the canvas before the
+    // animation started, record the second loop which repeats forever
+    if (pass_ == 2) {
+        lv_area_t area = dirty_area_;
+        if (cache_->frames.empty()) {
+            lv_area_set(&area, 0, 0, gif_->width - 1, gif_->height - 1);
+        }
+        if (!GifFrameCache::GetInstance().AddFrame(*cache_, gif_->canvas, area, frame_delay_ms_)) {
+            StopRecording(false);
+        }
+    } else if (pass_ == 3) {
+        // The frame on screen is the cached first frame
+        StopRecording(true);
+        if (cache_->complete) {
+            cache_index_ = 1 % cache_->frames.size();
+        }
+    }
+}
+
+void LvglGif::StopRecording(bool complete) {
+    if (!recording_) {
+        return;
+    }
+    recording_ = false;
+    GifFrameCache::GetInstance().EndRecording(*cache_, complete);
+    if (!complete) {
+        cache_.reset();
+    }
+}
+
+void LvglGif::PlayCachedFrame() {
+    auto& frame = cache_->frames[cache_index_];
+    int32_t w = lv_area_get_width(&frame.area);
+    int32_t h = lv_area_get_height(&frame.area);
+    uint8_t* dst = gif_->canvas + (frame.area.y1 * gif_->width + frame.area.x1) * 4;
+    const uint8_t* src = frame.pixels;
+    for (int32_t y = 0; y < h; y++) {
+        memcpy(dst, src, w * 4);
+        dst += gif_->width * 4;
+        src += w * 4;
+    }
+
+    dirty_area_ = frame.area;
+    frame_delay_ms_ = frame.delay_ms;
+    cache_index_ = (cache_index_ + 1) % cache_->frames.size();
+}
+
 void LvglGif::Cleanup() {
+    StopRecording(false);
+    cache_.reset();
+
     // Stop and delete timer
     if (timer_) {
         lv_timer_delete(timer_);
@@ -2,6 +2,7 @@
 
 #include "../lvgl_image.h"
 #include "gifdec.h"
+#include "gif_frame_cache.h"
 #include <lvgl.h>
 #include <memory>
 #include <functional>
@@ -69,6 +70,17 @@ public:
      */
     void SetFrameCallback(std::function<void()> callback);
 
+    /**
+     * Play looping GIFs from GifFrameCache once their frames are decoded
+     * Call before Start()
+     */
+    void EnableFrameCache();
+
+    /**
+     * Area of the image changed by the last frame, in image coordinates
+     */
+    const lv_area_t& dirty_area() const { return dirty_area_; }
+
 private:
     // GIF decoder instance
     gd_GIF* gif_;
@@ -88,11 +100,44 @@ private:
     
     // Frame update callback
     std::function<void()> frame_callback_;
+
+    // Delay of the frame on screen
+    uint32_t frame_delay_ms_;
+    lv_area_t dirty_area_;
+
+    // Frame cache
+    const void* source_;
+    size_t source_size_;
+    std::shared_ptr<GifFrameCache::Animation> cache_;
+    bool recording_;
+    size_t cache_index_;
+    int pass_;                  // Times the first frame has been decoded
+    uint32_t first_frame_pos_;  // Data offset after the first frame
     
     /**
      * Update to next frame
      */
     void NextFrame();
+
+    /**
+     * Decode the next frame into the canvas
+     */
+    void DecodeFrame();
+
+    /**
+     * Copy the next cached frame into the canvas
+     */
+    void PlayCachedFrame();
+
+    /**
+     * Store the decoded frame while the second loop plays
+     */
+    void RecordFrame();
+
+    /**
+     * Stop recording, keeping the frames if complete
+     */
+    void StopRecording(bool complete);
     
     /**
      * Cleanup resources
@@ -276,8 +276,7 @@ static uint8_t* convert_input_to_hw_encoder_buf(const uint8_t* src, uint16_t wid
 }
 
 static bool encode_with_hw_jpeg(const uint8_t* src, size_t src_len, uint16_t width, uint16_t height,
-                                v4l2_pix_fmt_t format, uint8_t quality, uint8_t** jpg_out, size_t* jpg_out_len,
-                                jpg_out_cb cb, void* cb_arg) {
+                                v4l2_pix_fmt_t format, uint8_t quality, uint8_t** jpg_out, size_t* jpg_out_len) {
     if (quality < 1)
         quality = 1;
     if (quality > 100)
@@ -325,31 +324,14 @@ static bool encode_with_hw_jpeg(const uint8_t* src, size_t src_len, uint16_t wid
         return false;
     }
 
-    if (cb) {
-        cb(cb_arg, 0, outbuf, (size_t)out_len);
-        cb(cb_arg, 1, NULL, 0);
-        free(outbuf);
-        if (jpg_out)
-            *jpg_out = NULL;
-        if (jpg_out_len)
-            *jpg_out_len = 0;
-        return true;
-    }
-
-    if (jpg_out && jpg_out_len) {
-        *jpg_out = outbuf;
-        *jpg_out_len = (size_t)out_len;
-        return true;
-    }
-
-    free(outbuf);
+    *jpg_out = outbuf;
+    *jpg_out_len = (size_t)out_len;
     return true;
 }
 #endif // CONFIG_XIAOZHI_ENABLE_HARDWARE_JPEG_ENCODER
 
 static bool encode_with_esp_new_jpeg(const uint8_t* src, size_t src_len, uint16_t width, uint16_t height,
-                                     v4l2_pix_fmt_t format, uint8_t quality, uint8_t** jpg_out, size_t* jpg_out_len,
-                                     jpg_out_cb cb, void* cb_arg) {
+                                     v4l2_pix_fmt_t format, uint8_t quality, uint8_t** jpg_out, size_t* jpg_out_len) {
     if (quality < 1)
         quality = 1;
     if (quality > 100)
@@ -403,25 +385,98 @@ static bool encode_with_esp_new_jpeg(const uint8_t* src, size_t src_len, uint16_
         return false;
     }
 
-    if (cb) {
-        cb(cb_arg, 0, outbuf, (size_t)out_len);
-        cb(cb_arg, 1, NULL, 0);  // 结束信号
-        free(outbuf);
-        if (jpg_out)
-            *jpg_out = NULL;
-        if (jpg_out_len)
-            *jpg_out_len = 0;
-        return true;
+    *jpg_out = outbuf;
+    *jpg_out_len = (size_t)out_len;
+    return true;
+}
+
+// 按编码器的块 (16 行) 逐块编码，每块的输出立即交给 cb，编码与发送重叠，输出缓冲只需一块大小
+// GRAY/YUYV 直接从 src 逐块复制，其他格式先整帧转换为 YCbYCr
+static bool encode_blocks_with_esp_new_jpeg(const uint8_t* src, uint16_t width, uint16_t height,
+                                            v4l2_pix_fmt_t format, uint8_t quality, jpg_out_cb cb, void* cb_arg) {
+    if (quality < 1)
+        quality = 1;
+    if (quality > 100)
+        quality = 100;
+
+    jpeg_pixel_format_t enc_src_type = JPEG_PIXEL_FORMAT_YCbYCr;
+    const uint8_t* rows = src;
+    uint8_t* enc_in = NULL;
+    if (format == V4L2_PIX_FMT_GREY) {
+        enc_src_type = JPEG_PIXEL_FORMAT_GRAY;
+    } else if (format != V4L2_PIX_FMT_YUYV) {
+        enc_in = convert_input_to_encoder_buf(src, width, height, format, &enc_src_type, NULL);
+        if (!enc_in) {
+            ESP_LOGE(TAG, "alloc/convert input failed");
+            return false;
+        }
+        rows = enc_in;
     }
 
-    if (jpg_out && jpg_out_len) {
-        *jpg_out = outbuf;
-        *jpg_out_len = (size_t)out_len;
-        return true;
+    jpeg_enc_config_t cfg = DEFAULT_JPEG_ENC_CONFIG();
+    cfg.width = width;
+    cfg.height = height;
+    cfg.src_type = enc_src_type;
+    cfg.subsampling = (enc_src_type == JPEG_PIXEL_FORMAT_GRAY) ? JPEG_SUBSAMPLE_GRAY : JPEG_SUBSAMPLE_420;
+    cfg.quality = quality;
+    cfg.rotate = JPEG_ROTATE_0D;
+    cfg.task_enable = false;
+
+    jpeg_enc_handle_t h = NULL;
+    jpeg_error_t ret = jpeg_enc_open(&cfg, &h);
+    if (ret != JPEG_ERR_OK) {
+        jpeg_free_align(enc_in);
+        ESP_LOGE(TAG, "jpeg_enc_open failed: %d", (int)ret);
+        return false;
     }
 
+    const int row_bytes = (int)width * (enc_src_type == JPEG_PIXEL_FORMAT_GRAY ? 1 : 2);
+    const int block_size = jpeg_enc_get_block_size(h);
+    if (block_size <= 0 || block_size % row_bytes != 0) {
+        ESP_LOGE(TAG, "unexpected block size %d for width %u", block_size, width);
+        jpeg_enc_close(h);
+        jpeg_free_align(enc_in);
+        return false;
+    }
+    const int lines = block_size / row_bytes;
+    const int out_cap = block_size + 1024;  // 头部与高质量块的余量
+
+    uint8_t* block = (uint8_t*)jpeg_calloc_align(block_size, 16);
+    uint8_t* outbuf = (uint8_t*)malloc_psram(out_cap);
+    bool ok = block && outbuf;
+    if (!ok) {
+        ESP_LOGE(TAG, "alloc block buffers failed");
+    }
+
+    size_t index = 0;
+    for (int y = 0; ok && y < height; y += lines) {
+        int n = height - y < lines ? height - y : lines;
+        memcpy(block, rows + (size_t)y * row_bytes, (size_t)n * row_bytes);
+        // 最后一块不足时重复最后一行，编码器按整块读取
+        for (int i = n; i < lines; i++) {
+            memcpy(block + i * row_bytes, block + (n - 1) * row_bytes, row_bytes);
+        }
+
+        int out_len = 0;
+        ret = jpeg_enc_process_with_block(h, block, block_size, outbuf, out_cap, &out_len);
+        if (ret < JPEG_ERR_OK) {
+            ESP_LOGE(TAG, "jpeg_enc_process_with_block failed: %d", (int)ret);
+            ok = false;
+            break;
+        }
+        if (out_len > 0 && cb(cb_arg, index++, outbuf, (size_t)out_len) != (size_t)out_len) {
+            ok = false;
+        }
+    }
+    if (ok) {
+        cb(cb_arg, index, NULL, 0);  // 结束信号
+    }
+
+    jpeg_enc_close(h);
     free(outbuf);
-    return true;
+    jpeg_free_align(block);
+    jpeg_free_align(enc_in);
+    return ok;
 }
 
 bool image_to_jpeg(uint8_t* src, size_t src_len, uint16_t width, uint16_t height, v4l2_pix_fmt_t format,
@@ -440,28 +495,330 @@ bool image_to_jpeg(uint8_t* src, size_t src_len, uint16_t width, uint16_t height
     }
 #endif // CONFIG_XIAOZHI_CAMERA_ALLOW_JPEG_INPUT
 #if CONFIG_XIAOZHI_ENABLE_HARDWARE_JPEG_ENCODER
-    if (encode_with_hw_jpeg(src, src_len, width, height, format, quality, out, out_len, NULL, NULL)) {
+    if (encode_with_hw_jpeg(src, src_len, width, height, format, quality, out, out_len)) {
         return true;
     }
     // Fallback to esp_new_jpeg
 #endif
-    return encode_with_esp_new_jpeg(src, src_len, width, height, format, quality, out, out_len, NULL, NULL);
+    return encode_with_esp_new_jpeg(src, src_len, width, height, format, quality, out, out_len);
 }
 
 bool image_to_jpeg_cb(uint8_t* src, size_t src_len, uint16_t width, uint16_t height, v4l2_pix_fmt_t format,
                       uint8_t quality, jpg_out_cb cb, void* arg) {
 #ifdef CONFIG_XIAOZHI_CAMERA_ALLOW_JPEG_INPUT
     if (format == V4L2_PIX_FMT_JPEG) {
-        cb(arg, 0, src, src_len);
+        if (cb(arg, 0, src, src_len) != src_len) {
+            return false;
+        }
         cb(arg, 1, nullptr, 0); // end signal
         return true;
     }
 #endif // CONFIG_XIAOZHI_CAMERA_ALLOW_JPEG_INPUT
 #if CONFIG_XIAOZHI_ENABLE_HARDWARE_JPEG_ENCODER
-    if (encode_with_hw_jpeg(src, src_len, width, height, format, quality, NULL, NULL, cb, arg)) {
-        return true;
+    // 硬件编码一次输出整张图，写入失败时不再回退到软件编码
+    uint8_t* jpg = NULL;
+    size_t jpg_len = 0;
+    if (encode_with_hw_jpeg(src, src_len, width, height, format, quality, &jpg, &jpg_len)) {
+        bool ok = cb(arg, 0, jpg, jpg_len) == jpg_len;
+        if (ok) {
+            cb(arg, 1, NULL, 0);
+        }
+        free(jpg);
+        return ok;
     }
     // Fallback to esp_new_jpeg
 #endif
-    return encode_with_esp_new_jpeg(src, src_len, width, height, format, quality, NULL, NULL, cb, arg);
+    return encode_blocks_with_esp_new_jpeg(src, width, height, format, quality, cb, arg);
+}
+
+bool image_to_jpeg_stream(uint16_t width, uint16_t height, v4l2_pix_fmt_t format, uint8_t quality,
+                          jpg_fill_cb fill, jpg_out_cb cb, void* arg) {
+    if (format != V4L2_PIX_FMT_RGB565 && format != V4L2_PIX_FMT_RGB565X) {
+        ESP_LOGE(TAG, "unsupported stream format: 0x%08lx", format);
+        return false;
+    }
+    if (quality < 1)
+        quality = 1;
+    if (quality > 100)
+        quality = 100;
+
+    jpeg_enc_config_t cfg = DEFAULT_JPEG_ENC_CONFIG();
+    cfg.width = width;
+    cfg.height = height;
+    cfg.src_type = JPEG_PIXEL_FORMAT_YCbYCr;
+    cfg.subsampling = JPEG_SUBSAMPLE_420;
+    cfg.quality = quality;
+    cfg.rotate = JPEG_ROTATE_0D;
+    cfg.task_enable = false;
+
+    jpeg_enc_handle_t h = NULL;
+    jpeg_error_t ret = jpeg_enc_open(&cfg, &h);
+    if (ret != JPEG_ERR_OK) {
+        ESP_LOGE(TAG, "jpeg_enc_open failed: %d", (int)ret);
+        return false;
+    }
+
+    // 块大小按 YCbYCr 计算，与同样行数的 RGB565 字节数相同
+    const int row_bytes = (int)width * 2;
+    const int block_size = jpeg_enc_get_block_size(h);
+    if (block_size <= 0 || block_size % row_bytes != 0) {
+        ESP_LOGE(TAG, "unexpected block size %d for width %u", block_size, width);
+        jpeg_enc_close(h);
+        return false;
+    }
+    const int lines = block_size / row_bytes;
+    const int out_cap = block_size + 1024;  // 头部与高质量块的余量
+
+    uint8_t* band = (uint8_t*)malloc_psram(block_size);
+    uint8_t* yuyv = (uint8_t*)jpeg_calloc_align(block_size, 16);
+    uint8_t* outbuf = (uint8_t*)malloc_psram(out_cap);
+    esp_imgfx_color_convert_cfg_t convert_cfg = {
+        .in_res = {.width = static_cast<int16_t>(width),
+                    .height = static_cast<int16_t>(lines)},
+        .in_pixel_fmt = format == V4L2_PIX_FMT_RGB565 ? ESP_IMGFX_PIXEL_FMT_RGB565_LE : ESP_IMGFX_PIXEL_FMT_RGB565_BE,
+        .out_pixel_fmt = ESP_IMGFX_PIXEL_FMT_YUYV,
+        .color_space_std = ESP_IMGFX_COLOR_SPACE_STD_BT601,
+    };
+    esp_imgfx_color_convert_handle_t convert_handle = nullptr;
+    bool ok = band && yuyv && outbuf &&
+              esp_imgfx_color_convert_open(&convert_cfg, &convert_handle) == ESP_IMGFX_ERR_OK && convert_handle;
+    if (!ok) {
+        ESP_LOGE(TAG, "alloc stream buffers failed");
+    }
+
+    size_t index = 0;
+    for (int y = 0; ok && y < height; y += lines) {
+        int n = height - y < lines ? height - y : lines;
+        if (!fill(arg, (uint16_t)y, (uint16_t)n, band)) {
+            ok = false;
+            break;
+        }
+        // 最后一块不足时重复最后一行，编码器按整块读取
+        for (int i = n; i < lines; i++) {
+            memcpy(band + i * row_bytes, band + (n - 1) * row_bytes, row_bytes);
+        }
+
+        esp_imgfx_data_t convert_input_data = {
+            .data = band,
+            .data_len = static_cast<uint32_t>(block_size),
+        };
+        esp_imgfx_data_t convert_output_data = {
+            .data = yuyv,
+            .data_len = static_cast<uint32_t>(block_size),
+        };
+        if (esp_imgfx_color_convert_process(convert_handle, &convert_input_data, &convert_output_data) != ESP_IMGFX_ERR_OK) {
+            ESP_LOGE(TAG, "esp_imgfx_color_convert_process failed");
+            ok = false;
+            break;
+        }
+
+        int out_len = 0;
+        ret = jpeg_enc_process_with_block(h, yuyv, block_size, outbuf, out_cap, &out_len);
+        if (ret < JPEG_ERR_OK) {
+            ESP_LOGE(TAG, "jpeg_enc_process_with_block failed: %d", (int)ret);
+            ok = false;
+            break;
+        }
+        if (out_len > 0 && cb(arg, index++, outbuf, (size_t)out_len) != (size_t)out_len) {
+            ok = false;
+        }
+    }
+    if (ok) {
+        cb(arg, index, NULL, 0);  // 结束信号
+    }
+
+    if (convert_handle) {
+        esp_imgfx_color_convert_close(convert_handle);
+    }
+    jpeg_enc_close(h);
+    free(outbuf);
+    jpeg_free_align(yuyv);
+    free(band);
+    return ok;
+}
+
+static int bytes_per_pixel(v4l2_pix_fmt_t format) {
+    switch (format) {
+        case V4L2_PIX_FMT_GREY:
+            return 1;
+        case V4L2_PIX_FMT_RGB24:
+            return 3;
+        case V4L2_PIX_FMT_RGB565:
+        case V4L2_PIX_FMT_RGB565X:
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_UYVY:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+// 计算 ROI 裁剪区域 (cx, cy, cw, ch) 和缩放后的内容尺寸 (dw, dh)，返回是否需要裁剪或缩放
+static bool crop_geometry(uint16_t width, uint16_t height, const image_to_jpeg_opts_t* opts,
+                          int* cx, int* cy, int* cw, int* ch, int* dw, int* dh) {
+    *cx = opts->crop_x < width ? opts->crop_x : 0;
+    *cy = opts->crop_y < height ? opts->crop_y : 0;
+    *cw = opts->crop_width ? opts->crop_width : width;
+    *ch = opts->crop_height ? opts->crop_height : height;
+    if (*cx + *cw > width)
+        *cw = width - *cx;
+    if (*cy + *ch > height)
+        *ch = height - *cy;
+    // YUV422 的 U/V 两个像素共用，起点必须是偶数
+    *cx &= ~1;
+
+    *dw = *cw;
+    *dh = *ch;
+    if (opts->max_width && *dw > opts->max_width) {
+        *dh = *dh * opts->max_width / *dw;
+        *dw = opts->max_width;
+    }
+    if (opts->max_height && *dh > opts->max_height) {
+        *dw = *dw * opts->max_height / *dh;
+        *dh = opts->max_height;
+    }
+    return *cx != 0 || *cy != 0 || *dw != width || *dh != height;
+}
+
+// 裁剪或缩放后的输出补齐到 16x16 MCU 的整数倍
+static inline int align_to_mcu(int v) {
+    return (v + 15) & ~15;
+}
+
+bool image_to_jpeg_output_size(uint16_t width, uint16_t height, const image_to_jpeg_opts_t* opts,
+                               uint16_t* out_w, uint16_t* out_h) {
+    int cx, cy, cw, ch, dw, dh;
+    if (!crop_geometry(width, height, opts, &cx, &cy, &cw, &ch, &dw, &dh)) {
+        // 不裁剪也不缩放时按原尺寸编码
+        *out_w = width;
+        *out_h = height;
+        return true;
+    }
+    *out_w = (uint16_t)align_to_mcu(dw > 0 ? dw : 0);
+    *out_h = (uint16_t)align_to_mcu(dh > 0 ? dh : 0);
+    return dw >= IMAGE_TO_JPEG_MIN_SIZE && dh >= IMAGE_TO_JPEG_MIN_SIZE;
+}
+
+// 按 ROI 裁剪并最近邻缩放，输出格式与输入相同，尺寸补齐到 16 的整数倍 (重复最后一行/列)
+// 不需要裁剪或缩放时 *out 为 NULL；格式不支持、区域太小或内存不足时返回 false
+static bool crop_and_scale(const uint8_t* src, uint16_t width, uint16_t height, v4l2_pix_fmt_t format,
+                           const image_to_jpeg_opts_t* opts, uint8_t** out, uint16_t* out_w, uint16_t* out_h,
+                           size_t* out_len) {
+    *out = NULL;
+    int cx, cy, cw, ch, dw, dh;
+    if (!crop_geometry(width, height, opts, &cx, &cy, &cw, &ch, &dw, &dh)) {
+        return true;
+    }
+    if (dw < IMAGE_TO_JPEG_MIN_SIZE || dh < IMAGE_TO_JPEG_MIN_SIZE) {
+        ESP_LOGE(TAG, "crop/scale result too small (%dx%d) for %ux%u", dw, dh, width, height);
+        return false;
+    }
+    int bpp = bytes_per_pixel(format);
+    if (bpp == 0) {
+        ESP_LOGE(TAG, "crop/scale not supported for format 0x%08lx", format);
+        return false;
+    }
+
+    const int aw = align_to_mcu(dw);
+    const int ah = align_to_mcu(dh);
+    size_t sz = (size_t)aw * ah * bpp;
+    uint8_t* buf = (uint8_t*)malloc_psram(sz);
+    if (!buf) {
+        ESP_LOGE(TAG, "alloc crop/scale buffer failed");
+        return false;
+    }
+
+    const bool is_yuyv = format == V4L2_PIX_FMT_YUYV;
+    const bool is_uyvy = format == V4L2_PIX_FMT_UYVY;
+    uint8_t* d = buf;
+    for (int y = 0; y < ah; y++) {
+        int sy = y < dh ? y : dh - 1;
+        const uint8_t* row = src + (size_t)(cy + sy * ch / dh) * width * bpp;
+        if (is_yuyv || is_uyvy) {
+            // 逐对输出像素：Y 各自采样，U/V 取第一个像素所在的宏像素
+            const int y_off = is_yuyv ? 0 : 1;
+            const int u_off = is_yuyv ? 1 : 0;
+            const int v_off = is_yuyv ? 3 : 2;
+            for (int x = 0; x < aw; x += 2) {
+                int sx0 = cx + (x < dw ? x : dw - 1) * cw / dw;
+                int sx1 = cx + (x + 1 < dw ? x + 1 : dw - 1) * cw / dw;
+                const uint8_t* mp = row + (sx0 & ~1) * 2;
+                d[y_off] = row[sx0 * 2 + y_off];
+                d[u_off] = mp[u_off];
+                d[y_off + 2] = row[sx1 * 2 + y_off];
+                d[v_off] = mp[v_off];
+                d += 4;
+            }
+        } else if (dw == cw && aw == dw) {
+            memcpy(d, row + cx * bpp, (size_t)dw * bpp);
+            d += dw * bpp;
+        } else {
+            for (int x = 0; x < aw; x++) {
+                const uint8_t* s = row + (cx + (x < dw ? x : dw - 1) * cw / dw) * bpp;
+                for (int b = 0; b < bpp; b++) {
+                    *d++ = s[b];
+                }
+            }
+        }
+    }
+
+    ESP_LOGD(TAG, "crop (%d,%d %dx%d) scale to %dx%d, padded to %dx%d", cx, cy, cw, ch, dw, dh, aw, ah);
+    *out = buf;
+    *out_w = (uint16_t)aw;
+    *out_h = (uint16_t)ah;
+    *out_len = sz;
+    return true;
+}
+
+bool image_to_jpeg_cb_ex(uint8_t* src, size_t src_len, uint16_t width, uint16_t height, v4l2_pix_fmt_t format,
+                         const image_to_jpeg_opts_t* opts, jpg_out_cb cb, void* arg) {
+    uint16_t w = width, h = height;
+    size_t len = src_len;
+    uint8_t* scaled = NULL;
+    if (!crop_and_scale(src, width, height, format, opts, &scaled, &w, &h, &len)) {
+        return false;
+    }
+    uint8_t* input = scaled ? scaled : src;
+    int quality = opts->quality ? opts->quality : 80;
+
+    bool ok = false;
+    if (opts->target_bytes == 0) {
+        ok = image_to_jpeg_cb(input, len, w, h, format, quality, cb, arg);
+    } else {
+        // 质量与输出大小近似成正比，超出预算时按比例降低质量重新编码
+        const int min_quality = 20;
+        uint8_t* jpg = NULL;
+        size_t jpg_len = 0;
+        for (int attempt = 0; attempt < 4; attempt++) {
+            if (!image_to_jpeg(input, len, w, h, format, quality, &jpg, &jpg_len)) {
+                break;
+            }
+            if (jpg_len <= opts->target_bytes || quality <= min_quality || attempt == 3) {
+                break;
+            }
+            int next = (int)((uint64_t)quality * opts->target_bytes * 9 / ((uint64_t)jpg_len * 10));
+            if (next > quality - 5)
+                next = quality - 5;
+            if (next < min_quality)
+                next = min_quality;
+            ESP_LOGD(TAG, "jpeg %u bytes over budget %u at quality %d, retry with %d",
+                     (unsigned)jpg_len, (unsigned)opts->target_bytes, quality, next);
+            free(jpg);
+            jpg = NULL;
+            quality = next;
+        }
+        if (jpg) {
+            ok = cb(arg, 0, jpg, jpg_len) == jpg_len;
+            if (ok) {
+                cb(arg, 1, NULL, 0);
+            }
+            free(jpg);
+        }
+        ESP_LOGI(TAG, "jpeg %ux%u quality=%d size=%u budget=%u", w, h, quality, (unsigned)jpg_len, (unsigned)opts->target_bytes);
+    }
+
+    if (scaled) {
+        free(scaled);
+    }
+    return ok;
 }
@@ -48,6 +48,8 @@ bool image_to_jpeg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height
  * - 节省约8KB的SRAM使用（静态变量改为堆分配）
  * - 支持流式输出，无需预分配大缓冲区
  * - 通过回调函数逐块处理JPEG数据
+ * - 软件编码每 16 行输出一次，硬件编码一次输出整张图
+ * - 回调返回值小于 len 时中止编码并返回 false
  * 
  * @param src       源图像数据
  * @param src_len   源图像数据长度
@@ -63,6 +65,85 @@ bool image_to_jpeg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height
 bool image_to_jpeg_cb(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, 
                       v4l2_pix_fmt_t format, uint8_t quality, jpg_out_cb cb, void *arg);
 
+/**
+ * @brief 编码前的预处理与码率控制选项
+ *
+ * - crop_*: 感兴趣区域 (ROI)，crop_width/crop_height 为 0 表示整帧
+ * - max_width/max_height: 编码前缩小到不超过该尺寸 (保持宽高比)，0 表示不限制
+ * - target_bytes: 输出字节预算，非 0 时自动降低质量直到满足预算
+ *
+ * 全部为 0 (除 quality 外) 时与 image_to_jpeg_cb() 相同，原图直接编码。
+ */
+typedef struct {
+    uint16_t crop_x;
+    uint16_t crop_y;
+    uint16_t crop_width;
+    uint16_t crop_height;
+    uint16_t max_width;
+    uint16_t max_height;
+    uint8_t quality;
+    size_t target_bytes;
+} image_to_jpeg_opts_t;
+
+// 裁剪缩放后的内容小于该尺寸时不编码
+#define IMAGE_TO_JPEG_MIN_SIZE 16
+
+/**
+ * @brief 计算按 opts 裁剪并缩放后的输出尺寸
+ *
+ * 不裁剪也不缩放时为原尺寸。否则输出补齐到 16 的整数倍 (重复最后一行/列)，
+ * 内容不足 IMAGE_TO_JPEG_MIN_SIZE 时返回 false，image_to_jpeg_cb_ex() 也会失败而不是回退到整帧。
+ *
+ * @return true 尺寸有效, false ROI 太小
+ */
+bool image_to_jpeg_output_size(uint16_t width, uint16_t height, const image_to_jpeg_opts_t *opts,
+                               uint16_t *out_w, uint16_t *out_h);
+
+/**
+ * @brief 带裁剪、缩放和自适应质量的 JPEG 编码（回调版本）
+ *
+ * 先按 ROI 裁剪并缩放到目标尺寸，再编码 (ESP32-P4 上优先使用硬件编码器)。
+ * 设置了 target_bytes 时，输出超出预算会降低质量重新编码，最多尝试 4 次。
+ *
+ * @param src       源图像数据
+ * @param src_len   源图像数据长度
+ * @param width     图像宽度
+ * @param height    图像高度
+ * @param format    图像格式
+ * @param opts      预处理与码率控制选项
+ * @param cb        输出回调函数
+ * @param arg       传递给回调函数的用户参数
+ *
+ * @return true 成功, false 失败
+ */
+bool image_to_jpeg_cb_ex(uint8_t *src, size_t src_len, uint16_t width, uint16_t height,
+                         v4l2_pix_fmt_t format, const image_to_jpeg_opts_t *opts, jpg_out_cb cb, void *arg);
+
+// 分块输入回调函数类型
+// arg: 用户自定义参数, y: 起始行, lines: 行数, buf: 写入 lines 行像素 (每行 width * 2 字节)
+// 返回: false 中止编码
+typedef bool (*jpg_fill_cb)(void *arg, uint16_t y, uint16_t lines, uint8_t *buf);
+
+/**
+ * @brief 分块读取 RGB565 图像并流式编码为 JPEG
+ *
+ * 每次只向 fill 索取编码器一个块 (一个 MCU 行，通常 16 行) 的像素，编码结果逐块交给 cb，
+ * 内存占用只有几个块大小，不需要整帧源图像和整张 JPEG 的缓冲区。
+ * 使用 esp_new_jpeg 软件编码 (硬件编码器需要整帧输入)。
+ *
+ * @param width     图像宽度
+ * @param height    图像高度
+ * @param format    V4L2_PIX_FMT_RGB565 或 V4L2_PIX_FMT_RGB565X
+ * @param quality   JPEG质量 (1-100)
+ * @param fill      输入回调函数
+ * @param cb        输出回调函数，返回值小于 len 时中止编码
+ * @param arg       传递给两个回调函数的用户参数
+ *
+ * @return true 成功, false 失败
+ */
+bool image_to_jpeg_stream(uint16_t width, uint16_t height, v4l2_pix_fmt_t format, uint8_t quality,
+                          jpg_fill_cb fill, jpg_out_cb cb, void *arg);
+
 #ifdef __cplusplus
 }
 #endif
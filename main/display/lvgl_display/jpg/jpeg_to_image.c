@@ -2,6 +2,7 @@
 #include <esp_err.h>
 #include <esp_heap_caps.h>
 #include <sys/param.h>
+#include <string.h>
 
 #include "esp_jpeg_common.h"
 #include "esp_jpeg_dec.h"
@@ -20,8 +21,21 @@
 
 #define TAG "jpeg_to_image"
 
-static esp_err_t decode_with_new_jpeg(const uint8_t* src, size_t src_len, uint8_t** out, size_t* out_len, size_t* width,
-                                      size_t* height, size_t* stride) {
+// Largest power of two reduction, up to 1/8, that still covers max_width x max_height when fitted
+static int pick_scale_shift(size_t width, size_t height, size_t max_width, size_t max_height) {
+    int shift = 0;
+    if (max_width == 0 || max_height == 0) {
+        return 0;
+    }
+    while (shift < 3 && (width >> (shift + 1)) >= 8 && (height >> (shift + 1)) >= 8 &&
+           ((width >> (shift + 1)) >= max_width || (height >> (shift + 1)) >= max_height)) {
+        shift++;
+    }
+    return shift;
+}
+
+static esp_err_t decode_with_new_jpeg(const uint8_t* src, size_t src_len, size_t max_width, size_t max_height,
+                                      uint8_t** out, size_t* out_len, size_t* width, size_t* height, size_t* stride) {
     ESP_LOGD(TAG, "Decoding JPEG with software decoder");
     esp_err_t ret = ESP_OK;
     jpeg_error_t jpeg_ret = JPEG_ERR_OK;
@@ -53,6 +67,34 @@ static esp_err_t decode_with_new_jpeg(const uint8_t* src, size_t src_len, uint8_
 
     ESP_LOGD(TAG, "JPEG header info: width=%d, height=%d", out_info.width, out_info.height);
 
+    int shift = pick_scale_shift(out_info.width, out_info.height, max_width, max_height);
+    if (shift > 0) {
+        // Scale down in the IDCT, the scaled size must be a multiple of 8, so reopen with the new config
+        config.scale.width = (out_info.width >> shift) & ~7;
+        config.scale.height = (out_info.height >> shift) & ~7;
+        jpeg_dec_close(jpeg_dec);
+        jpeg_dec = NULL;
+        jpeg_ret = jpeg_dec_open(&config, &jpeg_dec);
+        if (jpeg_ret != JPEG_ERR_OK) {
+            ESP_LOGE(TAG, "Failed to open JPEG decoder with scale 1/%d", 1 << shift);
+            ret = ESP_FAIL;
+            goto jpeg_dec_failed;
+        }
+        memset(&jpeg_io, 0, sizeof(jpeg_io));
+        jpeg_io.inbuf = (uint8_t*)src;
+        jpeg_io.inbuf_len = (int)src_len;
+        jpeg_ret = jpeg_dec_parse_header(jpeg_dec, &jpeg_io, &out_info);
+        if (jpeg_ret != JPEG_ERR_OK) {
+            ESP_LOGE(TAG, "Failed to parse JPEG header");
+            ret = ESP_ERR_INVALID_ARG;
+            goto jpeg_dec_failed;
+        }
+        ESP_LOGD(TAG, "Scaling %dx%d JPEG to %dx%d", out_info.width, out_info.height, config.scale.width,
+                 config.scale.height);
+        out_info.width = config.scale.width;
+        out_info.height = config.scale.height;
+    }
+
     out_buf = jpeg_calloc_align(out_info.width * out_info.height * 2, 16);
     if (out_buf == NULL) {
         ESP_LOGE(TAG, "Failed to allocate memory for JPEG output buffer");
@@ -100,8 +142,42 @@ jpeg_dec_failed:
 }
 
 #ifdef CONFIG_XIAOZHI_ENABLE_HARDWARE_JPEG_DECODER
-static esp_err_t decode_with_hardware_jpeg(const uint8_t* src, size_t src_len, uint8_t** out, size_t* out_len,
-                                           size_t* width, size_t* height, size_t* stride) {
+// The hardware decoder has no scaler, average 2^shift x 2^shift blocks of its RGB565 output instead
+static uint8_t* downsample_rgb565(const uint8_t* src, size_t src_stride, size_t width, size_t height, int shift) {
+    size_t out_width = width >> shift;
+    size_t out_height = height >> shift;
+#if CONFIG_SPIRAM
+    uint16_t* out = (uint16_t*)heap_caps_malloc(out_width * out_height * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+    uint16_t* out = (uint16_t*)heap_caps_malloc(out_width * out_height * 2, MALLOC_CAP_8BIT);
+#endif
+    if (out == NULL) {
+        return NULL;
+    }
+
+    int block = 1 << shift;
+    int area_shift = shift * 2;
+    for (size_t y = 0; y < out_height; y++) {
+        for (size_t x = 0; x < out_width; x++) {
+            uint32_t r = 0, g = 0, b = 0;
+            for (int dy = 0; dy < block; dy++) {
+                const uint16_t* row = (const uint16_t*)(src + ((y << shift) + dy) * src_stride) + (x << shift);
+                for (int dx = 0; dx < block; dx++) {
+                    uint16_t pixel = row[dx];
+                    r += pixel >> 11;
+                    g += (pixel >> 5) & 0x3F;
+                    b += pixel & 0x1F;
+                }
+            }
+            out[y * out_width + x] = ((r >> area_shift) << 11) | ((g >> area_shift) << 5) | (b >> area_shift);
+        }
+    }
+    return (uint8_t*)out;
+}
+
+static esp_err_t decode_with_hardware_jpeg(const uint8_t* src, size_t src_len, size_t max_width, size_t max_height,
+                                           uint8_t** out, size_t* out_len, size_t* width, size_t* height,
+                                           size_t* stride) {
     ESP_LOGD(TAG, "Decoding JPEG with hardware decoder");
     esp_err_t ret = ESP_OK;
 
@@ -206,6 +282,22 @@ static esp_err_t decode_with_hardware_jpeg(const uint8_t* src, size_t src_len, u
         ESP_LOGD(TAG, "Converted GRAY8 to RGB565, new size: %zu", out_size);
     }
 
+    int shift = pick_scale_shift(header_info.width, header_info.height, max_width, max_height);
+    if (shift > 0) {
+        uint8_t* scaled = downsample_rgb565(out_buf, *stride, header_info.width, header_info.height, shift);
+        if (scaled == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for scaled JPEG output");
+            ret = ESP_ERR_NO_MEM;
+            goto jpeg_hw_dec_failed;
+        }
+        heap_caps_free(out_buf);
+        out_buf = scaled;
+        header_info.width >>= shift;
+        header_info.height >>= shift;
+        *stride = header_info.width * 2;
+        out_size = header_info.width * header_info.height * 2;
+    }
+
     ESP_LOG_BUFFER_HEXDUMP(TAG, out_buf, MIN(out_size, 256), ESP_LOG_DEBUG);
 
     *out = out_buf;
@@ -244,6 +336,11 @@ jpeg_hw_dec_failed:
 
 esp_err_t jpeg_to_image(const uint8_t* src, size_t src_len, uint8_t** out, size_t* out_len, size_t* width,
                         size_t* height, size_t* stride) {
+    return jpeg_to_image_scaled(src, src_len, 0, 0, out, out_len, width, height, stride);
+}
+
+esp_err_t jpeg_to_image_scaled(const uint8_t* src, size_t src_len, size_t max_width, size_t max_height, uint8_t** out,
+                               size_t* out_len, size_t* width, size_t* height, size_t* stride) {
 #ifdef CONFIG_XIAOZHI_ENABLE_CAMERA_DEBUG_MODE
     esp_log_level_set(TAG, ESP_LOG_DEBUG);
 #endif  // CONFIG_XIAOZHI_ENABLE_CAMERA_DEBUG_MODE
@@ -253,12 +350,12 @@ esp_err_t jpeg_to_image(const uint8_t* src, size_t src_len, uint8_t** out, size_
         return ESP_ERR_INVALID_ARG;
     }
 #ifdef CONFIG_XIAOZHI_ENABLE_HARDWARE_JPEG_DECODER
-    esp_err_t ret = decode_with_hardware_jpeg(src, src_len, out, out_len, width, height, stride);
+    esp_err_t ret = decode_with_hardware_jpeg(src, src_len, max_width, max_height, out, out_len, width, height, stride);
     if (ret == ESP_OK) {
         return ret;
     }
     ESP_LOGW(TAG, "Failed to decode with hardware JPEG, fallback to software decoder");
     // Fallback to esp_new_jpeg
 #endif
-    return decode_with_new_jpeg(src, src_len, out, out_len, width, height, stride);
+    return decode_with_new_jpeg(src, src_len, max_width, max_height, out, out_len, width, height, stride);
 }
@@ -55,6 +55,22 @@ extern "C" {
 esp_err_t jpeg_to_image(const uint8_t* src, size_t src_len, uint8_t** out, size_t* out_len, size_t* width,
                         size_t* height, size_t* stride);
 
+/**
+ * @brief Decodes a JPEG image to RGB565, scaled down by 1/2, 1/4 or 1/8 to about the given size
+ *
+ * The largest reduction that still covers max_width x max_height (when fitted, keeping the aspect
+ * ratio) is used, so large photos never need a full resolution buffer with the software decoder.
+ * The software decoder scales in the IDCT, its output size is rounded down to a multiple of 8.
+ * The hardware decoder has no scaler, its full size output is averaged down and freed.
+ *
+ * @param[in] max_width Target width in pixels, 0 to decode at full size
+ * @param[in] max_height Target height in pixels, 0 to decode at full size
+ *
+ * Other parameters, the return value and the ownership of `*out` are the same as jpeg_to_image().
+ */
+esp_err_t jpeg_to_image_scaled(const uint8_t* src, size_t src_len, size_t max_width, size_t max_height, uint8_t** out,
+                               size_t* out_len, size_t* width, size_t* height, size_t* stride);
+
 #ifdef __cplusplus
 }
 #endif
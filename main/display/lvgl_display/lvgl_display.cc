@@ -13,16 +13,42 @@
 #include "assets/lang_config.h"
 #include "jpg/image_to_jpeg.h"
 
+#if CONFIG_LV_USE_SNAPSHOT
+#include <lvgl_private.h>
+#endif
+
 #define TAG "Display"
 
+// Every lv_label_set_text() relayouts and redraws the label, even if the text is the same
+static void SetLabelText(lv_obj_t* label, const char* text) {
+    const char* current = lv_label_get_text(label);
+    if (current == nullptr || strcmp(current, text) != 0) {
+        lv_label_set_text(label, text);
+    }
+}
+
+// Showing a visible object invalidates it again
+static void SetHidden(lv_obj_t* obj, bool hidden) {
+    if (lv_obj_has_flag(obj, LV_OBJ_FLAG_HIDDEN) != hidden) {
+        if (hidden) {
+            lv_obj_add_flag(obj, LV_OBJ_FLAG_HIDDEN);
+        } else {
+            lv_obj_remove_flag(obj, LV_OBJ_FLAG_HIDDEN);
+        }
+    }
+}
+
+// Interval of the render statistics log
+#define RENDER_STATS_INTERVAL_US (30 * 1000 * 1000)
+
 LvglDisplay::LvglDisplay() {
     // Notification timer
     esp_timer_create_args_t notification_timer_args = {
         .callback = [](void *arg) {
             LvglDisplay *display = static_cast<LvglDisplay*>(arg);
             DisplayLockGuard lock(display);
-            lv_obj_add_flag(display->notification_label_, LV_OBJ_FLAG_HIDDEN);
-            lv_obj_remove_flag(display->status_label_, LV_OBJ_FLAG_HIDDEN);
+            SetHidden(display->notification_label_, true);
+            SetHidden(display->status_label_, false);
         },
         .arg = this,
         .dispatch_method = ESP_TIMER_TASK,
@@ -74,9 +100,9 @@ void LvglDisplay::SetStatus(const char* status) {
     if (status_label_ == nullptr) {
         return;
     }
-    lv_label_set_text(status_label_, status);
-    lv_obj_remove_flag(status_label_, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(notification_label_, LV_OBJ_FLAG_HIDDEN);
+    SetLabelText(status_label_, status);
+    SetHidden(status_label_, false);
+    SetHidden(notification_label_, true);
 
     last_status_update_time_ = std::chrono::system_clock::now();
 }
@@ -90,9 +116,9 @@ void LvglDisplay::ShowNotification(const char* notification, int duration_ms) {
     if (notification_label_ == nullptr) {
         return;
     }
-    lv_label_set_text(notification_label_, notification);
-    lv_obj_remove_flag(notification_label_, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(status_label_, LV_OBJ_FLAG_HIDDEN);
+    SetLabelText(notification_label_, notification);
+    SetHidden(notification_label_, false);
+    SetHidden(status_label_, true);
 
     esp_timer_stop(notification_timer_);
     ESP_ERROR_CHECK(esp_timer_start_once(notification_timer_, duration_ms * 1000));
@@ -102,49 +128,34 @@ void LvglDisplay::UpdateStatusBar(bool update_all) {
     auto& app = Application::GetInstance();
     auto& board = Board::GetInstance();
     auto codec = board.GetAudioCodec();
-
-    // Update mute icon
-    {
-        DisplayLockGuard lock(this);
-        if (mute_label_ == nullptr) {
-            return;
-        }
-
-        // Update icon if mute state changes
-        if (codec->output_volume() == 0 && !muted_) {
-            muted_ = true;
-            lv_label_set_text(mute_label_, FONT_AWESOME_VOLUME_XMARK);
-        } else if (codec->output_volume() > 0 && muted_) {
-            muted_ = false;
-            lv_label_set_text(mute_label_, "");
-        }
+    auto device_state = app.GetDeviceState();
+    if (mute_label_ == nullptr) {
+        return;
     }
 
-    // Update time
-    if (app.GetDeviceState() == kDeviceStateIdle) {
-        if (last_status_update_time_ + std::chrono::seconds(10) < std::chrono::system_clock::now()) {
-            // Set status to clock "HH:MM"
-            time_t now = time(NULL);
-            struct tm* tm = localtime(&now);
-            // Check if the we have already set the time
-            if (tm->tm_year >= 2025 - 1900) {
-                char time_str[16];
-                strftime(time_str, sizeof(time_str), "%H:%M", tm);
-                SetStatus(time_str);
-            } else {
-                ESP_LOGW(TAG, "System time is not set, tm_year: %d", tm->tm_year);
-            }
+    // Read every value first, then apply only the changes in one locked update
+    esp_pm_lock_acquire(pm_lock_);
+    bool muted = codec->output_volume() == 0;
+
+    char time_str[16] = "";
+    if (device_state == kDeviceStateIdle && last_status_update_time_ + std::chrono::seconds(10) < std::chrono::system_clock::now()) {
+        // Set status to clock "HH:MM"
+        time_t now = time(NULL);
+        struct tm* tm = localtime(&now);
+        // Check if the we have already set the time
+        if (tm->tm_year >= 2025 - 1900) {
+            strftime(time_str, sizeof(time_str), "%H:%M", tm);
+        } else {
+            ESP_LOGW(TAG, "System time is not set, tm_year: %d", tm->tm_year);
         }
     }
 
-    esp_pm_lock_acquire(pm_lock_);
-    // Update battery icon
     int battery_level;
     bool charging, discharging;
-    const char* icon = nullptr;
+    const char* battery_icon = nullptr;
     if (board.GetBatteryLevel(battery_level, charging, discharging)) {
         if (charging) {
-            icon = FONT_AWESOME_BATTERY_BOLT;
+            battery_icon = FONT_AWESOME_BATTERY_BOLT;
         } else {
             const char* levels[] = {
                 FONT_AWESOME_BATTERY_EMPTY, // 0-19%
@@ -154,34 +165,15 @@ void LvglDisplay::UpdateStatusBar(bool update_all) {
                 FONT_AWESOME_BATTERY_FULL, // 80-99%
                 FONT_AWESOME_BATTERY_FULL, // 100%
             };
-            icon = levels[battery_level / 20];
-        }
-        DisplayLockGuard lock(this);
-        if (battery_label_ != nullptr && battery_icon_ != icon) {
-            battery_icon_ = icon;
-            lv_label_set_text(battery_label_, battery_icon_);
-        }
-
-        if (low_battery_popup_ != nullptr) {
-            if (strcmp(icon, FONT_AWESOME_BATTERY_EMPTY) == 0 && discharging) {
-                if (lv_obj_has_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN)) { // Show if low battery popup is hidden
-                    lv_obj_remove_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
-                    app.PlaySound(Lang::Sounds::OGG_LOW_BATTERY);
-                }
-            } else {
-                // Hide the low battery popup when the battery is not empty
-                if (!lv_obj_has_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN)) { // Hide if low battery popup is shown
-                    lv_obj_add_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
-                }
-            }
+            battery_icon = levels[battery_level / 20];
         }
     }
 
     // Update network icon every 10 seconds
+    const char* network_icon = nullptr;
     static int seconds_counter = 0;
     if (update_all || seconds_counter++ % 10 == 0) {
         // Don't read 4G network status during firmware upgrade to avoid occupying UART resources
-        auto device_state = Application::GetInstance().GetDeviceState();
         static const std::vector<DeviceState> allowed_states = {
             kDeviceStateIdle,
             kDeviceStateStarting,
@@ -190,16 +182,45 @@ void LvglDisplay::UpdateStatusBar(bool update_all) {
             kDeviceStateActivating,
         };
         if (std::find(allowed_states.begin(), allowed_states.end(), device_state) != allowed_states.end()) {
-            icon = board.GetNetworkStateIcon();
-            if (network_label_ != nullptr && icon != nullptr && network_icon_ != icon) {
-                DisplayLockGuard lock(this);
-                network_icon_ = icon;
-                lv_label_set_text(network_label_, network_icon_);
+            network_icon = board.GetNetworkStateIcon();
+        }
+    }
+    esp_pm_lock_release(pm_lock_);
+
+    bool low_battery_shown = false;
+    {
+        DisplayLockGuard lock(this);
+        if (muted != muted_) {
+            muted_ = muted;
+            lv_label_set_text(mute_label_, muted_ ? FONT_AWESOME_VOLUME_XMARK : "");
+        }
+
+        if (time_str[0] != '\0') {
+            SetStatus(time_str);
+        }
+
+        if (battery_icon != nullptr) {
+            if (battery_label_ != nullptr && battery_icon_ != battery_icon) {
+                battery_icon_ = battery_icon;
+                lv_label_set_text(battery_label_, battery_icon_);
+            }
+
+            if (low_battery_popup_ != nullptr) {
+                bool low_battery = strcmp(battery_icon, FONT_AWESOME_BATTERY_EMPTY) == 0 && discharging;
+                low_battery_shown = low_battery && lv_obj_has_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
+                SetHidden(low_battery_popup_, !low_battery);
             }
         }
+
+        if (network_label_ != nullptr && network_icon != nullptr && network_icon_ != network_icon) {
+            network_icon_ = network_icon;
+            lv_label_set_text(network_label_, network_icon_);
+        }
     }
 
-    esp_pm_lock_release(pm_lock_);
+    if (low_battery_shown) {
+        app.PlaySound(Lang::Sounds::OGG_LOW_BATTERY);
+    }
 }
 
 void LvglDisplay::SetPreviewImage(std::unique_ptr<LvglImage> image) {
@@ -215,44 +236,178 @@ void LvglDisplay::SetPowerSaveMode(bool on) {
     }
 }
 
-bool LvglDisplay::SnapshotToJpeg(std::string& jpeg_data, int quality) {
 #if CONFIG_LV_USE_SNAPSHOT
+// Same as lv_snapshot_take_to_draw_buf(), but only renders the part of obj inside area
+static void RenderArea(lv_obj_t* obj, lv_draw_buf_t* draw_buf, const lv_area_t& area) {
+    lv_draw_buf_clear(draw_buf, nullptr);
+
+    lv_layer_t layer;
+    lv_memzero(&layer, sizeof(layer));
+    layer.draw_buf = draw_buf;
+    layer.buf_area = area;
+    layer.color_format = draw_buf->header.cf;
+    layer._clip_area = area;
+    layer.phy_clip_area = area;
+#if LV_DRAW_TRANSFORM_USE_MATRIX
+    lv_matrix_identity(&layer.matrix);
+#endif
+
+    lv_display_t* disp_old = lv_refr_get_disp_refreshing();
+    lv_display_t* disp = lv_obj_get_display(obj);
+    lv_layer_t* layer_old = disp->layer_head;
+    disp->layer_head = &layer;
+    lv_refr_set_disp_refreshing(disp);
+    lv_obj_redraw(&layer, obj);
+    while (layer.draw_task_head) {
+        lv_draw_dispatch_wait_for_request();
+        lv_draw_dispatch();
+    }
+    disp->layer_head = layer_old;
+    lv_refr_set_disp_refreshing(disp_old);
+}
+#endif
+
+void LvglDisplay::SetFrameRateLimit(int fps) {
     DisplayLockGuard lock(this);
+    if (display_ == nullptr || fps <= 0 || fps == frame_rate_limit_) {
+        return;
+    }
 
-    lv_obj_t* screen = lv_screen_active();
-    lv_draw_buf_t* draw_buffer = lv_snapshot_take(screen, LV_COLOR_FORMAT_RGB565);
-    if (draw_buffer == nullptr) {
-        ESP_LOGE(TAG, "Failed to take snapshot, draw_buffer is nullptr");
-        return false;
+    // display_ is created by the subclasses, so the monitor is attached on first use
+    if (!render_stats_.monitored) {
+        render_stats_.monitored = true;
+        render_stats_.report_start_us = esp_timer_get_time();
+        lv_display_add_event_cb(display_, OnRenderEvent, LV_EVENT_ALL, this);
     }
 
-    // swap bytes
-    uint16_t* data = (uint16_t*)draw_buffer->data;
-    size_t pixel_count = draw_buffer->data_size / 2;
-    for (size_t i = 0; i < pixel_count; i++) {
-        data[i] = __builtin_bswap16(data[i]);
+    // LVGL merges all areas invalidated between two runs of the refresh timer into one frame
+    frame_rate_limit_ = fps;
+    lv_timer_set_period(lv_display_get_refr_timer(display_), 1000 / fps);
+    ESP_LOGI(TAG, "Frame rate limit: %d fps", fps);
+}
+
+void LvglDisplay::OnRenderEvent(lv_event_t* e) {
+    auto display = static_cast<LvglDisplay*>(lv_event_get_user_data(e));
+    auto& stats = display->render_stats_;
+    int64_t now = esp_timer_get_time();
+
+    switch (lv_event_get_code(e)) {
+    case LV_EVENT_REFR_START:
+        stats.refresh_start_us = now;
+        stats.frame_flush_us = 0;
+        stats.rendered = false;
+        break;
+    case LV_EVENT_RENDER_START:
+        stats.rendered = true;
+        break;
+    case LV_EVENT_FLUSH_START:
+    case LV_EVENT_FLUSH_WAIT_START:
+        stats.flush_start_us = now;
+        break;
+    case LV_EVENT_FLUSH_FINISH:
+    case LV_EVENT_FLUSH_WAIT_FINISH:
+        stats.frame_flush_us += now - stats.flush_start_us;
+        break;
+    case LV_EVENT_REFR_READY: {
+        if (!stats.rendered) {
+            break;
+        }
+        int64_t frame_us = now - stats.refresh_start_us;
+        ESP_LOGD(TAG, "Frame: render %d us, flush %d us", int(frame_us - stats.frame_flush_us), int(stats.frame_flush_us));
+        stats.frames++;
+        stats.render_us += frame_us - stats.frame_flush_us;
+        stats.flush_us += stats.frame_flush_us;
+        if (frame_us > stats.max_frame_us) {
+            stats.max_frame_us = frame_us;
+        }
+
+        if (now - stats.report_start_us >= RENDER_STATS_INTERVAL_US) {
+            ESP_LOGI(TAG, "%lu frames in %d s (limit %d fps), avg render %d us, avg flush %d us, max frame %d us",
+                stats.frames, int((now - stats.report_start_us) / 1000000), display->frame_rate_limit_,
+                int(stats.render_us / stats.frames), int(stats.flush_us / stats.frames), int(stats.max_frame_us));
+            stats.report_start_us = now;
+            stats.frames = 0;
+            stats.render_us = 0;
+            stats.flush_us = 0;
+            stats.max_frame_us = 0;
+        }
+        break;
+    }
+    default:
+        break;
     }
+}
 
-    // Clear output string and use callback version to avoid pre-allocating large memory blocks
+bool LvglDisplay::SnapshotToJpeg(std::string& jpeg_data, int quality) {
+#if CONFIG_LV_USE_SNAPSHOT
     jpeg_data.clear();
+    struct Context {
+        LvglDisplay* display;
+        std::string& jpeg_data;
+        int32_t width;
+    } context = { this, jpeg_data, 0 };
+    int32_t height;
+    {
+        DisplayLockGuard lock(this);
+        lv_obj_t* screen = lv_screen_active();
+        context.width = lv_obj_get_width(screen);
+        height = lv_obj_get_height(screen);
+        // Freeze animations, scrolling and GIF frames, so all bands show the same frame.
+        // Counted, so a concurrent snapshot does not resume the timers under this one
+        if (snapshot_pauses_++ == 0) {
+            lv_timer_enable(false);
+        }
+    }
+
+    // The display is only locked while a band is rendered, so other tasks are not blocked during
+    // encoding. A widget they change meanwhile may show up in the later bands only.
+    bool ret = image_to_jpeg_stream(context.width, height, V4L2_PIX_FMT_RGB565X, quality,
+        [](void* arg, uint16_t y, uint16_t lines, uint8_t* buf) -> bool {
+        auto context = static_cast<Context*>(arg);
+        int32_t width = context->width;
 
-    // Use callback-based JPEG encoder to further save memory
-    bool ret = image_to_jpeg_cb((uint8_t*)draw_buffer->data, draw_buffer->data_size, draw_buffer->header.w, draw_buffer->header.h, V4L2_PIX_FMT_RGB565, quality,
-        [](void *arg, size_t index, const void *data, size_t len) -> size_t {
-        std::string* output = static_cast<std::string*>(arg);
-        if (data && len > 0) {
-            output->append(static_cast<const char*>(data), len);
+        // LVGL renders RGB565 in native byte order, which the encoder takes as RGB565X, so no swap is needed
+        lv_draw_buf_t draw_buf;
+        if (lv_draw_buf_init(&draw_buf, width, lines, LV_COLOR_FORMAT_RGB565, width * 2, buf, width * 2 * lines) != LV_RESULT_OK) {
+            return false;
+        }
+        lv_area_t area = { 0, (int32_t)y, width - 1, (int32_t)(y + lines - 1) };
+        DisplayLockGuard lock(context->display);
+        RenderArea(lv_screen_active(), &draw_buf, area);
+        return true;
+    }, [](void* arg, size_t index, const void* data, size_t len) -> size_t {
+        auto context = static_cast<Context*>(arg);
+        if (data != nullptr && len > 0) {
+            context->jpeg_data.append(static_cast<const char*>(data), len);
         }
         return len;
-    }, &jpeg_data);
+    }, &context);
+    {
+        DisplayLockGuard lock(this);
+        if (--snapshot_pauses_ == 0) {
+            lv_timer_enable(true);
+        }
+    }
     if (!ret) {
-        ESP_LOGE(TAG, "Failed to convert image to JPEG");
+        ESP_LOGE(TAG, "Failed to convert snapshot to JPEG");
     }
-
-    lv_draw_buf_destroy(draw_buffer);
     return ret;
 #else
     ESP_LOGE(TAG, "LV_USE_SNAPSHOT is not enabled");
     return false;
 #endif
 }
+
+bool LvglDisplay::SnapshotToJpeg(std::function<bool(const void* data, size_t len)> write, int quality) {
+#if CONFIG_LV_USE_SNAPSHOT
+    // The compressed screen is small, keep it in memory rather than holding the timers across the write
+    std::string jpeg_data;
+    if (!SnapshotToJpeg(jpeg_data, quality)) {
+        return false;
+    }
+    return write(jpeg_data.data(), jpeg_data.size());
+#else
+    ESP_LOGE(TAG, "LV_USE_SNAPSHOT is not enabled");
+    return false;
+#endif
+}
@@ -11,6 +11,7 @@
 
 #include <string>
 #include <chrono>
+#include <functional>
 
 class LvglDisplay : public Display {
 public:
@@ -23,7 +24,13 @@ public:
     virtual void SetPreviewImage(std::unique_ptr<LvglImage> image);
     virtual void UpdateStatusBar(bool update_all = false);
     virtual void SetPowerSaveMode(bool on);
+    virtual void SetFrameRateLimit(int fps) override;
+    // Render and encode the screen a few lines at a time. LVGL timers are paused meanwhile,
+    // so all lines show the same frame and the screen does not refresh until it returns.
     virtual bool SnapshotToJpeg(std::string& jpeg_data, int quality = 80);
+    // Encode the screen as above, then pass the JPEG data to write with the timers running again,
+    // so a slow write (e.g. a network upload) does not freeze the screen
+    virtual bool SnapshotToJpeg(std::function<bool(const void* data, size_t len)> write, int quality = 80);
 
 protected:
     esp_pm_lock_handle_t pm_lock_ = nullptr;
@@ -44,6 +51,25 @@ protected:
     std::chrono::system_clock::time_point last_status_update_time_;
     esp_timer_handle_t notification_timer_ = nullptr;
 
+    // Render statistics, updated from display events in the LVGL task
+    struct RenderStats {
+        bool monitored = false;
+        bool rendered = false;          // Current refresh drew something
+        int64_t refresh_start_us = 0;
+        int64_t flush_start_us = 0;
+        int64_t frame_flush_us = 0;
+        int64_t report_start_us = 0;
+        uint32_t frames = 0;
+        int64_t render_us = 0;
+        int64_t flush_us = 0;
+        int64_t max_frame_us = 0;
+    } render_stats_;
+    int frame_rate_limit_ = 0;
+    // Snapshots that paused the LVGL timers, guarded by the display lock
+    int snapshot_pauses_ = 0;
+
+    static void OnRenderEvent(lv_event_t* e);
+
     friend class DisplayLockGuard;
     virtual bool Lock(int timeout_ms = 0) = 0;
     virtual void Unlock() = 0;
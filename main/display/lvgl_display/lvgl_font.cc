@@ -1,13 +1,109 @@
 #include "lvgl_font.h"
 #include <cbin_font.h>
 
+#include <cstring>
 
-LvglCBinFont::LvglCBinFont(void* data) {
-    font_ = cbin_font_create(static_cast<uint8_t*>(data));
+
+LvglCBinFont::LvglCBinFont(void* data, size_t cache_budget) : cache_budget_(cache_budget) {
+    source_ = cbin_font_create(static_cast<uint8_t*>(data));
+    if (source_ == nullptr) {
+        return;
+    }
+
+    wrapper_.font = *source_;
+    wrapper_.owner = this;
+    wrapper_.font.get_glyph_dsc = GetGlyphDsc;
+    wrapper_.font.get_glyph_bitmap = GetGlyphBitmap;
+    // With kerning the advance depends on the next letter, so only plain fonts cache descriptors
+    if (source_->get_glyph_dsc == lv_font_get_glyph_dsc_fmt_txt) {
+        auto fmt_dsc = static_cast<const lv_font_fmt_txt_dsc_t*>(source_->dsc);
+        cache_dsc_ = fmt_dsc != nullptr && fmt_dsc->kern_dsc == nullptr;
+    }
 }
 
 LvglCBinFont::~LvglCBinFont() {
-    if (font_ != nullptr) {
-        cbin_font_delete(font_);
+    if (source_ != nullptr) {
+        cbin_font_delete(source_);
+    }
+}
+
+bool LvglCBinFont::GetGlyphDsc(const lv_font_t* font, lv_font_glyph_dsc_t* dsc, uint32_t letter, uint32_t letter_next) {
+    auto self = reinterpret_cast<const Wrapper*>(font)->owner;
+    if (!self->cache_dsc_) {
+        return self->source_->get_glyph_dsc(font, dsc, letter, letter_next);
+    }
+
+    auto it = self->glyph_dsc_.find(letter);
+    if (it == self->glyph_dsc_.end()) {
+        if (self->glyph_dsc_.size() >= FONT_GLYPH_DSC_CACHE_SIZE) {
+            self->glyph_dsc_.clear();
+        }
+        GlyphDsc entry = {};
+        entry.found = self->source_->get_glyph_dsc(font, dsc, letter, letter_next);
+        if (entry.found) {
+            entry.adv_w = dsc->adv_w;
+            entry.box_w = dsc->box_w;
+            entry.box_h = dsc->box_h;
+            entry.ofs_x = dsc->ofs_x;
+            entry.ofs_y = dsc->ofs_y;
+            entry.format = dsc->format;
+            entry.is_placeholder = dsc->is_placeholder;
+            entry.index = dsc->gid.index;
+        }
+        self->glyph_dsc_.emplace(letter, entry);
+        return entry.found;
+    }
+
+    auto& entry = it->second;
+    if (entry.found) {
+        dsc->adv_w = entry.adv_w;
+        dsc->box_w = entry.box_w;
+        dsc->box_h = entry.box_h;
+        dsc->ofs_x = entry.ofs_x;
+        dsc->ofs_y = entry.ofs_y;
+        dsc->format = static_cast<lv_font_glyph_format_t>(entry.format);
+        dsc->is_placeholder = entry.is_placeholder;
+        dsc->gid.index = entry.index;
     }
-}
\ No newline at end of file
+    return entry.found;
+}
+
+const void* LvglCBinFont::GetGlyphBitmap(lv_font_glyph_dsc_t* dsc, lv_draw_buf_t* draw_buf) {
+    auto self = reinterpret_cast<const Wrapper*>(dsc->resolved_font)->owner;
+    if (self->cache_budget_ == 0 || draw_buf == nullptr) {
+        return self->source_->get_glyph_bitmap(dsc, draw_buf);
+    }
+
+    uint32_t index = dsc->gid.index;
+    auto it = self->bitmap_index_.find(index);
+    if (it != self->bitmap_index_.end()) {
+        auto& bitmap = *it->second;
+        if (lv_draw_buf_reshape(draw_buf, static_cast<lv_color_format_t>(bitmap.cf), dsc->box_w, dsc->box_h, bitmap.stride) != nullptr &&
+            bitmap.data.size() <= draw_buf->data_size) {
+            memcpy(draw_buf->data, bitmap.data.data(), bitmap.data.size());
+            self->bitmaps_.splice(self->bitmaps_.begin(), self->bitmaps_, it->second);
+            return draw_buf;
+        }
+    }
+
+    const void* result = self->source_->get_glyph_bitmap(dsc, draw_buf);
+    // Only glyphs unpacked into the draw buffer are cached, raw bitmaps are used in place
+    if (result != draw_buf || it != self->bitmap_index_.end()) {
+        return result;
+    }
+
+    size_t size = draw_buf->header.stride * dsc->box_h;
+    if (size == 0 || size > self->cache_budget_) {
+        return result;
+    }
+    while (self->cache_used_ + size > self->cache_budget_) {
+        auto& oldest = self->bitmaps_.back();
+        self->cache_used_ -= oldest.data.size();
+        self->bitmap_index_.erase(oldest.index);
+        self->bitmaps_.pop_back();
+    }
+    self->bitmaps_.push_front({ index, draw_buf->header.cf, draw_buf->header.stride, std::vector<uint8_t>(draw_buf->data, draw_buf->data + size) });
+    self->bitmap_index_[index] = self->bitmaps_.begin();
+    self->cache_used_ += size;
+    return result;
+}
@@ -2,6 +2,28 @@
 
 #include <lvgl.h>
 
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Memory budget of rendered glyph bitmaps per cbin font
+ * Saves reading and unpacking glyphs from memory-mapped flash for every label update
+ */
+#ifndef FONT_GLYPH_CACHE_BUDGET
+#if CONFIG_SPIRAM
+#define FONT_GLYPH_CACHE_BUDGET (128 * 1024)
+#else
+#define FONT_GLYPH_CACHE_BUDGET (16 * 1024)
+#endif
+#endif
+
+// Glyph descriptors kept per cbin font, the table is cleared when full
+#ifndef FONT_GLYPH_DSC_CACHE_SIZE
+#define FONT_GLYPH_DSC_CACHE_SIZE 2048
+#endif
+
 
 class LvglFont {
 public:
@@ -20,12 +42,48 @@ private:
 };
 
 
+// Font from the assets partition, glyph lookups and bitmaps are cached in RAM
 class LvglCBinFont : public LvglFont {
 public:
-    LvglCBinFont(void* data);
+    LvglCBinFont(void* data, size_t cache_budget = FONT_GLYPH_CACHE_BUDGET);
     virtual ~LvglCBinFont();
-    virtual const lv_font_t* font() const override { return font_; }
+    virtual const lv_font_t* font() const override { return source_ != nullptr ? &wrapper_.font : nullptr; }
 
 private:
-    lv_font_t* font_;
+    // Copy of the cbin font with caching callbacks, LVGL only sees this one
+    struct Wrapper {
+        lv_font_t font;
+        LvglCBinFont* owner;
+    };
+
+    struct GlyphDsc {
+        bool found;
+        uint16_t adv_w;
+        uint16_t box_w;
+        uint16_t box_h;
+        int16_t ofs_x;
+        int16_t ofs_y;
+        uint8_t format;
+        bool is_placeholder;
+        uint32_t index;
+    };
+
+    struct Bitmap {
+        uint32_t index;
+        uint32_t cf;
+        uint32_t stride;
+        std::vector<uint8_t> data;
+    };
+
+    lv_font_t* source_ = nullptr;
+    Wrapper wrapper_ = {};
+    bool cache_dsc_ = false;
+    size_t cache_budget_;
+    size_t cache_used_ = 0;
+    std::unordered_map<uint32_t, GlyphDsc> glyph_dsc_;
+    std::list<Bitmap> bitmaps_;     // Most recently used first
+    std::unordered_map<uint32_t, std::list<Bitmap>::iterator> bitmap_index_;
+
+    static bool GetGlyphDsc(const lv_font_t* font, lv_font_glyph_dsc_t* dsc, uint32_t letter, uint32_t letter_next);
+    static const void* GetGlyphBitmap(lv_font_glyph_dsc_t* dsc, lv_draw_buf_t* draw_buf);
 };
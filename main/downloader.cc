@@ -0,0 +1,451 @@
+#include "downloader.h"
+#include "board.h"
+#include "settings.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <mbedtls/sha256.h>
+
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
+
+#define TAG "Downloader"
+
+#define DOWNLOAD_CHECKPOINT_NAMESPACE "download"
+#define DOWNLOAD_CHECKPOINT_INTERVAL (256 * 1024)
+
+Downloader::Downloader(const esp_partition_t* partition, const std::string& checkpoint_id, size_t block_size, size_t block_count)
+    : partition_(partition), checkpoint_id_(checkpoint_id), block_size_(block_size), block_count_(block_count) {
+    sector_size_ = esp_partition_get_main_flash_sector_size();
+    // Blocks are whole sectors, so every checkpoint lands on a sector boundary
+    block_size_ = std::max(sector_size_, block_size_ - block_size_ % sector_size_);
+    free_queue_ = xQueueCreate(block_count_, sizeof(int));
+    ready_queue_ = xQueueCreate(block_count_ + 1, sizeof(BlockRef));
+}
+
+Downloader::~Downloader() {
+    if (free_queue_ != nullptr) {
+        vQueueDelete(free_queue_);
+    }
+    if (ready_queue_ != nullptr) {
+        vQueueDelete(ready_queue_);
+    }
+    if (pool_ != nullptr) {
+        heap_caps_free(pool_);
+    }
+}
+
+bool Downloader::AllocatePool() {
+    if (pool_ != nullptr) {
+        return true;
+    }
+    pool_ = (char*)heap_caps_malloc(block_size_ * block_count_, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    // Without PSRAM, fall back to smaller blocks in internal RAM
+    while (pool_ == nullptr && block_size_ >= sector_size_) {
+        pool_ = (char*)heap_caps_malloc(block_size_ * block_count_, MALLOC_CAP_8BIT);
+        if (pool_ == nullptr) {
+            block_size_ /= 2;
+        }
+    }
+    if (pool_ == nullptr || free_queue_ == nullptr || ready_queue_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate download buffers");
+        return false;
+    }
+    ESP_LOGI(TAG, "Using %u blocks of %u bytes", block_count_, block_size_);
+    return true;
+}
+
+// Validator for If-Range, weak ETags are not allowed there
+static std::string GetValidator(Http* http) {
+    auto etag = http->GetResponseHeader("ETag");
+    if (!etag.empty() && etag.compare(0, 2, "W/") != 0) {
+        return etag;
+    }
+    return http->GetResponseHeader("Last-Modified");
+}
+
+void Downloader::ClearCheckpoint(const std::string& checkpoint_id) {
+    Settings settings(DOWNLOAD_CHECKPOINT_NAMESPACE, true);
+    settings.EraseKey(checkpoint_id + "_url");
+    settings.EraseKey(checkpoint_id + "_off");
+    settings.EraseKey(checkpoint_id + "_len");
+    settings.EraseKey(checkpoint_id + "_lbl");
+    settings.EraseKey(checkpoint_id + "_tag");
+}
+
+bool Downloader::HasCheckpoint(const std::string& checkpoint_id, const std::string& url, const esp_partition_t* partition) {
+    Settings settings(DOWNLOAD_CHECKPOINT_NAMESPACE);
+    return settings.GetInt(checkpoint_id + "_off") > 0 && settings.GetString(checkpoint_id + "_url") == url &&
+        settings.GetString(checkpoint_id + "_lbl") == partition->label && !settings.GetString(checkpoint_id + "_tag").empty();
+}
+
+void Downloader::SaveCheckpoint(const std::string& url, size_t offset) {
+    if (validator_.empty()) {
+        return;
+    }
+    Settings settings(DOWNLOAD_CHECKPOINT_NAMESPACE, true);
+    settings.SetString(checkpoint_id_ + "_url", url);
+    settings.SetInt(checkpoint_id_ + "_off", offset);
+    settings.SetInt(checkpoint_id_ + "_len", total_size_);
+    settings.SetString(checkpoint_id_ + "_lbl", partition_->label);
+    settings.SetString(checkpoint_id_ + "_tag", validator_);
+    ESP_LOGD(TAG, "Checkpoint %s at %u/%u", checkpoint_id_.c_str(), offset, total_size_);
+}
+
+void Downloader::ReportProgress(bool force) {
+    if (esp_timer_get_time() - last_calc_time_ < 1000000 && !force) {
+        return;
+    }
+    size_t progress = total_size_ > 0 ? received_ * 100 / total_size_ : 0;
+    ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %uB/s", progress, received_, total_size_, recent_received_);
+    if (callback_) {
+        callback_(progress, recent_received_);
+    }
+    last_calc_time_ = esp_timer_get_time();
+    recent_received_ = 0;
+}
+
+void Downloader::WaitWhilePaused() {
+    if (!pause_check_ || !pause_check_()) {
+        return;
+    }
+    ESP_LOGI(TAG, "Download paused at %u/%u", received_, total_size_);
+    while (pause_check_()) {
+        vTaskDelay(pdMS_TO_TICKS(500));
+    }
+    ESP_LOGI(TAG, "Download resumed");
+    // Do not count the pause in the speed or let the rate limit catch up with a burst
+    throttle_start_time_ = esp_timer_get_time();
+    throttle_bytes_ = 0;
+    last_calc_time_ = throttle_start_time_;
+    recent_received_ = 0;
+}
+
+void Downloader::Throttle(size_t bytes) {
+    if (rate_limit_ == 0) {
+        return;
+    }
+    throttle_bytes_ += bytes;
+    int64_t expected_us = (int64_t)throttle_bytes_ * 1000000 / rate_limit_;
+    int64_t elapsed_us = esp_timer_get_time() - throttle_start_time_;
+    if (expected_us > elapsed_us) {
+        vTaskDelay(pdMS_TO_TICKS((expected_us - elapsed_us) / 1000));
+    }
+}
+
+bool Downloader::EraseTo(size_t end) {
+    end = std::min<size_t>((end + sector_size_ - 1) / sector_size_ * sector_size_, partition_->size);
+    if (erased_end_ >= end) {
+        return true;
+    }
+    esp_err_t err = esp_partition_erase_range(partition_, erased_end_, end - erased_end_);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to erase 0x%x-0x%x: %s", erased_end_, end, esp_err_to_name(err));
+        return false;
+    }
+    erased_end_ = end;
+    return true;
+}
+
+void Downloader::WriterLoop() {
+    size_t erase_end = std::min<size_t>((total_size_ + sector_size_ - 1) / sector_size_ * sector_size_, partition_->size);
+    while (true) {
+        // While no block is ready, erase ahead up to one pool worth beyond what has been written
+        size_t erase_ahead = std::min(erase_end, flushed_ + block_size_ * block_count_);
+        TickType_t wait = (!write_error_ && erased_end_ < erase_ahead) ? 0 : portMAX_DELAY;
+
+        BlockRef ref;
+        if (xQueueReceive(ready_queue_, &ref, wait) != pdPASS) {
+            if (!EraseTo(erased_end_ + sector_size_)) {
+                write_error_ = true;
+            }
+            continue;
+        }
+        if (ref.index < 0) {
+            break;
+        }
+
+        if (!write_error_) {
+            if (!EraseTo(ref.offset + ref.len)) {
+                write_error_ = true;
+            } else {
+                esp_err_t err = esp_partition_write(partition_, ref.offset, pool_ + ref.index * block_size_, ref.len);
+                if (err != ESP_OK) {
+                    ESP_LOGE(TAG, "Failed to write at offset %u: %s", ref.offset, esp_err_to_name(err));
+                    write_error_ = true;
+                } else {
+                    flushed_ = ref.offset + ref.len;
+                }
+            }
+        }
+        // Always return the block, so the network side never waits on a failed writer
+        xQueueSend(free_queue_, &ref.index, portMAX_DELAY);
+    }
+}
+
+bool Downloader::DownloadOnce(const std::string& url, size_t& offset, bool& retryable, bool& handled) {
+    retryable = true;
+    handled = false;
+
+    auto http = Board::GetInstance().GetNetwork()->CreateHttp(0);
+    if (offset > 0 && validator_.empty()) {
+        ESP_LOGW(TAG, "The server sent no ETag or Last-Modified, starting over");
+        offset = 0;
+    }
+    if (offset > 0) {
+        // The server answers 200 with the whole file if it changed since the checkpoint
+        http->SetHeader("Range", "bytes=" + std::to_string(offset) + "-");
+        http->SetHeader("If-Range", validator_);
+    }
+    if (!http->Open("GET", url)) {
+        ESP_LOGE(TAG, "Failed to open HTTP connection");
+        return false;
+    }
+
+    int status_code = http->GetStatusCode();
+    size_t body_length = http->GetBodyLength();
+    if (status_code == 206 && offset > 0) {
+        auto validator = GetValidator(http.get());
+        if (offset + body_length != total_size_ || (!validator.empty() && validator != validator_)) {
+            ESP_LOGW(TAG, "Remote file changed (%u != %u bytes), starting over", offset + body_length, total_size_);
+            ClearCheckpoint(checkpoint_id_);
+            offset = 0;
+            return false;
+        }
+        ESP_LOGI(TAG, "Resuming download at %u/%u", offset, total_size_);
+    } else if (status_code == 200) {
+        if (offset > 0) {
+            ESP_LOGW(TAG, "Server ignored the range request or the file changed, starting over");
+            ClearCheckpoint(checkpoint_id_);
+            offset = 0;
+        }
+        total_size_ = body_length;
+        validator_ = GetValidator(http.get());
+    } else {
+        ESP_LOGE(TAG, "Failed to download, status code: %d", status_code);
+        retryable = status_code >= 500;
+        return false;
+    }
+
+    if (total_size_ == 0) {
+        ESP_LOGE(TAG, "Failed to get content length");
+        retryable = false;
+        return false;
+    }
+    if (total_size_ > partition_->size) {
+        ESP_LOGE(TAG, "File size (%u) is larger than partition %s (%lu)", total_size_, partition_->label, partition_->size);
+        retryable = false;
+        return false;
+    }
+
+    received_ = offset;
+    recent_received_ = 0;
+    last_calc_time_ = esp_timer_get_time();
+    throttle_start_time_ = last_calc_time_;
+    throttle_bytes_ = 0;
+    flushed_ = offset;
+    erased_end_ = offset;
+    write_error_ = false;
+    xQueueReset(free_queue_);
+    xQueueReset(ready_queue_);
+    for (int i = 0; i < (int)block_count_; i++) {
+        xQueueSend(free_queue_, &i, 0);
+    }
+    // Started with the first block to write: until the first block handler returns,
+    // it may write the partition itself and must not race with erase-ahead
+    std::thread writer;
+
+    Downloader::ReadFunction read = [this, &http](char* buffer, size_t size) -> int {
+        WaitWhilePaused();
+        int ret = http->Read(buffer, size);
+        if (ret < 0) {
+            ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
+            return ret;
+        }
+        received_ += ret;
+        recent_received_ += ret;
+        ReportProgress(ret == 0);
+        Throttle(ret);
+        return ret;
+    };
+
+    bool ok = true;
+    bool eof = false;
+    bool first_block = offset == 0;
+    size_t write_offset = offset;
+    size_t last_checkpoint = offset;
+    while (ok && !eof) {
+        int index;
+        xQueueReceive(free_queue_, &index, portMAX_DELAY);
+        char* block = pool_ + index * block_size_;
+
+        // Fill the whole block, so flash sees few large writes
+        size_t len = 0;
+        while (len < block_size_) {
+            int ret = read(block + len, block_size_ - len);
+            if (ret < 0) {
+                ok = false;
+                break;
+            }
+            if (ret == 0) {
+                eof = true;
+                break;
+            }
+            len += ret;
+        }
+
+        if (ok && first_block && len > 0 && first_block_handler_) {
+            first_block = false;
+            auto action = first_block_handler_(block, len, read);
+            if (action == kFirstBlockHandled) {
+                handled = true;
+                eof = true;
+                len = 0;
+            } else if (action == kFirstBlockAbort) {
+                ok = false;
+                retryable = false;
+            }
+        }
+
+        if (!ok || write_error_ || len == 0) {
+            xQueueSend(free_queue_, &index, 0);
+            ok = ok && !write_error_;
+            continue;
+        }
+        if (!writer.joinable()) {
+            writer = std::thread([this]() {
+                WriterLoop();
+            });
+        }
+        BlockRef ref = { .index = index, .offset = write_offset, .len = len };
+        xQueueSend(ready_queue_, &ref, portMAX_DELAY);
+        write_offset += len;
+
+        size_t flushed = flushed_;
+        if (flushed - last_checkpoint >= DOWNLOAD_CHECKPOINT_INTERVAL) {
+            SaveCheckpoint(url, flushed);
+            last_checkpoint = flushed;
+        }
+    }
+
+    if (writer.joinable()) {
+        BlockRef end = { .index = -1, .offset = 0, .len = 0 };
+        xQueueSend(ready_queue_, &end, portMAX_DELAY);
+        writer.join();
+    }
+    http->Close();
+
+    if (write_error_) {
+        // Flash errors will not go away by retrying
+        ok = false;
+        retryable = false;
+    }
+    if (handled) {
+        return ok;
+    }
+
+    offset = flushed_;
+    if (ok && offset != total_size_) {
+        ESP_LOGE(TAG, "Downloaded size (%u) does not match expected size (%u)", offset, total_size_);
+        ok = false;
+    }
+    if (!ok && retryable && offset > last_checkpoint) {
+        SaveCheckpoint(url, offset);
+    }
+    return ok;
+}
+
+bool Downloader::VerifySha256(const esp_partition_t* partition, size_t size, const std::string& expected_sha256) {
+    auto start_time = esp_timer_get_time();
+    const size_t buffer_size = 4096;
+    auto buffer = (uint8_t*)malloc(buffer_size);
+    if (buffer == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate buffer for SHA-256");
+        return false;
+    }
+
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+    bool ok = true;
+    for (size_t offset = 0; offset < size; offset += buffer_size) {
+        size_t len = std::min(buffer_size, size - offset);
+        if (esp_partition_read(partition, offset, buffer, len) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read back partition at offset %u", offset);
+            ok = false;
+            break;
+        }
+        mbedtls_sha256_update(&ctx, buffer, len);
+    }
+    uint8_t sha256[32];
+    mbedtls_sha256_finish(&ctx, sha256);
+    mbedtls_sha256_free(&ctx);
+    free(buffer);
+    if (!ok) {
+        return false;
+    }
+
+    char hex[sizeof(sha256) * 2 + 1];
+    for (size_t i = 0; i < sizeof(sha256); i++) {
+        snprintf(hex + i * 2, 3, "%02x", sha256[i]);
+    }
+    std::string expected = expected_sha256;
+    std::transform(expected.begin(), expected.end(), expected.begin(), ::tolower);
+    if (expected != hex) {
+        ESP_LOGE(TAG, "SHA-256 mismatch, expected %s, got %s", expected.c_str(), hex);
+        return false;
+    }
+    ESP_LOGI(TAG, "SHA-256 verified in %dms", (int)((esp_timer_get_time() - start_time) / 1000));
+    return true;
+}
+
+bool Downloader::Download(const std::string& url, ProgressCallback callback) {
+    resumable_ = false;
+    if (!AllocatePool()) {
+        return false;
+    }
+    callback_ = callback;
+
+    size_t offset = 0;
+    validator_.clear();
+    if (HasCheckpoint(checkpoint_id_, url, partition_)) {
+        Settings settings(DOWNLOAD_CHECKPOINT_NAMESPACE);
+        offset = settings.GetInt(checkpoint_id_ + "_off");
+        total_size_ = settings.GetInt(checkpoint_id_ + "_len");
+        validator_ = settings.GetString(checkpoint_id_ + "_tag");
+    }
+    offset -= offset % sector_size_;
+    if (offset >= total_size_ || total_size_ > partition_->size) {
+        offset = 0;
+    }
+
+    auto start_time = esp_timer_get_time();
+    for (int attempt = 0; attempt < max_attempts_; attempt++) {
+        if (attempt > 0) {
+            ESP_LOGW(TAG, "Retrying download (%d/%d) from %u", attempt, max_attempts_ - 1, offset);
+            vTaskDelay(pdMS_TO_TICKS(1000 * attempt));
+        }
+        // Reconnect only after a pause ended, the old connection may have timed out during it
+        WaitWhilePaused();
+
+        bool retryable = false, handled = false;
+        if (DownloadOnce(url, offset, retryable, handled)) {
+            ClearCheckpoint(checkpoint_id_);
+            if (handled) {
+                return true;
+            }
+            ESP_LOGI(TAG, "Downloaded %u bytes to %s in %dms", total_size_, partition_->label,
+                (int)((esp_timer_get_time() - start_time) / 1000));
+            return expected_sha256_.empty() || VerifySha256(partition_, total_size_, expected_sha256_);
+        }
+        if (!retryable) {
+            ClearCheckpoint(checkpoint_id_);
+            return false;
+        }
+    }
+    resumable_ = offset > 0 && !validator_.empty();
+    return false;
+}
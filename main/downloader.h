@@ -0,0 +1,114 @@
+#ifndef _DOWNLOADER_H_
+#define _DOWNLOADER_H_
+
+#include <string>
+#include <atomic>
+#include <functional>
+
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+/**
+ * Downloads a URL into a raw partition.
+ *
+ * The network side fills large blocks while a writer thread erases and writes
+ * them, erasing the next sectors ahead whenever it is idle, so flash erase
+ * overlaps network reads. Progress is checkpointed in NVS and an interrupted
+ * download, in this session or after a reboot, continues with an HTTP Range
+ * request instead of starting from zero.
+ *
+ * A checkpoint belongs to the URL, the partition label and the ETag (or
+ * Last-Modified) of the file. The resumed request carries If-Range with that
+ * validator, and the download starts over when any of them differs. A server
+ * that sends neither header is never resumed.
+ */
+class Downloader {
+public:
+    typedef std::function<void(int progress, size_t speed)> ProgressCallback;
+    // Same contract as Http::Read: bytes read, 0 at end of stream, negative on error
+    typedef std::function<int(char* buffer, size_t size)> ReadFunction;
+
+    enum FirstBlockAction {
+        kFirstBlockWrite,     // Write the data to the partition as usual
+        kFirstBlockHandled,   // The handler consumed the rest of the stream successfully
+        kFirstBlockAbort,     // Stop and fail the download
+    };
+    // Called with the first block when a download starts from offset 0. The handler may
+    // take over the rest of the stream with `read` (progress is still reported). The writer
+    // thread only starts after it returns, so it may write the partition itself.
+    typedef std::function<FirstBlockAction(const char* data, size_t size, ReadFunction read)> FirstBlockHandler;
+
+    // checkpoint_id identifies the NVS checkpoint, at most 11 characters
+    Downloader(const esp_partition_t* partition, const std::string& checkpoint_id,
+        size_t block_size = 16 * 1024, size_t block_count = 3);
+    ~Downloader();
+
+    void SetFirstBlockHandler(FirstBlockHandler handler) { first_block_handler_ = handler; }
+    // Hex encoded SHA-256 of the whole file, checked against the flash contents after download
+    void SetExpectedSha256(const std::string& sha256) { expected_sha256_ = sha256; }
+    void SetMaxAttempts(int max_attempts) { max_attempts_ = max_attempts; }
+    // Limit the average download speed, 0 for unlimited
+    void SetRateLimit(size_t bytes_per_second) { rate_limit_ = bytes_per_second; }
+    // Reading stops while the check returns true, the connection is kept open if the server allows
+    void SetPauseCheck(std::function<bool()> pause_check) { pause_check_ = pause_check; }
+
+    bool Download(const std::string& url, ProgressCallback callback);
+
+    size_t total_size() const { return total_size_; }
+    // True if a failed download left a checkpoint that a later call can resume from
+    bool resumable() const { return resumable_; }
+
+    static void ClearCheckpoint(const std::string& checkpoint_id);
+    static bool HasCheckpoint(const std::string& checkpoint_id, const std::string& url, const esp_partition_t* partition);
+    // Compare the first `size` bytes of the partition with a hex encoded SHA-256
+    static bool VerifySha256(const esp_partition_t* partition, size_t size, const std::string& expected_sha256);
+
+private:
+    struct BlockRef {
+        int index;  // -1 marks the end of the stream
+        size_t offset;
+        size_t len;
+    };
+
+    const esp_partition_t* partition_;
+    std::string checkpoint_id_;
+    size_t block_size_;
+    size_t block_count_;
+    size_t sector_size_;
+    char* pool_ = nullptr;
+    QueueHandle_t free_queue_ = nullptr;
+    QueueHandle_t ready_queue_ = nullptr;
+
+    FirstBlockHandler first_block_handler_;
+    std::string expected_sha256_;
+    int max_attempts_ = 3;
+    size_t rate_limit_ = 0;
+    std::function<bool()> pause_check_;
+
+    size_t total_size_ = 0;
+    std::string validator_;  // ETag or Last-Modified of the file being downloaded
+    bool resumable_ = false;
+    std::atomic<size_t> flushed_ = 0;
+    std::atomic<bool> write_error_ = false;
+    size_t erased_end_ = 0;
+
+    // Progress
+    size_t received_ = 0;
+    size_t recent_received_ = 0;
+    int64_t last_calc_time_ = 0;
+    ProgressCallback callback_;
+    int64_t throttle_start_time_ = 0;
+    size_t throttle_bytes_ = 0;
+
+    bool AllocatePool();
+    void ReportProgress(bool force);
+    void WaitWhilePaused();
+    void Throttle(size_t bytes);
+    bool EraseTo(size_t end);
+    void WriterLoop();
+    bool DownloadOnce(const std::string& url, size_t& offset, bool& retryable, bool& handled);
+    void SaveCheckpoint(const std::string& url, size_t offset);
+};
+
+#endif // _DOWNLOADER_H_
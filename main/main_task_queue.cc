@@ -0,0 +1,120 @@
+#include "main_task_queue.h"
+
+#include <esp_log.h>
+
+#define TAG "MainTaskQueue"
+
+static const char* const priority_names[] = {
+    "state",
+    "audio",
+    "ui",
+    "tool",
+};
+
+static int64_t BudgetUs(SchedulePriority priority) {
+    if (priority == kSchedulePriorityTool) {
+        return MAIN_TASK_TOOL_BUDGET_MS * 1000LL;
+    }
+    return MAIN_TASK_BUDGET_MS * 1000LL;
+}
+
+MainTaskQueue::MainTaskQueue() {
+    esp_timer_create_args_t watchdog_timer_args = {
+        .callback = [](void* arg) {
+            auto queue = (MainTaskQueue*)arg;
+            ESP_LOGW(TAG, "A %s task is still running after %d ms", priority_names[queue->running_priority_],
+                (int)((esp_timer_get_time() - queue->running_since_) / 1000));
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "main_task_watchdog",
+        .skip_unhandled_events = true
+    };
+    esp_timer_create(&watchdog_timer_args, &watchdog_timer_);
+}
+
+MainTaskQueue::~MainTaskQueue() {
+    if (watchdog_timer_ != nullptr) {
+        esp_timer_stop(watchdog_timer_);
+        esp_timer_delete(watchdog_timer_);
+    }
+}
+
+void MainTaskQueue::Push(MainTask&& task, SchedulePriority priority) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lanes_[priority].push_back({ std::move(task), esp_timer_get_time(), ++sequence_ });
+}
+
+// Oldest task of the highest lane, skipping the lower lanes' tasks queued after last_sequence
+bool MainTaskQueue::Pop(SchedulePriority lowest_priority, uint32_t last_sequence, Entry& entry, SchedulePriority& priority) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int i = 0; i <= lowest_priority; i++) {
+        auto& lane = lanes_[i];
+        if (lane.empty()) {
+            continue;
+        }
+        if (i != kSchedulePriorityState && (int32_t)(lane.front().sequence - last_sequence) > 0) {
+            continue;
+        }
+        entry = std::move(lane.front());
+        lane.pop_front();
+        priority = (SchedulePriority)i;
+        return true;
+    }
+    return false;
+}
+
+void MainTaskQueue::RunPending(SchedulePriority lowest_priority) {
+    uint32_t last_sequence;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        last_sequence = sequence_;
+    }
+
+    Entry entry;
+    SchedulePriority priority;
+    while (Pop(lowest_priority, last_sequence, entry, priority)) {
+        int64_t budget = BudgetUs(priority);
+        running_priority_ = priority;
+        running_since_ = esp_timer_get_time();
+        esp_timer_start_once(watchdog_timer_, budget);
+
+        entry.task();
+
+        esp_timer_stop(watchdog_timer_);
+        int64_t now = esp_timer_get_time();
+        int64_t latency = running_since_ - entry.queued_time;
+        int64_t run_time = now - running_since_;
+        entry.task = MainTask();
+
+        if (run_time > budget) {
+            ESP_LOGW(TAG, "A %s task ran for %d ms, queued for %d ms", priority_names[priority],
+                (int)(run_time / 1000), (int)(latency / 1000));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& stats = stats_[priority];
+        stats.count++;
+        stats.total_latency += latency;
+        if (latency > stats.max_latency) {
+            stats.max_latency = latency;
+        }
+        if (run_time > stats.max_run_time) {
+            stats.max_run_time = run_time;
+        }
+    }
+}
+
+void MainTaskQueue::PrintStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int i = 0; i < kSchedulePriorityCount; i++) {
+        auto& stats = stats_[i];
+        if (stats.count == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%s: %u tasks, latency avg %d max %d ms, run time max %d ms, %u queued", priority_names[i],
+            (unsigned)stats.count, (int)(stats.total_latency / stats.count / 1000), (int)(stats.max_latency / 1000),
+            (int)(stats.max_run_time / 1000), (unsigned)lanes_[i].size());
+        stats = LaneStats();
+    }
+}
@@ -0,0 +1,183 @@
+#ifndef MAIN_TASK_QUEUE_H
+#define MAIN_TASK_QUEUE_H
+
+#include <esp_timer.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Log a task that runs longer than this, tool calls may legitimately take longer
+#ifndef MAIN_TASK_BUDGET_MS
+#define MAIN_TASK_BUDGET_MS 100
+#endif
+#ifndef MAIN_TASK_TOOL_BUDGET_MS
+#define MAIN_TASK_TOOL_BUDGET_MS 3000
+#endif
+
+/**
+ * Lanes of the main task, a higher priority lane is always drained first
+ * Only tasks of the same lane keep their order, so tasks that must run in the order
+ * they were queued, like those of incoming protocol messages, share a lane.
+ */
+enum SchedulePriority {
+    kSchedulePriorityState,     // Device state transitions and incoming protocol messages
+    kSchedulePriorityAudio,     // Audio channel and codec control
+    kSchedulePriorityUi,        // Display updates and everything else
+    kSchedulePriorityTool,      // MCP tool calls and their replies
+    kSchedulePriorityCount
+};
+
+/**
+ * Move-only void() callable
+ * Captures up to kInlineSize bytes (a few pointers and a std::string) are stored
+ * inline, larger ones fall back to the heap.
+ */
+class MainTask {
+public:
+    static constexpr size_t kInlineSize = 40;
+
+    MainTask() = default;
+
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, MainTask>>>
+    MainTask(F&& callable) {
+        using T = std::decay_t<F>;
+        if constexpr (sizeof(T) <= kInlineSize && alignof(T) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible_v<T>) {
+            new (storage_) T(std::forward<F>(callable));
+            ops_ = &kInlineOps<T>;
+        } else {
+            *reinterpret_cast<T**>(storage_) = new T(std::forward<F>(callable));
+            ops_ = &kHeapOps<T>;
+        }
+    }
+
+    MainTask(MainTask&& other) noexcept {
+        MoveFrom(other);
+    }
+
+    MainTask& operator=(MainTask&& other) noexcept {
+        if (this != &other) {
+            Reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    MainTask(const MainTask&) = delete;
+    MainTask& operator=(const MainTask&) = delete;
+
+    ~MainTask() {
+        Reset();
+    }
+
+    void operator()() {
+        ops_->invoke(storage_);
+    }
+
+    explicit operator bool() const {
+        return ops_ != nullptr;
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* from, void* to);
+        void (*destroy)(void* storage);
+    };
+
+    template <typename T>
+    static constexpr Ops kInlineOps = {
+        [](void* storage) { (*static_cast<T*>(storage))(); },
+        [](void* from, void* to) {
+            new (to) T(std::move(*static_cast<T*>(from)));
+            static_cast<T*>(from)->~T();
+        },
+        [](void* storage) { static_cast<T*>(storage)->~T(); },
+    };
+
+    template <typename T>
+    static constexpr Ops kHeapOps = {
+        [](void* storage) { (**static_cast<T**>(storage))(); },
+        [](void* from, void* to) { *static_cast<T**>(to) = *static_cast<T**>(from); },
+        [](void* storage) { delete *static_cast<T**>(storage); },
+    };
+
+    alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+    const Ops* ops_ = nullptr;
+
+    void MoveFrom(MainTask& other) {
+        if (other.ops_ != nullptr) {
+            other.ops_->move(other.storage_, storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+
+    void Reset() {
+        if (ops_ != nullptr) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+};
+
+/**
+ * Callbacks waiting to run in the main task, one FIFO lane per priority
+ *
+ * Push() may be called from any task. RunPending() runs in the main task and
+ * always picks the oldest task of the highest non-empty lane, so a state
+ * transition queued behind slow tool calls runs right after the current one.
+ * Queue latency and run time are recorded per lane, and a watchdog timer logs
+ * a task that is still running after its budget.
+ */
+class MainTaskQueue {
+public:
+    MainTaskQueue();
+    ~MainTaskQueue();
+
+    MainTaskQueue(const MainTaskQueue&) = delete;
+    MainTaskQueue& operator=(const MainTaskQueue&) = delete;
+
+    void Push(MainTask&& task, SchedulePriority priority);
+
+    /**
+     * Run the queued tasks of lanes up to lowest_priority
+     * Tasks queued meanwhile wait for the next call, except state transitions
+     */
+    void RunPending(SchedulePriority lowest_priority = kSchedulePriorityTool);
+
+    // Log and reset the per lane statistics
+    void PrintStats();
+
+private:
+    struct Entry {
+        MainTask task;
+        int64_t queued_time;
+        uint32_t sequence;
+    };
+
+    struct LaneStats {
+        uint32_t count = 0;
+        int64_t total_latency = 0;
+        int64_t max_latency = 0;
+        int64_t max_run_time = 0;
+    };
+
+    std::mutex mutex_;
+    std::deque<Entry> lanes_[kSchedulePriorityCount];
+    uint32_t sequence_ = 0;
+    LaneStats stats_[kSchedulePriorityCount];
+
+    esp_timer_handle_t watchdog_timer_ = nullptr;
+    SchedulePriority running_priority_ = kSchedulePriorityUi;
+    int64_t running_since_ = 0;
+
+    bool Pop(SchedulePriority lowest_priority, uint32_t last_sequence, Entry& entry, SchedulePriority& priority);
+};
+
+#endif // MAIN_TASK_QUEUE_H
@@ -7,6 +7,7 @@
 #include <esp_log.h>
 #include <esp_app_desc.h>
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <esp_pthread.h>
 
@@ -15,8 +16,10 @@
 #include "oled_display.h"
 #include "board.h"
 #include "settings.h"
+#include "streaming_uploader.h"
 #include "lvgl_theme.h"
 #include "lvgl_display.h"
+#include "jpeg_to_image.h"
 
 #define TAG "MCP"
 
@@ -144,7 +147,7 @@ void McpServer::AddUserOnlyTools() {
                 vTaskDelay(pdMS_TO_TICKS(1000));
 
                 app.Reboot();
-            });
+            }, kSchedulePriorityTool);
             return true;
         });
 
@@ -163,7 +166,7 @@ void McpServer::AddUserOnlyTools() {
                 if (!success) {
                     ESP_LOGE(TAG, "Firmware upgrade failed");
                 }
-            });
+            }, kSchedulePriorityTool);
             
             return true;
         });
@@ -196,47 +199,17 @@ void McpServer::AddUserOnlyTools() {
                 auto url = properties["url"].value<std::string>();
                 auto quality = properties["quality"].value<int>();
 
-                std::string jpeg_data;
-                if (!display->SnapshotToJpeg(jpeg_data, quality)) {
-                    throw std::runtime_error("Failed to snapshot screen");
-                }
-
-                ESP_LOGI(TAG, "Upload snapshot %u bytes to %s", jpeg_data.size(), url.c_str());
-                
-                // 构造multipart/form-data请求体
-                std::string boundary = "----ESP32_SCREEN_SNAPSHOT_BOUNDARY";
-                
-                auto http = Board::GetInstance().GetNetwork()->CreateHttp(3);
-                http->SetHeader("Content-Type", "multipart/form-data; boundary=" + boundary);
-                if (!http->Open("POST", url)) {
-                    throw std::runtime_error("Failed to open URL: " + url);
-                }
-                {
-                    // 文件字段头部
-                    std::string file_header;
-                    file_header += "--" + boundary + "\r\n";
-                    file_header += "Content-Disposition: form-data; name=\"file\"; filename=\"screenshot.jpg\"\r\n";
-                    file_header += "Content-Type: image/jpeg\r\n";
-                    file_header += "\r\n";
-                    http->Write(file_header.c_str(), file_header.size());
-                }
-
-                // JPEG数据
-                http->Write((const char*)jpeg_data.data(), jpeg_data.size());
-
-                {
-                    // multipart尾部
-                    std::string multipart_footer;
-                    multipart_footer += "\r\n--" + boundary + "--\r\n";
-                    http->Write(multipart_footer.c_str(), multipart_footer.size());
-                }
-                http->Write("", 0);
-
-                if (http->GetStatusCode() != 200) {
-                    throw std::runtime_error("Unexpected status code: " + std::to_string(http->GetStatusCode()));
-                }
-                std::string result = http->ReadAll();
-                http->Close();
+                StreamingUploader uploader;
+                uploader.SetFileField("file", "screenshot.jpg", "image/jpeg");
+                std::string result = uploader.Upload(url, [display, quality](StreamingUploader& stream) -> bool {
+                    bool ok = display->SnapshotToJpeg([&stream](const void* data, size_t len) {
+                        return stream.Write(data, len);
+                    }, quality);
+                    if (!ok) {
+                        ESP_LOGE(TAG, "Failed to snapshot screen");
+                    }
+                    return ok;
+                });
                 ESP_LOGI(TAG, "Snapshot screen result: %s", result.c_str());
                 return true;
             });
@@ -276,6 +249,23 @@ void McpServer::AddUserOnlyTools() {
                 }
                 http->Close();
 
+#ifndef CONFIG_IDF_TARGET_ESP32
+                // Decode photos at about the screen size, a full resolution decode at draw time runs out of memory
+                if (total_read > 2 && (uint8_t)data[0] == 0xFF && (uint8_t)data[1] == 0xD8) {
+                    uint8_t* pixels = nullptr;
+                    size_t pixels_len = 0, width = 0, height = 0, stride = 0;
+                    esp_err_t err = jpeg_to_image_scaled((const uint8_t*)data, total_read, display->width(), display->height(),
+                        &pixels, &pixels_len, &width, &height, &stride);
+                    heap_caps_free(data);
+                    if (err != ESP_OK) {
+                        throw std::runtime_error("Failed to decode image: " + url);
+                    }
+                    auto image = std::make_unique<LvglAllocatedImage>(pixels, pixels_len, width, height, stride, LV_COLOR_FORMAT_RGB565);
+                    display->SetPreviewImage(std::move(image));
+                    return true;
+                }
+#endif
+
                 auto image = std::make_unique<LvglAllocatedImage>(data, content_length);
                 display->SetPreviewImage(std::move(image));
                 return true;
@@ -287,14 +277,20 @@ void McpServer::AddUserOnlyTools() {
     // Assets download url
     auto& assets = Assets::GetInstance();
     if (assets.partition_valid()) {
-        AddUserOnlyTool("self.assets.set_download_url", "Set the download url for the assets",
+        AddUserOnlyTool("self.assets.set_download_url", "Set the download url for the assets.\n"
+            "Args:\n"
+            "  `url`: The url of assets.bin\n"
+            "  `sha256`: Optional hex SHA-256 of assets.bin, verified after download",
             PropertyList({
-                Property("url", kPropertyTypeString)
+                Property("url", kPropertyTypeString),
+                Property("sha256", kPropertyTypeString, std::string(""))
             }),
             [](const PropertyList& properties) -> ReturnValue {
                 auto url = properties["url"].value<std::string>();
+                auto sha256 = properties["sha256"].value<std::string>();
                 Settings settings("assets", true);
                 settings.SetString("download_url", url);
+                settings.SetString("download_sha256", sha256);
                 return true;
             });
     }
@@ -345,6 +341,43 @@ void McpServer::ParseCapabilities(const cJSON* capabilities) {
                     token_str = std::string(token->valuestring);
                 }
                 camera->SetExplainUrl(url_str, token_str);
+
+                // Optional encoding hints: { "quality", "max_width", "max_height", "max_bytes", "roi": { "x", "y", "width", "height" } }
+                CameraEncodeOptions options;
+                auto quality = cJSON_GetObjectItem(vision, "quality");
+                if (cJSON_IsNumber(quality) && quality->valueint >= 1 && quality->valueint <= 100) {
+                    options.quality = quality->valueint;
+                }
+                auto max_width = cJSON_GetObjectItem(vision, "max_width");
+                if (cJSON_IsNumber(max_width) && max_width->valueint > 0) {
+                    options.max_width = std::min(max_width->valueint, (int)UINT16_MAX);
+                }
+                auto max_height = cJSON_GetObjectItem(vision, "max_height");
+                if (cJSON_IsNumber(max_height) && max_height->valueint > 0) {
+                    options.max_height = std::min(max_height->valueint, (int)UINT16_MAX);
+                }
+                auto max_bytes = cJSON_GetObjectItem(vision, "max_bytes");
+                if (cJSON_IsNumber(max_bytes) && max_bytes->valueint > 0) {
+                    options.max_bytes = max_bytes->valueint;
+                }
+                auto roi = cJSON_GetObjectItem(vision, "roi");
+                if (cJSON_IsObject(roi)) {
+                    auto x = cJSON_GetObjectItem(roi, "x");
+                    auto y = cJSON_GetObjectItem(roi, "y");
+                    auto width = cJSON_GetObjectItem(roi, "width");
+                    auto height = cJSON_GetObjectItem(roi, "height");
+                    // Fractions of the frame, anything that is not a finite number is ignored
+                    auto fraction = [](const cJSON* item) { return std::clamp(item->valuedouble, 0.0, 1.0); };
+                    if (cJSON_IsNumber(x) && cJSON_IsNumber(y) && cJSON_IsNumber(width) && cJSON_IsNumber(height) &&
+                        std::isfinite(x->valuedouble) && std::isfinite(y->valuedouble) &&
+                        std::isfinite(width->valuedouble) && std::isfinite(height->valuedouble)) {
+                        options.roi_x = fraction(x);
+                        options.roi_y = fraction(y);
+                        options.roi_width = fraction(width);
+                        options.roi_height = fraction(height);
+                    }
+                }
+                camera->SetEncodeOptions(options);
             }
         }
     }
@@ -559,5 +592,5 @@ void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* to
             ESP_LOGE(TAG, "tools/call: %s", e.what());
             ReplyError(id, e.what());
         }
-    });
+    }, kSchedulePriorityTool);
 }
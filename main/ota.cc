@@ -1,6 +1,8 @@
 #include "ota.h"
 #include "system_info.h"
 #include "settings.h"
+#include "delta_patch.h"
+#include "downloader.h"
 #include "assets/lang_config.h"
 
 #include <cJSON.h>
@@ -8,6 +10,7 @@
 #include <esp_partition.h>
 #include <esp_ota_ops.h>
 #include <esp_app_format.h>
+#include <esp_image_format.h>
 #include <esp_efuse.h>
 #include <esp_efuse_table.h>
 #ifdef SOC_HMAC_SUPPORTED
@@ -64,6 +67,8 @@ std::unique_ptr<Http> Ota::SetupHttp() {
     http->SetHeader("User-Agent", user_agent);
     http->SetHeader("Accept-Language", Lang::CODE);
     http->SetHeader("Content-Type", "application/json");
+    // Tell the server that firmware.url may point to a delta patch against the running image
+    http->SetHeader("Accept-Delta", "xzdp/" + std::to_string(DELTA_PATCH_VERSION));
 
     return http;
 }
@@ -261,108 +266,104 @@ void Ota::MarkCurrentVersionValid() {
     }
 }
 
-bool Ota::Upgrade(const std::string& firmware_url, std::function<void(int progress, size_t speed)> callback) {
+bool Ota::Upgrade(const std::string& firmware_url, std::function<void(int progress, size_t speed)> callback,
+    size_t rate_limit, std::function<bool()> pause_check) {
     ESP_LOGI(TAG, "Upgrading firmware from %s", firmware_url.c_str());
-    esp_ota_handle_t update_handle = 0;
     auto update_partition = esp_ota_get_next_update_partition(NULL);
     if (update_partition == NULL) {
         ESP_LOGE(TAG, "Failed to get update partition");
         return false;
     }
 
-    ESP_LOGI(TAG, "Writing to partition %s at offset 0x%lx", update_partition->label, update_partition->address);
-    bool image_header_checked = false;
-    std::string image_header;
-
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(0);
-    if (!http->Open("GET", firmware_url)) {
-        ESP_LOGE(TAG, "Failed to open HTTP connection");
+    // Full images are written straight to the partition so an interrupted download can
+    // resume, which bypasses esp_ota_begin/esp_ota_end. Repeat their checks here.
+    auto running_partition = esp_ota_get_running_partition();
+    if (update_partition == running_partition) {
+        ESP_LOGE(TAG, "Update partition %s is the running partition", update_partition->label);
         return false;
     }
-
-    if (http->GetStatusCode() != 200) {
-        ESP_LOGE(TAG, "Failed to get firmware, status code: %d", http->GetStatusCode());
-        return false;
-    }
-
-    size_t content_length = http->GetBodyLength();
-    if (content_length == 0) {
-        ESP_LOGE(TAG, "Failed to get content length");
+#ifdef CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+    esp_ota_img_states_t running_state;
+    if (esp_ota_get_state_partition(running_partition, &running_state) == ESP_OK &&
+        running_state == ESP_OTA_IMG_PENDING_VERIFY) {
+        ESP_LOGE(TAG, "Running firmware is pending verification, mark it valid before upgrading");
         return false;
     }
+#endif
 
-    char buffer[512];
-    size_t total_read = 0, recent_read = 0;
-    auto last_calc_time = esp_timer_get_time();
-    while (true) {
-        int ret = http->Read(buffer, sizeof(buffer));
-        if (ret < 0) {
-            ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
-            return false;
-        }
+    ESP_LOGI(TAG, "Writing to partition %s at offset 0x%lx", update_partition->label, update_partition->address);
 
-        // Calculate speed and progress every second
-        recent_read += ret;
-        total_read += ret;
-        if (esp_timer_get_time() - last_calc_time >= 1000000 || ret == 0) {
-            size_t progress = total_read * 100 / content_length;
-            ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %uB/s", progress, total_read, content_length, recent_read);
-            if (callback) {
-                callback(progress, recent_read);
+    bool patched = false;
+    Downloader downloader(update_partition, "ota");
+    downloader.SetFirstBlockHandler([update_partition, &patched](const char* data, size_t size, Downloader::ReadFunction read) {
+        if (DeltaPatch::IsPatch(data, size)) {
+            // Patches are small and applied while streaming, they are not checkpointed
+            esp_ota_handle_t update_handle = 0;
+            if (esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle)) {
+                esp_ota_abort(update_handle);
+                ESP_LOGE(TAG, "Failed to begin OTA");
+                return Downloader::kFirstBlockAbort;
+            }
+            DeltaPatch patch(esp_ota_get_running_partition(), update_handle, read);
+            if (!patch.Apply(data, size)) {
+                esp_ota_abort(update_handle);
+                return Downloader::kFirstBlockAbort;
             }
-            last_calc_time = esp_timer_get_time();
-            recent_read = 0;
+            esp_err_t err = esp_ota_end(update_handle);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to end OTA: %s", esp_err_to_name(err));
+                return Downloader::kFirstBlockAbort;
+            }
+            patched = true;
+            return Downloader::kFirstBlockHandled;
         }
 
-        if (ret == 0) {
-            break;
+        if (size < sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t) ||
+            ((const esp_image_header_t*)data)->magic != ESP_IMAGE_HEADER_MAGIC) {
+            ESP_LOGE(TAG, "Invalid firmware image header");
+            return Downloader::kFirstBlockAbort;
         }
+        esp_app_desc_t new_app_info;
+        memcpy(&new_app_info, data + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(esp_app_desc_t));
+        auto current_version = esp_app_get_description()->version;
+        ESP_LOGI(TAG, "Current version: %s, New version: %s", current_version, new_app_info.version);
+        return Downloader::kFirstBlockWrite;
+    });
+
+    downloader.SetRateLimit(rate_limit);
+    if (pause_check) {
+        // A paused download may lose its connection, allow more attempts to resume it
+        downloader.SetPauseCheck(pause_check);
+        downloader.SetMaxAttempts(10);
+    }
+    if (!downloader.Download(firmware_url, callback)) {
+        ESP_LOGE(TAG, "Failed to download firmware%s", downloader.resumable() ? ", will resume next time" : "");
+        return false;
+    }
 
-        if (!image_header_checked) {
-            image_header.append(buffer, ret);
-            if (image_header.size() >= sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
-                esp_app_desc_t new_app_info;
-                memcpy(&new_app_info, image_header.data() + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(esp_app_desc_t));
-                
-                auto current_version = esp_app_get_description()->version;
-                ESP_LOGI(TAG, "Current version: %s, New version: %s", current_version, new_app_info.version);
-
-                if (esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle)) {
-                    esp_ota_abort(update_handle);
-                    ESP_LOGE(TAG, "Failed to begin OTA");
-                    return false;
-                }
-
-                image_header_checked = true;
-                std::string().swap(image_header);
-            }
-        }
-        auto err = esp_ota_write(update_handle, buffer, ret);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to write OTA data: %s", esp_err_to_name(err));
-            esp_ota_abort(update_handle);
+    // Patches were validated by esp_ota_end, a full image is validated like esp_ota_end does
+    if (!patched) {
+        esp_partition_pos_t part_pos = {
+            .offset = update_partition->address,
+            .size = update_partition->size,
+        };
+        esp_image_metadata_t metadata;
+        if (esp_image_verify(ESP_IMAGE_VERIFY, &part_pos, &metadata) != ESP_OK) {
+            ESP_LOGE(TAG, "Image validation failed, image is corrupted");
             return false;
         }
     }
-    http->Close();
 
-    esp_err_t err = esp_ota_end(update_handle);
+    esp_err_t err = esp_ota_set_boot_partition(update_partition);
     if (err != ESP_OK) {
         if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
             ESP_LOGE(TAG, "Image validation failed, image is corrupted");
         } else {
-            ESP_LOGE(TAG, "Failed to end OTA: %s", esp_err_to_name(err));
+            ESP_LOGE(TAG, "Failed to set boot partition: %s", esp_err_to_name(err));
         }
         return false;
     }
 
-    err = esp_ota_set_boot_partition(update_partition);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to set boot partition: %s", esp_err_to_name(err));
-        return false;
-    }
-
     ESP_LOGI(TAG, "Firmware upgrade successful");
     return true;
 }
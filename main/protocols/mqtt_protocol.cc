@@ -10,6 +10,18 @@
 
 #define TAG "MQTT"
 
+// GCM is only offered when this build of mbedtls passes the known answer test, checked once
+static bool IsGcmSupported() {
+    static const bool supported = [] {
+        bool ok = UdpAudioGcmSelfTest();
+        if (!ok) {
+            ESP_LOGW(TAG, "AES-GCM self test failed, only aes-128-ctr is offered");
+        }
+        return ok;
+    }();
+    return supported;
+}
+
 MqttProtocol::MqttProtocol() {
     event_group_handle_ = xEventGroupCreate();
 
@@ -46,6 +58,7 @@ MqttProtocol::~MqttProtocol() {
 
     udp_.reset();
     mqtt_.reset();
+    DeinitializeCrypto();
     
     if (event_group_handle_ != nullptr) {
         vEventGroupDelete(event_group_handle_);
@@ -121,7 +134,7 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
                     if (*alive) {
                         CloseAudioChannel();
                     }
-                });
+                }, kSchedulePriorityState);
             }
         } else if (on_incoming_json_ != nullptr) {
             on_incoming_json_(root);
@@ -168,32 +181,40 @@ bool MqttProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
         return false;
     }
 
-    std::string nonce(aes_nonce_);
-    *(uint16_t*)&nonce[2] = htons(packet->payload.size());
-    *(uint32_t*)&nonce[8] = htonl(packet->timestamp);
-    *(uint32_t*)&nonce[12] = htonl(++local_sequence_);
-
-    std::string encrypted;
-    encrypted.resize(aes_nonce_.size() + packet->payload.size());
-    memcpy(encrypted.data(), nonce.data(), nonce.size());
-
-    size_t nc_off = 0;
-    uint8_t stream_block[16] = {0};
-    if (mbedtls_aes_crypt_ctr(&aes_ctx_, packet->payload.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
-        (uint8_t*)packet->payload.data(), (uint8_t*)&encrypted[nonce.size()]) != 0) {
-        ESP_LOGE(TAG, "Failed to encrypt audio data");
+    // Build the datagram in the reused buffer and encrypt straight into it
+    size_t payload_size = packet->payload.size();
+    size_t tag_size = use_gcm_ ? MQTT_UDP_GCM_TAG_SIZE : 0;
+    send_buffer_.resize(MQTT_UDP_HEADER_SIZE + payload_size + tag_size);
+    auto header = (uint8_t*)send_buffer_.data();
+    memcpy(header, aes_nonce_.data(), MQTT_UDP_HEADER_SIZE);
+    if (use_gcm_) {
+        header[1] |= MQTT_UDP_FLAG_UPLINK;
+    }
+    *(uint16_t*)&header[2] = htons(payload_size);
+    *(uint32_t*)&header[8] = htonl(packet->timestamp);
+    *(uint32_t*)&header[12] = htonl(++local_sequence_);
+    int ret = UdpAudioEncrypt(&aes_ctx_, use_gcm_ ? &gcm_send_ctx_ : nullptr, header, packet->payload.data(),
+        payload_size, header + MQTT_UDP_HEADER_SIZE);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Failed to encrypt audio data, ret: %d", ret);
         return false;
     }
 
-    return udp_->Send(encrypted) > 0;
+    return udp_->Send(send_buffer_) > 0;
 }
 
 void MqttProtocol::CloseAudioChannel() {
+    bool had_udp = false;
     {
         std::lock_guard<std::mutex> lock(channel_mutex_);
+        had_udp = udp_ != nullptr;
         udp_.reset();
     }
 
+    if (had_udp && replay_window_.GetStats().received > 0) {
+        SendText(GetUdpStatsMessage(true));
+    }
+
     std::string message = "{";
     message += "\"session_id\":\"" + session_id_ + "\",";
     message += "\"type\":\"goodbye\"";
@@ -239,7 +260,8 @@ bool MqttProtocol::OpenAudioChannel() {
          * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
          * |payload payload_len|
          */
-        if (data.size() < sizeof(aes_nonce_)) {
+        size_t tag_size = use_gcm_ ? MQTT_UDP_GCM_TAG_SIZE : 0;
+        if (data.size() < MQTT_UDP_HEADER_SIZE + tag_size) {
             ESP_LOGE(TAG, "Invalid audio packet size: %u", data.size());
             return;
         }
@@ -247,35 +269,50 @@ bool MqttProtocol::OpenAudioChannel() {
             ESP_LOGE(TAG, "Invalid audio packet type: %x", data[0]);
             return;
         }
-        uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
-        uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
-        if (sequence < remote_sequence_) {
-            ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_);
+        // A downlink packet carrying the uplink bit would reuse an IV of our own packets
+        if (use_gcm_ && (data[1] & MQTT_UDP_FLAG_UPLINK)) {
+            ESP_LOGE(TAG, "Invalid audio packet flags: %x", data[1]);
             return;
         }
-        if (sequence != remote_sequence_ + 1) {
-            ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
-        }
+        uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
+        uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
 
-        size_t decrypted_size = data.size() - aes_nonce_.size();
-        size_t nc_off = 0;
-        uint8_t stream_block[16] = {0};
-        auto nonce = (uint8_t*)data.data();
-        auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
+        size_t decrypted_size = data.size() - MQTT_UDP_HEADER_SIZE - tag_size;
+        auto header = (const uint8_t*)data.data();
+        auto encrypted = header + MQTT_UDP_HEADER_SIZE;
         auto packet = std::make_unique<AudioStreamPacket>();
         packet->sample_rate = server_sample_rate_;
         packet->frame_duration = server_frame_duration_;
         packet->timestamp = timestamp;
         packet->payload.resize(decrypted_size);
-        int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, (uint8_t*)packet->payload.data());
+        int ret = UdpAudioDecrypt(&aes_ctx_, use_gcm_ ? &gcm_recv_ctx_ : nullptr, header, encrypted, decrypted_size,
+            packet->payload.data());
         if (ret != 0) {
             ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
             return;
         }
+
+        // Only authenticated packets may advance the replay window
+        if (!replay_window_.Check(sequence)) {
+            ESP_LOGW(TAG, "Dropped duplicate or too old audio packet, sequence: %lu", sequence);
+            return;
+        }
+
+        // Periodically report the receive statistics so that the server can adapt to the link
+        auto now = esp_timer_get_time();
+        if (now - last_stats_report_time_ >= MQTT_UDP_STATS_INTERVAL_MS * 1000) {
+            last_stats_report_time_ = now;
+            auto alive = alive_;  // Capture alive flag
+            Application::GetInstance().Schedule([this, alive, message = GetUdpStatsMessage(false)]() {
+                if (*alive) {
+                    SendText(message);
+                }
+            });
+        }
+
         if (on_incoming_audio_ != nullptr) {
             on_incoming_audio_(std::move(packet));
         }
-        remote_sequence_ = sequence;
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
@@ -298,6 +335,9 @@ std::string MqttProtocol::GetHelloMessage() {
     cJSON_AddBoolToObject(features, "aec", true);
 #endif
     cJSON_AddBoolToObject(features, "mcp", true);
+    if (IsGcmSupported()) {
+        cJSON_AddBoolToObject(features, "aes_gcm", true);
+    }
     cJSON_AddItemToObject(root, "features", features);
     cJSON* audio_params = cJSON_CreateObject();
     cJSON_AddStringToObject(audio_params, "format", "opus");
@@ -312,6 +352,17 @@ std::string MqttProtocol::GetHelloMessage() {
     return message;
 }
 
+std::string MqttProtocol::GetUdpStatsMessage(bool final) {
+    auto stats = replay_window_.GetStats(final);
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+        "{\"session_id\":\"%s\",\"type\":\"udp_stats\",\"final\":%s,\"received\":%lu,\"lost\":%lu,"
+        "\"reordered\":%lu,\"duplicate\":%lu,\"too_old\":%lu,\"highest_sequence\":%lu}",
+        session_id_.c_str(), final ? "true" : "false", stats.received, stats.lost,
+        stats.reordered, stats.duplicate, stats.too_old, stats.highest_sequence);
+    return buffer;
+}
+
 void MqttProtocol::ParseServerHello(const cJSON* root) {
     auto transport = cJSON_GetObjectItem(root, "transport");
     if (transport == nullptr || strcmp(transport->valuestring, "udp") != 0) {
@@ -348,16 +399,65 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
     auto key = cJSON_GetObjectItem(udp, "key")->valuestring;
     auto nonce = cJSON_GetObjectItem(udp, "nonce")->valuestring;
 
-    // auto encryption = cJSON_GetObjectItem(udp, "encryption")->valuestring;
-    // ESP_LOGI(TAG, "UDP server: %s, port: %d, encryption: %s", udp_server_.c_str(), udp_port_, encryption);
+    auto encryption = cJSON_GetObjectItem(udp, "encryption");
+    bool use_gcm = cJSON_IsString(encryption) && strcmp(encryption->valuestring, "aes-128-gcm") == 0;
+
     aes_nonce_ = DecodeHexString(nonce);
-    mbedtls_aes_init(&aes_ctx_);
-    mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)DecodeHexString(key).c_str(), 128);
+    if (aes_nonce_.size() != MQTT_UDP_HEADER_SIZE) {
+        ESP_LOGE(TAG, "Invalid nonce size: %u", aes_nonce_.size());
+        return;
+    }
+    if (use_gcm && !IsGcmSupported()) {
+        ESP_LOGE(TAG, "The server selected aes-128-gcm, which was not offered");
+        return;
+    }
+    if (!InitializeCrypto(DecodeHexString(key), use_gcm)) {
+        return;
+    }
     local_sequence_ = 0;
-    remote_sequence_ = 0;
+    replay_window_.Reset();
+    last_stats_report_time_ = esp_timer_get_time();
     xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 }
 
+bool MqttProtocol::InitializeCrypto(const std::string& key, bool use_gcm) {
+    // Stop receiving from the previous session before the contexts are replaced
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    udp_.reset();
+    DeinitializeCrypto();
+
+    // mbedtls runs the AES block operations on the AES peripheral (CONFIG_MBEDTLS_HARDWARE_AES, the IDF default)
+    mbedtls_aes_init(&aes_ctx_);
+    mbedtls_gcm_init(&gcm_send_ctx_);
+    mbedtls_gcm_init(&gcm_recv_ctx_);
+    crypto_initialized_ = true;
+    int ret = key.size() == 16 ? mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)key.data(), 128) : -1;
+    if (ret == 0 && use_gcm) {
+        ret = mbedtls_gcm_setkey(&gcm_send_ctx_, MBEDTLS_CIPHER_ID_AES, (const unsigned char*)key.data(), 128);
+    }
+    if (ret == 0 && use_gcm) {
+        ret = mbedtls_gcm_setkey(&gcm_recv_ctx_, MBEDTLS_CIPHER_ID_AES, (const unsigned char*)key.data(), 128);
+    }
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Failed to set the UDP key (%u bytes), ret: %d", key.size(), ret);
+        DeinitializeCrypto();
+        return false;
+    }
+    use_gcm_ = use_gcm;
+    ESP_LOGI(TAG, "UDP encryption: %s", use_gcm ? "aes-128-gcm" : "aes-128-ctr");
+    return true;
+}
+
+void MqttProtocol::DeinitializeCrypto() {
+    if (!crypto_initialized_) {
+        return;
+    }
+    mbedtls_aes_free(&aes_ctx_);
+    mbedtls_gcm_free(&gcm_send_ctx_);
+    mbedtls_gcm_free(&gcm_recv_ctx_);
+    crypto_initialized_ = false;
+}
+
 static const char hex_chars[] = "0123456789ABCDEF";
 // 辅助函数，将单个十六进制字符转换为对应的数值
 static inline uint8_t CharToHex(char c) {
@@ -3,10 +3,11 @@
 
 
 #include "protocol.h"
+#include "replay_window.h"
+#include "udp_audio_cipher.h"
 #include <mqtt.h>
 #include <udp.h>
 #include <cJSON.h>
-#include <mbedtls/aes.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 #include <esp_timer.h>
@@ -20,6 +21,7 @@
 
 #define MQTT_PING_INTERVAL_SECONDS 90
 #define MQTT_RECONNECT_INTERVAL_MS 60000
+#define MQTT_UDP_STATS_INTERVAL_MS 5000
 
 #define MQTT_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
 
@@ -46,19 +48,30 @@ private:
     std::unique_ptr<Mqtt> mqtt_;
     std::unique_ptr<Udp> udp_;
     mbedtls_aes_context aes_ctx_;
+    // GCM contexts keep per-operation state, so sending and receiving use separate ones
+    mbedtls_gcm_context gcm_send_ctx_;
+    mbedtls_gcm_context gcm_recv_ctx_;
+    bool use_gcm_ = false;
+    bool crypto_initialized_ = false;
     std::string aes_nonce_;
+    // Reused datagram buffer, encrypted in place to avoid per-packet allocations
+    std::string send_buffer_;
     std::string udp_server_;
     int udp_port_;
     uint32_t local_sequence_;
-    uint32_t remote_sequence_;
+    ReplayWindow replay_window_;
+    int64_t last_stats_report_time_ = 0;
     esp_timer_handle_t reconnect_timer_;
 
     bool StartMqttClient(bool report_error=false);
     void ParseServerHello(const cJSON* root);
     std::string DecodeHexString(const std::string& hex_string);
+    bool InitializeCrypto(const std::string& key, bool use_gcm);
+    void DeinitializeCrypto();
 
     bool SendText(const std::string& text) override;
     std::string GetHelloMessage();
+    std::string GetUdpStatsMessage(bool final);
 };
 
 
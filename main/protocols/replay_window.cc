@@ -0,0 +1,50 @@
+#include "replay_window.h"
+
+void ReplayWindow::Reset() {
+    highest_ = 0;
+    // Sequence numbers start from 1, treat everything before as received
+    bitmap_ = ~0ULL;
+    stats_ = ReplayWindowStats();
+}
+
+bool ReplayWindow::Check(uint32_t sequence) {
+    if (sequence > highest_) {
+        uint32_t shift = sequence - highest_;
+        if (shift < kWindowSize) {
+            // Count the unreceived sequences shifted out of the window
+            uint64_t leaving = bitmap_ >> (kWindowSize - shift);
+            stats_.lost += shift - __builtin_popcountll(leaving);
+            bitmap_ = (bitmap_ << shift) | 1;
+        } else {
+            stats_.lost += (kWindowSize - __builtin_popcountll(bitmap_)) + (shift - kWindowSize);
+            bitmap_ = 1;
+        }
+        highest_ = sequence;
+        stats_.highest_sequence = sequence;
+        stats_.received++;
+        return true;
+    }
+
+    uint32_t offset = highest_ - sequence;
+    if (offset >= kWindowSize) {
+        stats_.too_old++;
+        return false;
+    }
+    uint64_t mask = 1ULL << offset;
+    if (bitmap_ & mask) {
+        stats_.duplicate++;
+        return false;
+    }
+    bitmap_ |= mask;
+    stats_.reordered++;
+    stats_.received++;
+    return true;
+}
+
+ReplayWindowStats ReplayWindow::GetStats(bool final) const {
+    auto stats = stats_;
+    if (final) {
+        stats.lost += kWindowSize - __builtin_popcountll(bitmap_);
+    }
+    return stats;
+}
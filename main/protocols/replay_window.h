@@ -0,0 +1,39 @@
+#ifndef REPLAY_WINDOW_H
+#define REPLAY_WINDOW_H
+
+#include <cstdint>
+
+struct ReplayWindowStats {
+    uint32_t received = 0;    // Accepted packets
+    uint32_t lost = 0;        // Packets that left the window without arriving
+    uint32_t reordered = 0;   // Accepted packets that arrived behind a newer one
+    uint32_t duplicate = 0;   // Rejected, already received
+    uint32_t too_old = 0;     // Rejected, behind the window
+    uint32_t highest_sequence = 0;
+};
+
+/**
+ * Sliding-window anti-replay check for incoming sequence numbers (RFC 4303, section 3.4.3).
+ * Packets newer than the highest sequence advance the window; packets inside the window
+ * are accepted once, so reordered datagrams are not dropped.
+ */
+class ReplayWindow {
+public:
+    static constexpr uint32_t kWindowSize = 64;
+
+    void Reset();
+
+    // Returns true if the packet should be processed
+    bool Check(uint32_t sequence);
+
+    // Statistics; lost includes packets still missing inside the window if final is true
+    ReplayWindowStats GetStats(bool final = false) const;
+
+private:
+    uint32_t highest_ = 0;
+    // Bit i is set if sequence (highest_ - i) has been received
+    uint64_t bitmap_ = ~0ULL;
+    ReplayWindowStats stats_;
+};
+
+#endif // REPLAY_WINDOW_H
@@ -0,0 +1,95 @@
+#ifndef UDP_AUDIO_CIPHER_H
+#define UDP_AUDIO_CIPHER_H
+
+#include <mbedtls/aes.h>
+#include <mbedtls/gcm.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// UDP audio packet header, also used as the AES counter block / GCM IV
+#define MQTT_UDP_HEADER_SIZE 16
+#define MQTT_UDP_GCM_TAG_SIZE 16
+// Flags bit of device to server packets in GCM mode, so the two directions never share an IV
+#define MQTT_UDP_FLAG_UPLINK 0x01
+
+/**
+ * Payload encryption of the UDP audio packets, shared by MqttProtocol and the host
+ * benchmark in scripts/host_tests.
+ *
+ * With a GCM context the packet is AES-GCM with the header as the IV and the tag after
+ * the payload, otherwise AES-CTR with the header as the initial counter block.
+ * Output may be a buffer other than the input, so the datagram is built in place.
+ */
+inline int UdpAudioEncrypt(mbedtls_aes_context* aes, mbedtls_gcm_context* gcm, const uint8_t* header,
+                           const uint8_t* input, size_t size, uint8_t* output) {
+    if (gcm != nullptr) {
+        return mbedtls_gcm_crypt_and_tag(gcm, MBEDTLS_GCM_ENCRYPT, size, header, MQTT_UDP_HEADER_SIZE, nullptr, 0,
+            input, output, MQTT_UDP_GCM_TAG_SIZE, output + size);
+    }
+    // The cipher advances the counter block, so keep the header intact
+    uint8_t counter[MQTT_UDP_HEADER_SIZE];
+    memcpy(counter, header, sizeof(counter));
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    return mbedtls_aes_crypt_ctr(aes, size, &nc_off, counter, stream_block, input, output);
+}
+
+// size excludes the GCM tag, which follows the input. Fails if the tag does not match.
+inline int UdpAudioDecrypt(mbedtls_aes_context* aes, mbedtls_gcm_context* gcm, const uint8_t* header,
+                           const uint8_t* input, size_t size, uint8_t* output) {
+    if (gcm != nullptr) {
+        return mbedtls_gcm_auth_decrypt(gcm, size, header, MQTT_UDP_HEADER_SIZE, nullptr, 0,
+            input + size, MQTT_UDP_GCM_TAG_SIZE, input, output);
+    }
+    uint8_t counter[MQTT_UDP_HEADER_SIZE];
+    memcpy(counter, header, sizeof(counter));
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    return mbedtls_aes_crypt_ctr(aes, size, &nc_off, counter, stream_block, input, output);
+}
+
+/**
+ * Known answer test of AES-128-GCM, so GCM is only offered when this build of mbedtls has it
+ * and it produces the standard output. The first vector is test case 2 of the GCM
+ * specification (96-bit IV), the second uses a 16-byte IV as the packets do and was
+ * computed with OpenSSL.
+ */
+inline bool UdpAudioGcmSelfTest() {
+    static const uint8_t key[16] = {0};
+    static const uint8_t plain[16] = {0};
+    static const struct {
+        uint8_t iv[MQTT_UDP_HEADER_SIZE];
+        size_t iv_len;
+        uint8_t cipher[16];
+        uint8_t tag[16];
+    } vectors[] = {
+        {
+            {0}, 12,
+            {0x03, 0x88, 0xda, 0xce, 0x60, 0xb6, 0xa3, 0x92, 0xf3, 0x28, 0xc2, 0xb9, 0x71, 0xb2, 0xfe, 0x78},
+            {0xab, 0x6e, 0x47, 0xd4, 0x2c, 0xec, 0x13, 0xbd, 0xf5, 0x3a, 0x67, 0xb2, 0x12, 0x57, 0xbd, 0xdf},
+        },
+        {
+            {0x01, 0x01, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x00, 0x00, 0x01}, 16,
+            {0x9c, 0xfc, 0x0d, 0x25, 0x63, 0xed, 0xd1, 0xb3, 0xdb, 0x84, 0x8c, 0xf8, 0xb0, 0x47, 0xba, 0x1d},
+            {0xed, 0x6d, 0x02, 0x8d, 0x57, 0xe1, 0xe1, 0xfb, 0x3e, 0x88, 0x22, 0x88, 0x6f, 0x50, 0x4c, 0x78},
+        },
+    };
+
+    mbedtls_gcm_context gcm;
+    mbedtls_gcm_init(&gcm);
+    bool ok = mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, key, 128) == 0;
+    for (const auto& v : vectors) {
+        uint8_t cipher[16], tag[16], decrypted[16];
+        ok = ok && mbedtls_gcm_crypt_and_tag(&gcm, MBEDTLS_GCM_ENCRYPT, sizeof(plain), v.iv, v.iv_len, nullptr, 0,
+            plain, cipher, sizeof(tag), tag) == 0;
+        ok = ok && memcmp(cipher, v.cipher, sizeof(cipher)) == 0 && memcmp(tag, v.tag, sizeof(tag)) == 0;
+        ok = ok && mbedtls_gcm_auth_decrypt(&gcm, sizeof(cipher), v.iv, v.iv_len, nullptr, 0, v.tag, sizeof(tag),
+            v.cipher, decrypted) == 0 && memcmp(decrypted, plain, sizeof(plain)) == 0;
+    }
+    mbedtls_gcm_free(&gcm);
+    return ok;
+}
+
+#endif // UDP_AUDIO_CIPHER_H
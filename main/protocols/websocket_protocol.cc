@@ -7,6 +7,7 @@
 #include <cstring>
 #include <cJSON.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <arpa/inet.h>
 #include "assets/lang_config.h"
 
@@ -21,7 +22,14 @@ WebsocketProtocol::~WebsocketProtocol() {
 }
 
 bool WebsocketProtocol::Start() {
-    // Only connect to server when audio channel is needed
+#if CONFIG_WEBSOCKET_KEEP_WARM
+    // Establish the idle connection in advance, so the first conversation skips the handshake
+    if (!Connect()) {
+        ESP_LOGW(TAG, "Failed to warm up websocket connection, will connect on demand");
+        error_occurred_ = false;
+    }
+#endif
+    // Otherwise only connect to server when audio channel is needed
     return true;
 }
 
@@ -72,14 +80,95 @@ bool WebsocketProtocol::SendText(const std::string& text) {
 }
 
 bool WebsocketProtocol::IsAudioChannelOpened() const {
-    return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
+    return websocket_ != nullptr && websocket_->IsConnected() && audio_channel_opened_ && !error_occurred_ && !IsTimeout();
 }
 
 void WebsocketProtocol::CloseAudioChannel() {
+#if CONFIG_WEBSOCKET_KEEP_WARM
+    // Keep the connection for the next conversation and only end the session
+    if (websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_) {
+        if (audio_channel_opened_) {
+            audio_channel_opened_ = false;
+            SendText("{\"session_id\":\"" + session_id_ + "\",\"type\":\"goodbye\"}");
+            if (on_audio_channel_closed_ != nullptr) {
+                on_audio_channel_closed_();
+            }
+        }
+        return;
+    }
+#endif
     websocket_.reset();
+    audio_channel_opened_ = false;
 }
 
 bool WebsocketProtocol::OpenAudioChannel() {
+    auto start_time = esp_timer_get_time();
+    error_occurred_ = false;
+    audio_channel_opened_ = false;
+
+    bool warm = false;
+#if CONFIG_WEBSOCKET_KEEP_WARM
+    warm = websocket_ != nullptr && websocket_->IsConnected();
+    if (warm) {
+        // A warm connection may have been dropped silently, fall back to a new one quickly
+        last_incoming_time_ = std::chrono::steady_clock::now();
+        if (!SendHelloAndWait(3000, false)) {
+            ESP_LOGW(TAG, "Warm connection did not respond, reconnecting");
+            websocket_.reset();
+            warm = false;
+        }
+    }
+#endif
+
+    int64_t connect_us = 0;
+    if (!warm) {
+        auto connect_start = esp_timer_get_time();
+        if (!Connect()) {
+            return false;
+        }
+        connect_us = esp_timer_get_time() - connect_start;
+        if (!SendHelloAndWait(10000, true)) {
+            return false;
+        }
+    }
+
+    audio_channel_opened_ = true;
+    ESP_LOGI(TAG, "Audio channel opened in %dms (%s, connect=%dms)", (int)((esp_timer_get_time() - start_time) / 1000),
+        warm ? "warm" : "cold", (int)(connect_us / 1000));
+
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
+
+    return true;
+}
+
+bool WebsocketProtocol::SendHelloAndWait(int timeout_ms, bool report_error) {
+    xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
+
+    // Send hello message to describe the client
+    auto message = GetHelloMessage();
+    if (report_error) {
+        if (!SendText(message)) {
+            return false;
+        }
+    } else if (!websocket_->Send(message)) {
+        return false;
+    }
+
+    // Wait for server hello
+    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(timeout_ms));
+    if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
+        ESP_LOGE(TAG, "Failed to receive server hello");
+        if (report_error) {
+            SetError(Lang::Strings::SERVER_TIMEOUT);
+        }
+        return false;
+    }
+    return true;
+}
+
+bool WebsocketProtocol::Connect() {
     Settings settings("websocket", false);
     std::string url = settings.GetString("url");
     std::string token = settings.GetString("token");
@@ -88,8 +177,6 @@ bool WebsocketProtocol::OpenAudioChannel() {
         version_ = version;
     }
 
-    error_occurred_ = false;
-
     auto network = Board::GetInstance().GetNetwork();
     websocket_ = network->CreateWebSocket(1);
     if (websocket_ == nullptr) {
@@ -166,6 +253,13 @@ bool WebsocketProtocol::OpenAudioChannel() {
 
     websocket_->OnDisconnected([this]() {
         ESP_LOGI(TAG, "Websocket disconnected");
+#if CONFIG_WEBSOCKET_KEEP_WARM
+        // Losing an idle warm connection does not close any conversation
+        if (!audio_channel_opened_) {
+            return;
+        }
+        audio_channel_opened_ = false;
+#endif
         if (on_audio_channel_closed_ != nullptr) {
             on_audio_channel_closed_();
         }
@@ -177,25 +271,6 @@ bool WebsocketProtocol::OpenAudioChannel() {
         SetError(Lang::Strings::SERVER_NOT_CONNECTED);
         return false;
     }
-
-    // Send hello message to describe the client
-    auto message = GetHelloMessage();
-    if (!SendText(message)) {
-        return false;
-    }
-
-    // Wait for server hello
-    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
-    if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
-        ESP_LOGE(TAG, "Failed to receive server hello");
-        SetError(Lang::Strings::SERVER_TIMEOUT);
-        return false;
-    }
-
-    if (on_audio_channel_opened_ != nullptr) {
-        on_audio_channel_opened_();
-    }
-
     return true;
 }
 
@@ -204,6 +279,12 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON* root = cJSON_CreateObject();
     cJSON_AddStringToObject(root, "type", "hello");
     cJSON_AddNumberToObject(root, "version", version_);
+#if CONFIG_WEBSOCKET_KEEP_WARM
+    // Ask the server to resume the previous session on the same connection
+    if (!session_id_.empty()) {
+        cJSON_AddStringToObject(root, "session_id", session_id_.c_str());
+    }
+#endif
     cJSON* features = cJSON_CreateObject();
 #if CONFIG_USE_SERVER_AEC
     cJSON_AddBoolToObject(features, "aec", true);
@@ -25,7 +25,10 @@ private:
     EventGroupHandle_t event_group_handle_;
     std::unique_ptr<WebSocket> websocket_;
     int version_ = 1;
+    bool audio_channel_opened_ = false;
 
+    bool Connect();
+    bool SendHelloAndWait(int timeout_ms, bool report_error);
     void ParseServerHello(const cJSON* root);
     bool SendText(const std::string& text) override;
     std::string GetHelloMessage();
@@ -1,88 +1,295 @@
 #include "settings.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_system.h>
 #include <nvs_flash.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <map>
+#include <set>
+#include <mutex>
 
 #define TAG "Settings"
 
-Settings::Settings(const std::string& ns, bool read_write) : ns_(ns), read_write_(read_write) {
-    nvs_open(ns.c_str(), read_write_ ? NVS_READWRITE : NVS_READONLY, &nvs_handle_);
-}
+// Writes are committed once no change happened for this long
+#define SETTINGS_COMMIT_DELAY_MS 1000
 
-Settings::~Settings() {
-    if (nvs_handle_ != 0) {
-        if (read_write_ && dirty_) {
-            ESP_ERROR_CHECK(nvs_commit(nvs_handle_));
+namespace {
+
+class SettingsCache {
+public:
+    struct Entry {
+        nvs_type_t type;    // NVS_TYPE_I32, NVS_TYPE_U8 or NVS_TYPE_STR
+        int32_t number;
+        std::string text;
+    };
+
+    static SettingsCache& GetInstance() {
+        static SettingsCache instance;
+        return instance;
+    }
+
+    bool Get(const std::string& ns, const std::string& key, nvs_type_t type, Entry& entry) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& space = Load(ns);
+        auto it = space.entries.find(key);
+        if (it == space.entries.end() || it->second.type != type) {
+            return false;
         }
-        nvs_close(nvs_handle_);
+        entry = it->second;
+        return true;
     }
-}
 
-std::string Settings::GetString(const std::string& key, const std::string& default_value) {
-    if (nvs_handle_ == 0) {
-        return default_value;
+    void Set(const std::string& ns, const std::string& key, Entry entry) {
+        if (key.size() >= NVS_KEY_NAME_MAX_SIZE) {
+            ESP_LOGE(TAG, "Key %s in namespace %s is too long", key.c_str(), ns.c_str());
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& space = Load(ns);
+            space.entries[key] = std::move(entry);
+            space.dirty.insert(key);
+        }
+        ScheduleCommit();
     }
 
-    size_t length = 0;
-    if (nvs_get_str(nvs_handle_, key.c_str(), nullptr, &length) != ESP_OK) {
-        return default_value;
+    void Erase(const std::string& ns, const std::string& key) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& space = Load(ns);
+            // Also erases keys of types the cache does not hold, like the nvs call did
+            space.entries.erase(key);
+            space.dirty.insert(key);
+        }
+        ScheduleCommit();
     }
 
-    std::string value;
-    value.resize(length);
-    ESP_ERROR_CHECK(nvs_get_str(nvs_handle_, key.c_str(), value.data(), &length));
-    while (!value.empty() && value.back() == '\0') {
-        value.pop_back();
+    void EraseAll(const std::string& ns) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& space = Load(ns);
+            space.entries.clear();
+            space.dirty.clear();
+            space.erase_all = true;
+        }
+        ScheduleCommit();
+    }
+
+    void Commit() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& [ns, space] : namespaces_) {
+            if (!space.erase_all && space.dirty.empty()) {
+                continue;
+            }
+            nvs_handle_t handle;
+            esp_err_t err = nvs_open(ns.c_str(), NVS_READWRITE, &handle);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to open namespace %s: %s", ns.c_str(), esp_err_to_name(err));
+                continue;
+            }
+            if (space.erase_all) {
+                err = nvs_erase_all(handle);
+                if (err != ESP_OK) {
+                    ESP_LOGE(TAG, "Failed to erase namespace %s: %s", ns.c_str(), esp_err_to_name(err));
+                }
+            }
+            for (auto& key : space.dirty) {
+                auto it = space.entries.find(key);
+                if (it == space.entries.end()) {
+                    err = nvs_erase_key(handle, key.c_str());
+                    if (err == ESP_ERR_NVS_NOT_FOUND) {
+                        err = ESP_OK;
+                    }
+                } else if (it->second.type == NVS_TYPE_STR) {
+                    err = nvs_set_str(handle, key.c_str(), it->second.text.c_str());
+                } else if (it->second.type == NVS_TYPE_I32) {
+                    err = nvs_set_i32(handle, key.c_str(), it->second.number);
+                } else {
+                    err = nvs_set_u8(handle, key.c_str(), (uint8_t)it->second.number);
+                }
+                if (err != ESP_OK) {
+                    ESP_LOGE(TAG, "Failed to write %s/%s: %s", ns.c_str(), key.c_str(), esp_err_to_name(err));
+                }
+            }
+            err = nvs_commit(handle);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to commit namespace %s: %s", ns.c_str(), esp_err_to_name(err));
+            }
+            nvs_close(handle);
+            ESP_LOGD(TAG, "Committed %u changes to namespace %s", space.dirty.size(), ns.c_str());
+            space.dirty.clear();
+            space.erase_all = false;
+        }
+    }
+
+private:
+    struct Namespace {
+        std::map<std::string, Entry> entries;
+        std::set<std::string> dirty;    // Keys to write, or to erase when missing from entries
+        bool erase_all = false;
+    };
+
+    std::mutex mutex_;
+    std::map<std::string, Namespace> namespaces_;
+    esp_timer_handle_t commit_timer_ = nullptr;
+
+    // Restart the debounce timer, the batch is committed when it expires
+    void ScheduleCommit() {
+        esp_timer_stop(commit_timer_);
+        esp_timer_start_once(commit_timer_, SETTINGS_COMMIT_DELAY_MS * 1000);
+    }
+
+    SettingsCache() {
+        esp_timer_create_args_t timer_args = {
+            .callback = [](void* arg) {
+                // Flash writes would hold up every other esp_timer callback, commit in a task
+                auto task = [](void* arg) {
+                    static_cast<SettingsCache*>(arg)->Commit();
+                    vTaskDelete(NULL);
+                };
+                if (xTaskCreate(task, "settings_commit", 4096, arg, 1, nullptr) != pdPASS) {
+                    static_cast<SettingsCache*>(arg)->Commit();
+                }
+            },
+            .arg = this,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "settings_commit",
+            .skip_unhandled_events = true
+        };
+        esp_timer_create(&timer_args, &commit_timer_);
+        // esp_restart() runs shutdown handlers, so pending writes survive a reboot
+        esp_register_shutdown_handler([]() {
+            SettingsCache::GetInstance().Commit();
+        });
     }
-    return value;
+
+    // Read the whole namespace the first time it is used, the caller holds mutex_
+    Namespace& Load(const std::string& ns) {
+        auto it = namespaces_.find(ns);
+        if (it != namespaces_.end()) {
+            return it->second;
+        }
+        auto& space = namespaces_[ns];
+
+        nvs_handle_t handle;
+        if (nvs_open(ns.c_str(), NVS_READONLY, &handle) != ESP_OK) {
+            return space;
+        }
+        nvs_iterator_t iterator = nullptr;
+        esp_err_t err = nvs_entry_find(NVS_DEFAULT_PART_NAME, ns.c_str(), NVS_TYPE_ANY, &iterator);
+        while (err == ESP_OK) {
+            nvs_entry_info_t info;
+            nvs_entry_info(iterator, &info);
+            Entry entry = { .type = info.type, .number = 0, .text = "" };
+            if (info.type == NVS_TYPE_I32) {
+                if (nvs_get_i32(handle, info.key, &entry.number) == ESP_OK) {
+                    space.entries[info.key] = std::move(entry);
+                }
+            } else if (info.type == NVS_TYPE_U8) {
+                uint8_t value;
+                if (nvs_get_u8(handle, info.key, &value) == ESP_OK) {
+                    entry.number = value;
+                    space.entries[info.key] = std::move(entry);
+                }
+            } else if (info.type == NVS_TYPE_STR) {
+                size_t length = 0;
+                if (nvs_get_str(handle, info.key, nullptr, &length) == ESP_OK) {
+                    entry.text.resize(length);
+                    if (nvs_get_str(handle, info.key, entry.text.data(), &length) == ESP_OK) {
+                        while (!entry.text.empty() && entry.text.back() == '\0') {
+                            entry.text.pop_back();
+                        }
+                        space.entries[info.key] = std::move(entry);
+                    }
+                }
+            }
+            err = nvs_entry_next(&iterator);
+        }
+        nvs_release_iterator(iterator);
+        nvs_close(handle);
+        return space;
+    }
+};
+
+} // namespace
+
+Settings::Settings(const std::string& ns, bool read_write) : ns_(ns), read_write_(read_write) {
+}
+
+Settings::~Settings() {
+}
+
+void Settings::Flush() {
+    SettingsCache::GetInstance().Commit();
+}
+
+/*
+ * Boards enter deep sleep directly, which does not run the shutdown handlers, and
+ * deep sleep hooks must not block. The linker routes every call of the two entry
+ * points through these wrappers (-Wl,--wrap in CMakeLists.txt), so the pending
+ * writes are committed first.
+ */
+extern "C" {
+[[noreturn]] void __real_esp_deep_sleep_start(void);
+[[noreturn]] void __real_esp_deep_sleep(uint64_t time_in_us);
+
+[[noreturn]] void __wrap_esp_deep_sleep_start(void) {
+    Settings::Flush();
+    __real_esp_deep_sleep_start();
+}
+
+[[noreturn]] void __wrap_esp_deep_sleep(uint64_t time_in_us) {
+    Settings::Flush();
+    __real_esp_deep_sleep(time_in_us);
+}
+}
+
+std::string Settings::GetString(const std::string& key, const std::string& default_value) {
+    SettingsCache::Entry entry;
+    if (!SettingsCache::GetInstance().Get(ns_, key, NVS_TYPE_STR, entry)) {
+        return default_value;
+    }
+    return entry.text;
 }
 
 void Settings::SetString(const std::string& key, const std::string& value) {
     if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_str(nvs_handle_, key.c_str(), value.c_str()));
-        dirty_ = true;
+        SettingsCache::GetInstance().Set(ns_, key, { .type = NVS_TYPE_STR, .number = 0, .text = value });
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
 }
 
 int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
-    if (nvs_handle_ == 0) {
+    SettingsCache::Entry entry;
+    if (!SettingsCache::GetInstance().Get(ns_, key, NVS_TYPE_I32, entry)) {
         return default_value;
     }
-
-    int32_t value;
-    if (nvs_get_i32(nvs_handle_, key.c_str(), &value) != ESP_OK) {
-        return default_value;
-    }
-    return value;
+    return entry.number;
 }
 
 void Settings::SetInt(const std::string& key, int32_t value) {
     if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_i32(nvs_handle_, key.c_str(), value));
-        dirty_ = true;
+        SettingsCache::GetInstance().Set(ns_, key, { .type = NVS_TYPE_I32, .number = value, .text = "" });
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
 }
 
 bool Settings::GetBool(const std::string& key, bool default_value) {
-    if (nvs_handle_ == 0) {
+    SettingsCache::Entry entry;
+    if (!SettingsCache::GetInstance().Get(ns_, key, NVS_TYPE_U8, entry)) {
         return default_value;
     }
-
-    uint8_t value;
-    if (nvs_get_u8(nvs_handle_, key.c_str(), &value) != ESP_OK) {
-        return default_value;
-    }
-    return value != 0;
+    return entry.number != 0;
 }
 
 void Settings::SetBool(const std::string& key, bool value) {
     if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_u8(nvs_handle_, key.c_str(), value ? 1 : 0));
-        dirty_ = true;
+        SettingsCache::GetInstance().Set(ns_, key, { .type = NVS_TYPE_U8, .number = value ? 1 : 0, .text = "" });
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
@@ -90,10 +297,7 @@ void Settings::SetBool(const std::string& key, bool value) {
 
 void Settings::EraseKey(const std::string& key) {
     if (read_write_) {
-        auto ret = nvs_erase_key(nvs_handle_, key.c_str());
-        if (ret != ESP_ERR_NVS_NOT_FOUND) {
-            ESP_ERROR_CHECK(ret);
-        }
+        SettingsCache::GetInstance().Erase(ns_, key);
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
@@ -101,7 +305,7 @@ void Settings::EraseKey(const std::string& key) {
 
 void Settings::EraseAll() {
     if (read_write_) {
-        ESP_ERROR_CHECK(nvs_erase_all(nvs_handle_));
+        SettingsCache::GetInstance().EraseAll(ns_);
     } else {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
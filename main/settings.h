@@ -4,6 +4,13 @@
 #include <string>
 #include <nvs_flash.h>
 
+/**
+ * Typed access to one NVS namespace.
+ *
+ * All instances share a process-wide cache: each namespace is read from NVS once,
+ * reads are served from RAM, and writes are committed in one batch shortly after
+ * the last change, on reboot, or when Flush() is called (e.g. before deep sleep).
+ */
 class Settings {
 public:
     Settings(const std::string& ns, bool read_write = false);
@@ -18,11 +25,12 @@ public:
     void EraseKey(const std::string& key);
     void EraseAll();
 
+    // Commit all pending changes of every namespace to NVS now
+    static void Flush();
+
 private:
     std::string ns_;
-    nvs_handle_t nvs_handle_ = 0;
     bool read_write_ = false;
-    bool dirty_ = false;
 };
 
 #endif
@@ -0,0 +1,255 @@
+#include "streaming_uploader.h"
+#include "board.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <esp_pthread.h>
+
+#include <cstring>
+#include <thread>
+#include <stdexcept>
+#include <algorithm>
+
+#define TAG "StreamingUploader"
+
+// The producer encodes JPEG and renders the screen, which used to run on the main task
+#if CONFIG_IDF_TARGET_ESP32P4
+#define STREAMING_UPLOAD_PRODUCER_STACK_SIZE 10240
+#else
+#define STREAMING_UPLOAD_PRODUCER_STACK_SIZE 8192
+#endif
+
+StreamingUploader::StreamingUploader(size_t block_size, size_t block_count)
+    : block_size_(block_size), block_count_(block_count) {
+    pool_ = (uint8_t*)heap_caps_malloc(block_size_ * block_count_, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (pool_ == nullptr) {
+        pool_ = (uint8_t*)heap_caps_malloc(block_size_ * block_count_, MALLOC_CAP_8BIT);
+    }
+    free_queue_ = xQueueCreate(block_count_, sizeof(int));
+    // One extra slot for the end marker, so the producer never blocks on this queue
+    ready_queue_ = xQueueCreate(block_count_ + 1, sizeof(BlockRef));
+}
+
+StreamingUploader::~StreamingUploader() {
+    if (free_queue_ != nullptr) {
+        vQueueDelete(free_queue_);
+    }
+    if (ready_queue_ != nullptr) {
+        vQueueDelete(ready_queue_);
+    }
+    if (pool_ != nullptr) {
+        heap_caps_free(pool_);
+    }
+}
+
+void StreamingUploader::SetHeader(const std::string& key, const std::string& value) {
+    headers_.emplace_back(key, value);
+}
+
+void StreamingUploader::AddFormField(const std::string& name, const std::string& value) {
+    form_fields_.reserve(form_fields_.size() + boundary_.size() + name.size() + value.size() + 64);
+    form_fields_.append("--").append(boundary_).append("\r\n");
+    form_fields_.append("Content-Disposition: form-data; name=\"").append(name).append("\"\r\n\r\n");
+    form_fields_.append(value).append("\r\n");
+}
+
+void StreamingUploader::SetFileField(const std::string& name, const std::string& filename, const std::string& content_type) {
+    file_header_.clear();
+    file_header_.reserve(boundary_.size() + name.size() + filename.size() + content_type.size() + 96);
+    file_header_.append("--").append(boundary_).append("\r\n");
+    file_header_.append("Content-Disposition: form-data; name=\"").append(name);
+    file_header_.append("\"; filename=\"").append(filename).append("\"\r\n");
+    file_header_.append("Content-Type: ").append(content_type).append("\r\n\r\n");
+}
+
+void StreamingUploader::ResetPool() {
+    xQueueReset(free_queue_);
+    xQueueReset(ready_queue_);
+    for (int i = 0; i < (int)block_count_; i++) {
+        xQueueSend(free_queue_, &i, 0);
+    }
+    current_index_ = -1;
+    current_len_ = 0;
+    aborted_ = false;
+}
+
+bool StreamingUploader::SubmitCurrentBlock() {
+    BlockRef ref = { .index = current_index_, .len = current_len_, .ok = true };
+    current_index_ = -1;
+    current_len_ = 0;
+    return xQueueSend(ready_queue_, &ref, portMAX_DELAY) == pdPASS;
+}
+
+bool StreamingUploader::Write(const void* data, size_t len) {
+    auto src = static_cast<const uint8_t*>(data);
+    while (len > 0) {
+        if (aborted_) {
+            return false;
+        }
+        if (current_index_ < 0) {
+            // Wait for the network side to release a block
+            auto wait_start = esp_timer_get_time();
+            while (xQueueReceive(free_queue_, &current_index_, pdMS_TO_TICKS(100)) != pdPASS) {
+                if (aborted_) {
+                    return false;
+                }
+            }
+            stats_.producer_blocked_us += esp_timer_get_time() - wait_start;
+            current_len_ = 0;
+        }
+
+        size_t n = std::min(len, block_size_ - current_len_);
+        memcpy(pool_ + current_index_ * block_size_ + current_len_, src, n);
+        current_len_ += n;
+        src += n;
+        len -= n;
+        if (current_len_ == block_size_ && !SubmitCurrentBlock()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StreamingUploader::FinishProducer(bool ok) {
+    if (current_index_ >= 0 && current_len_ > 0 && !aborted_) {
+        SubmitCurrentBlock();
+    }
+    BlockRef end = { .index = -1, .len = 0, .ok = ok && !aborted_ };
+    xQueueSend(ready_queue_, &end, portMAX_DELAY);
+}
+
+bool StreamingUploader::UploadOnce(const std::string& url, Producer& producer, std::string& response, bool& retryable) {
+    retryable = false;
+    stats_.body_bytes = 0;
+    ResetPool();
+
+    // Start producing before the connection is established, so that encoding overlaps
+    // with the TCP/TLS handshake
+    auto pthread_cfg = esp_pthread_get_default_config();
+    pthread_cfg.stack_size = STREAMING_UPLOAD_PRODUCER_STACK_SIZE;
+    pthread_cfg.thread_name = "upload_producer";
+    esp_pthread_set_cfg(&pthread_cfg);
+    std::thread producer_thread([this, &producer]() {
+        auto start_time = esp_timer_get_time();
+        bool ok = producer(*this);
+        stats_.producer_us += esp_timer_get_time() - start_time;
+        FinishProducer(ok);
+    });
+    // Later threads of the calling task get the default config again
+    pthread_cfg = esp_pthread_get_default_config();
+    esp_pthread_set_cfg(&pthread_cfg);
+    auto abort_producer = [this, &producer_thread]() {
+        aborted_ = true;
+        producer_thread.join();
+    };
+
+    auto http = Board::GetInstance().GetNetwork()->CreateHttp(3);
+    for (auto& header : headers_) {
+        http->SetHeader(header.first, header.second);
+    }
+    http->SetHeader("Content-Type", "multipart/form-data; boundary=" + boundary_);
+    http->SetHeader("Transfer-Encoding", "chunked");
+
+    auto net_start = esp_timer_get_time();
+    bool opened = http->Open("POST", url);
+    if (opened) {
+        std::string preamble;
+        preamble.reserve(form_fields_.size() + file_header_.size());
+        preamble.append(form_fields_).append(file_header_);
+        opened = http->Write(preamble.data(), preamble.size()) >= 0;
+    }
+    stats_.network_us += esp_timer_get_time() - net_start;
+    if (!opened) {
+        ESP_LOGE(TAG, "Failed to connect to %s", url.c_str());
+        abort_producer();
+        retryable = true;
+        return false;
+    }
+
+    bool producer_ok = false;
+    while (true) {
+        BlockRef ref;
+        auto wait_start = esp_timer_get_time();
+        if (xQueueReceive(ready_queue_, &ref, portMAX_DELAY) != pdPASS) {
+            continue;
+        }
+        stats_.consumer_idle_us += esp_timer_get_time() - wait_start;
+        if (ref.index < 0) {
+            producer_ok = ref.ok;
+            break;
+        }
+
+        auto write_start = esp_timer_get_time();
+        int ret = http->Write((const char*)pool_ + ref.index * block_size_, ref.len);
+        stats_.network_us += esp_timer_get_time() - write_start;
+        xQueueSend(free_queue_, &ref.index, 0);
+        if (ret < 0) {
+            ESP_LOGE(TAG, "Failed to write %u bytes after %u bytes sent", ref.len, stats_.body_bytes);
+            abort_producer();
+            retryable = true;
+            return false;
+        }
+        stats_.body_bytes += ref.len;
+    }
+    producer_thread.join();
+
+    if (!producer_ok || stats_.body_bytes == 0) {
+        throw std::runtime_error("Failed to produce upload data");
+    }
+
+    auto finish_start = esp_timer_get_time();
+    std::string footer;
+    footer.reserve(boundary_.size() + 8);
+    footer.append("\r\n--").append(boundary_).append("--\r\n");
+    http->Write(footer.data(), footer.size());
+    // Terminating chunk
+    http->Write("", 0);
+    stats_.network_us += esp_timer_get_time() - finish_start;
+
+    int status_code = http->GetStatusCode();
+    if (status_code != 200) {
+        ESP_LOGE(TAG, "Upload failed, status code: %d", status_code);
+        retryable = status_code >= 500;
+        if (!retryable) {
+            throw std::runtime_error("Unexpected status code: " + std::to_string(status_code));
+        }
+        return false;
+    }
+    response = http->ReadAll();
+    http->Close();
+    return true;
+}
+
+std::string StreamingUploader::Upload(const std::string& url, Producer producer) {
+    if (pool_ == nullptr || free_queue_ == nullptr || ready_queue_ == nullptr) {
+        throw std::runtime_error("Failed to allocate upload buffers");
+    }
+
+    stats_ = UploadStats();
+    auto start_time = esp_timer_get_time();
+    std::string response;
+    for (int attempt = 0; attempt <= max_retries_; attempt++) {
+        if (attempt > 0) {
+            ESP_LOGW(TAG, "Retrying upload (%d/%d)", attempt, max_retries_);
+            vTaskDelay(pdMS_TO_TICKS(500 * attempt));
+        }
+        stats_.attempts++;
+        bool retryable = false;
+        if (UploadOnce(url, producer, response, retryable)) {
+            break;
+        }
+        if (!retryable || attempt == max_retries_) {
+            throw std::runtime_error("Failed to upload to " + url);
+        }
+    }
+    stats_.wall_us = esp_timer_get_time() - start_time;
+
+    int64_t producer_busy_us = stats_.producer_us - stats_.producer_blocked_us;
+    int64_t overlap_us = std::max<int64_t>(0, producer_busy_us + stats_.network_us - stats_.wall_us);
+    ESP_LOGI(TAG, "Uploaded %u bytes in %dms, attempts=%d, produce=%dms (blocked %dms), network=%dms (idle %dms), overlap=%dms",
+        stats_.body_bytes, (int)(stats_.wall_us / 1000), stats_.attempts,
+        (int)(producer_busy_us / 1000), (int)(stats_.producer_blocked_us / 1000),
+        (int)(stats_.network_us / 1000), (int)(stats_.consumer_idle_us / 1000), (int)(overlap_us / 1000));
+    return response;
+}
@@ -0,0 +1,92 @@
+#ifndef _STREAMING_UPLOADER_H_
+#define _STREAMING_UPLOADER_H_
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+struct UploadStats {
+    size_t body_bytes = 0;
+    int attempts = 0;
+    int64_t wall_us = 0;
+    int64_t producer_us = 0;          // Time spent producing data (excluding backpressure)
+    int64_t producer_blocked_us = 0;  // Time the producer waited for a free block
+    int64_t network_us = 0;           // Time spent in HTTP open and writes
+    int64_t consumer_idle_us = 0;     // Time the network side waited for data
+};
+
+/**
+ * Producer/consumer multipart uploader.
+ *
+ * The producer runs on a worker thread and writes into a bounded pool of blocks,
+ * while the calling thread opens the HTTP connection and streams filled blocks
+ * with chunked transfer encoding. When all blocks are in flight, the producer
+ * blocks (backpressure), so memory usage is bounded by block_size * block_count.
+ *
+ * A retry does not resume a failed upload. Nothing of the failed attempt is kept,
+ * the connection is reopened and the producer runs again from the start, so the
+ * whole body is produced (e.g. the JPEG encoded) and sent again.
+ */
+class StreamingUploader {
+public:
+    // Returns false if the data could not be produced
+    typedef std::function<bool(StreamingUploader& uploader)> Producer;
+
+    StreamingUploader(size_t block_size = 4096, size_t block_count = 4);
+    ~StreamingUploader();
+
+    void SetHeader(const std::string& key, const std::string& value);
+    void AddFormField(const std::string& name, const std::string& value);
+    void SetFileField(const std::string& name, const std::string& filename, const std::string& content_type);
+    void SetMaxRetries(int max_retries) { max_retries_ = max_retries; }
+
+    /**
+     * Write data to the upload stream, called from the producer.
+     * Blocks while all blocks are in flight. Returns false if the upload was aborted.
+     */
+    bool Write(const void* data, size_t len);
+
+    /**
+     * Run the producer and upload its output as the file field to the URL.
+     * The producer is invoked again from the beginning if the connection fails and
+     * a retry is attempted, so it must be able to regenerate the same data.
+     * Returns the response body, throws std::runtime_error on failure.
+     */
+    std::string Upload(const std::string& url, Producer producer);
+
+    const UploadStats& stats() const { return stats_; }
+
+private:
+    struct BlockRef {
+        int index;  // -1 marks the end of the stream
+        size_t len;
+        bool ok;
+    };
+
+    size_t block_size_;
+    size_t block_count_;
+    uint8_t* pool_ = nullptr;
+    QueueHandle_t free_queue_ = nullptr;
+    QueueHandle_t ready_queue_ = nullptr;
+    int current_index_ = -1;
+    size_t current_len_ = 0;
+    std::atomic<bool> aborted_ = false;
+    int max_retries_ = 2;
+
+    std::vector<std::pair<std::string, std::string>> headers_;
+    std::string form_fields_;
+    std::string file_header_;
+    std::string boundary_ = "----ESP32_STREAMING_UPLOAD_BOUNDARY";
+    UploadStats stats_;
+
+    void ResetPool();
+    bool SubmitCurrentBlock();
+    void FinishProducer(bool ok);
+    bool UploadOnce(const std::string& url, Producer& producer, std::string& response, bool& retryable);
+};
+
+#endif // _STREAMING_UPLOADER_H_
@@ -19,6 +19,10 @@ import json
 import struct
 from datetime import datetime
 
+# The assets.bin table format lives next to spiffs_assets_gen.py
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), 'spiffs_assets'))
+from assets_table import CRC_TABLE_NAME, pack_assets_image, write_mmap_header
+
 
 # =============================================================================
 # Pack model functions (from pack_model.py)
@@ -334,97 +338,30 @@ def generate_config_json(build_dir, assets_dir):
 # Simplified SPIFFS assets generation (from spiffs_assets_gen.py)
 # =============================================================================
 
-def compute_checksum(data):
-    checksum = sum(data) & 0xFFFF
-    return checksum
-
-
-def sort_key(filename):
-    basename, extension = os.path.splitext(filename)
-    return extension, basename
-
-
-def pack_assets_simple(target_path, include_path, out_file, assets_path, max_name_len=32):
+def pack_assets_simple(target_path, include_path, out_file, assets_path, max_name_len=32, base_assets=None):
     """
     Simplified version of pack_assets that handles basic file packing
     """
-    merged_data = bytearray()
-    file_info_list = []
-    skip_files = ['config.json']
+    skip_files = ['config.json', CRC_TABLE_NAME]
 
     # Ensure output directory exists
     os.makedirs(os.path.dirname(out_file), exist_ok=True)
-    os.makedirs(include_path, exist_ok=True)
-
-    file_list = sorted(os.listdir(target_path), key=sort_key)
-    for filename in file_list:
-        if filename in skip_files:
-            continue
 
+    files = []
+    for filename in os.listdir(target_path):
         file_path = os.path.join(target_path, filename)
-        if not os.path.isfile(file_path):
+        if filename in skip_files or not os.path.isfile(file_path):
             continue
-            
-        file_name = os.path.basename(file_path)
-        file_size = os.path.getsize(file_path)
-
-        file_info_list.append((file_name, len(merged_data), file_size, 0, 0))
-        # Add 0x5A5A prefix to merged_data
-        merged_data.extend(b'\x5A' * 2)
-
         with open(file_path, 'rb') as bin_file:
-            bin_data = bin_file.read()
-
-        merged_data.extend(bin_data)
-
-    total_files = len(file_info_list)
-
-    mmap_table = bytearray()
-    for file_name, offset, file_size, width, height in file_info_list:
-        if len(file_name) > max_name_len:
-            print(f'Warning: "{file_name}" exceeds {max_name_len} bytes and will be truncated.')
-        fixed_name = file_name.ljust(max_name_len, '\0')[:max_name_len]
-        mmap_table.extend(fixed_name.encode('utf-8'))
-        mmap_table.extend(file_size.to_bytes(4, byteorder='little'))
-        mmap_table.extend(offset.to_bytes(4, byteorder='little'))
-        mmap_table.extend(width.to_bytes(2, byteorder='little'))
-        mmap_table.extend(height.to_bytes(2, byteorder='little'))
-
-    combined_data = mmap_table + merged_data
-    combined_checksum = compute_checksum(combined_data)
-    combined_data_length = len(combined_data).to_bytes(4, byteorder='little')
-    header_data = total_files.to_bytes(4, byteorder='little') + combined_checksum.to_bytes(4, byteorder='little')
-    final_data = header_data + combined_data_length + combined_data
+            files.append((filename, bin_file.read(), 0, 0))
 
+    final_data, entries, checksum, changed = pack_assets_image(files, max_name_len, base_assets)
     with open(out_file, 'wb') as output_bin:
         output_bin.write(final_data)
+    if changed is not None:
+        print(f'Changed since base: {changed} of {len(final_data)} bytes')
 
-    # Generate header file
-    current_year = datetime.now().year
-    asset_name = os.path.basename(assets_path)
-    header_file_path = os.path.join(include_path, f'mmap_generate_{asset_name}.h')
-    with open(header_file_path, 'w') as output_header:
-        output_header.write('/*\n')
-        output_header.write(' * SPDX-FileCopyrightText: 2022-{} Espressif Systems (Shanghai) CO LTD\n'.format(current_year))
-        output_header.write(' *\n')
-        output_header.write(' * SPDX-License-Identifier: Apache-2.0\n')
-        output_header.write(' */\n\n')
-        output_header.write('/**\n')
-        output_header.write(' * @file\n')
-        output_header.write(" * @brief This file was generated by esp_mmap_assets, don't modify it\n")
-        output_header.write(' */\n\n')
-        output_header.write('#pragma once\n\n')
-        output_header.write("#include \"esp_mmap_assets.h\"\n\n")
-        output_header.write(f'#define MMAP_{asset_name.upper()}_FILES           {total_files}\n')
-        output_header.write(f'#define MMAP_{asset_name.upper()}_CHECKSUM        0x{combined_checksum:04X}\n\n')
-        output_header.write(f'enum MMAP_{asset_name.upper()}_LISTS {{\n')
-
-        for i, (file_name, _, _, _, _) in enumerate(file_info_list):
-            enum_name = file_name.replace('.', '_')
-            output_header.write(f'    MMAP_{asset_name.upper()}_{enum_name.upper()} = {i},        /*!< {file_name} */\n')
-
-        output_header.write('};\n')
-
+    write_mmap_header(include_path, assets_path, entries, checksum)
     print(f'All files have been merged into {os.path.basename(out_file)}')
 
 
@@ -698,7 +635,7 @@ def get_emoji_collection_path(default_emoji_collection, xiaozhi_fonts_path):
         return None
 
 
-def build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font_path, emoji_collection_path, extra_files_path, output_path, multinet_model_info=None):
+def build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font_path, emoji_collection_path, extra_files_path, output_path, multinet_model_info=None, base_assets=None):
     """
     Build assets using integrated functions (no external dependencies)
     """
@@ -734,7 +671,7 @@ def build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font
         # Use simplified packing function
         include_path = config_data['include_path']
         image_file = config_data['image_file']
-        pack_assets_simple(assets_dir, include_path, image_file, "assets", int(config_data['name_length']))
+        pack_assets_simple(assets_dir, include_path, image_file, "assets", int(config_data['name_length']), base_assets)
         
         # Copy final assets.bin to output location
         if os.path.exists(image_file):
@@ -768,6 +705,7 @@ def main():
     parser.add_argument('--esp_sr_model_path', help='Path to ESP-SR model directory')
     parser.add_argument('--xiaozhi_fonts_path', help='Path to xiaozhi-fonts component directory')
     parser.add_argument('--extra_files', help='Path to extra files directory to be included in assets')
+    parser.add_argument('--base_assets', help='Previous assets.bin, unchanged entries keep their offsets for incremental updates')
     
     args = parser.parse_args()
     
@@ -870,7 +808,7 @@ def main():
     
     # Build the assets
     success = build_assets_integrated(wakenet_model_paths, multinet_model_paths, text_font_path, emoji_collection_path, 
-                                     extra_files_path, args.output, multinet_model_info)
+                                     extra_files_path, args.output, multinet_model_info, args.base_assets)
     
     if not success:
         sys.exit(1)
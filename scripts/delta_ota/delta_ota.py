@@ -0,0 +1,258 @@
+#!/usr/bin/env python3
+"""
+Create and apply delta OTA patches for xiaozhi firmware images
+
+The device reconstructs the new image by streaming the patch and reading the
+running partition (see main/delta_patch.cc), so the format is a flat command
+stream without compression or random access into the patch.
+
+Usage:
+    ./delta_ota.py diff <old.bin> <new.bin> <patch.bin>
+    ./delta_ota.py apply <old.bin> <patch.bin> <new.bin>
+    ./delta_ota.py test <old.bin> <new.bin>
+
+Patch format (little-endian):
+    magic "XZDP" | version u8 | flags u8 | reserved u16 |
+    old_size u32 | new_size u32 | old_sha256 [32] | new_sha256 [32] |
+    commands...
+
+Commands (numbers are unsigned LEB128 varints):
+    0x00 END
+    0x01 COPY   old_offset, length
+    0x02 INSERT length, bytes[length]
+    0x03 DIFF   old_offset, length, segments...
+                each segment is skip, count, delta[count]: copy `skip` bytes
+                from old, then `count` bytes of (old + delta) & 0xff
+"""
+
+import sys
+import struct
+import hashlib
+import argparse
+import time
+
+MAGIC = b"XZDP"
+VERSION = 1
+HEADER_FORMAT = "<4sBBHII32s32s"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+
+CMD_END = 0x00
+CMD_COPY = 0x01
+CMD_INSERT = 0x02
+CMD_DIFF = 0x03
+
+BLOCK_SIZE = 16     # Hashed window for finding exact matches
+INDEX_STEP = 4      # Index every 4th offset of the old image
+MIN_MATCH = 32      # Shorter matches are cheaper as DIFF/INSERT
+MAX_GAP = 3         # Zero bytes kept inside a delta run instead of splitting it
+
+
+def write_varint(out, value):
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return
+
+
+def read_varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return value, pos
+        shift += 7
+
+
+def build_index(old):
+    index = {}
+    for j in range(0, len(old) - BLOCK_SIZE + 1, INDEX_STEP):
+        index.setdefault(old[j:j + BLOCK_SIZE], j)
+    return index
+
+
+def encode_diff_segments(old, old_offset, new_chunk):
+    """Encode new_chunk against old[old_offset:] as skip/count/delta segments"""
+    deltas = bytes((n - old[old_offset + k]) & 0xFF for k, n in enumerate(new_chunk))
+    out = bytearray()
+    pos = 0
+    size = len(deltas)
+    while pos < size:
+        start = pos
+        while pos < size and deltas[pos] == 0:
+            pos += 1
+        skip = pos - start
+        run_start = pos
+        zeros = 0
+        while pos < size and zeros <= MAX_GAP:
+            zeros = zeros + 1 if deltas[pos] == 0 else 0
+            pos += 1
+        # Trailing zeros belong to the next segment's skip
+        run_end = pos
+        while run_end > run_start and deltas[run_end - 1] == 0:
+            run_end -= 1
+        write_varint(out, skip)
+        write_varint(out, run_end - run_start)
+        out += deltas[run_start:run_end]
+        pos = run_end
+    return out
+
+
+def emit_unmatched(out, old, new, start, end, old_hint):
+    """Emit new[start:end] as DIFF against old_hint if it helps, else INSERT"""
+    if end <= start:
+        return
+    length = end - start
+    chunk = new[start:end]
+    if old_hint + length <= len(old):
+        segments = encode_diff_segments(old, old_hint, chunk)
+        if len(segments) < length * 3 // 4:
+            out.append(CMD_DIFF)
+            write_varint(out, old_hint)
+            write_varint(out, length)
+            out += segments
+            return
+    out.append(CMD_INSERT)
+    write_varint(out, length)
+    out += chunk
+
+
+def diff(old, new):
+    index = build_index(old)
+    out = bytearray()
+    out += struct.pack(HEADER_FORMAT, MAGIC, VERSION, 0, 0, len(old), len(new),
+                       hashlib.sha256(old).digest(), hashlib.sha256(new).digest())
+
+    i = 0
+    pending = 0             # Start of the unmatched region in new
+    old_pos = 0             # Old offset that continues the previous copy
+    size = len(new)
+    while i + BLOCK_SIZE <= size:
+        j = index.get(new[i:i + BLOCK_SIZE])
+        if j is None:
+            i += 1
+            continue
+        # Extend the match in both directions
+        start_new, start_old = i, j
+        while start_new > pending and start_old > 0 and new[start_new - 1] == old[start_old - 1]:
+            start_new -= 1
+            start_old -= 1
+        end_new, end_old = i + BLOCK_SIZE, j + BLOCK_SIZE
+        while end_new < size and end_old < len(old) and new[end_new] == old[end_old]:
+            end_new += 1
+            end_old += 1
+        if end_new - start_new < MIN_MATCH:
+            i += 1
+            continue
+
+        emit_unmatched(out, old, new, pending, start_new, old_pos)
+        out.append(CMD_COPY)
+        write_varint(out, start_old)
+        write_varint(out, end_new - start_new)
+        pending = i = end_new
+        old_pos = end_old
+
+    emit_unmatched(out, old, new, pending, size, old_pos)
+    out.append(CMD_END)
+    return bytes(out)
+
+
+def apply(old, patch):
+    magic, version, flags, _, old_size, new_size, old_sha, new_sha = struct.unpack_from(HEADER_FORMAT, patch)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("Not a delta patch or unsupported version")
+    if old_size > len(old) or hashlib.sha256(old[:old_size]).digest() != old_sha:
+        raise ValueError("Patch does not match the old image")
+
+    new = bytearray()
+    pos = HEADER_SIZE
+    while True:
+        cmd = patch[pos]
+        pos += 1
+        if cmd == CMD_END:
+            break
+        elif cmd == CMD_COPY:
+            offset, pos = read_varint(patch, pos)
+            length, pos = read_varint(patch, pos)
+            new += old[offset:offset + length]
+        elif cmd == CMD_INSERT:
+            length, pos = read_varint(patch, pos)
+            new += patch[pos:pos + length]
+            pos += length
+        elif cmd == CMD_DIFF:
+            offset, pos = read_varint(patch, pos)
+            length, pos = read_varint(patch, pos)
+            remaining = length
+            while remaining > 0:
+                skip, pos = read_varint(patch, pos)
+                count, pos = read_varint(patch, pos)
+                if skip + count > remaining:
+                    raise ValueError("Corrupted DIFF segment")
+                new += old[offset:offset + skip]
+                offset += skip
+                for k in range(count):
+                    new.append((old[offset + k] + patch[pos + k]) & 0xFF)
+                offset += count
+                pos += count
+                remaining -= skip + count
+        else:
+            raise ValueError("Unknown command 0x%02x at %d" % (cmd, pos - 1))
+
+    if len(new) != new_size or hashlib.sha256(new).digest() != new_sha:
+        raise ValueError("Reconstructed image does not match")
+    return bytes(new)
+
+
+def read_file(path):
+    with open(path, "rb") as f:
+        return f.read()
+
+
+def write_file(path, data):
+    with open(path, "wb") as f:
+        f.write(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Delta OTA patch tool")
+    sub = parser.add_subparsers(dest="command", required=True)
+    p = sub.add_parser("diff", help="create a patch from old.bin to new.bin")
+    p.add_argument("old")
+    p.add_argument("new")
+    p.add_argument("patch")
+    p = sub.add_parser("apply", help="apply a patch to old.bin")
+    p.add_argument("old")
+    p.add_argument("patch")
+    p.add_argument("new")
+    p = sub.add_parser("test", help="round-trip old.bin -> patch -> new.bin")
+    p.add_argument("old")
+    p.add_argument("new")
+    args = parser.parse_args()
+
+    if args.command == "diff":
+        old, new = read_file(args.old), read_file(args.new)
+        patch = diff(old, new)
+        write_file(args.patch, patch)
+        print("Patch %d bytes, new image %d bytes (%.1f%%)" % (len(patch), len(new), len(patch) * 100.0 / len(new)))
+    elif args.command == "apply":
+        write_file(args.new, apply(read_file(args.old), read_file(args.patch)))
+    else:
+        old, new = read_file(args.old), read_file(args.new)
+        start = time.time()
+        patch = diff(old, new)
+        elapsed = time.time() - start
+        if apply(old, patch) != new:
+            print("FAILED: reconstructed image differs")
+            sys.exit(1)
+        print("OK: patch %d bytes for %d byte image (%.1f%%), diff took %.1fs"
+              % (len(patch), len(new), len(patch) * 100.0 / len(new), elapsed))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,163 @@
+// Host test of main/assets_table.h against images packed by scripts/spiffs_assets/assets_table.py
+// Usage: assets_table_test <image.bin> <manifest.txt> ...
+// The manifests are written by make_test_assets.py, one line per file:
+// <table index> <size> <crc32> <name>
+
+#include "assets_table.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define CRC_TABLE_NAME "crc32.bin"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+struct ManifestEntry {
+    int index;
+    uint32_t size;
+    uint32_t crc32;
+    std::string name;
+};
+
+static uint32_t Crc32(const char* data, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint8_t)data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static std::vector<char> ReadFile(const char* path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static std::vector<ManifestEntry> ReadManifest(const char* path) {
+    std::vector<ManifestEntry> entries;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        ManifestEntry entry;
+        fields >> entry.index >> entry.size >> entry.crc32 >> entry.name;
+        entries.push_back(entry);
+    }
+    return entries;
+}
+
+static void CheckImage(const char* image_path, const char* manifest_path) {
+    int failures_before = failures;
+    auto image = ReadFile(image_path);
+    auto manifest = ReadManifest(manifest_path);
+    CHECK(image.size() >= ASSETS_TABLE_HEADER_SIZE && !manifest.empty(), "%s: cannot read the image or manifest", image_path);
+    if (failures != failures_before) {
+        return;
+    }
+
+    uint32_t files, stored_checksum, stored_length;
+    memcpy(&files, image.data() + 0, 4);
+    memcpy(&stored_checksum, image.data() + 4, 4);
+    memcpy(&stored_length, image.data() + 8, 4);
+    CHECK(files == manifest.size(), "%s: %u files, manifest has %u", image_path, files, (unsigned)manifest.size());
+    CHECK(ASSETS_TABLE_HEADER_SIZE + stored_length == image.size(), "%s: data length %u, image is %u bytes", image_path,
+          stored_length, (unsigned)image.size());
+
+    // The checksum in one pass and in chunks as the background verification does
+    const char* body = image.data() + ASSETS_TABLE_HEADER_SIZE;
+    CHECK(AssetsTableChecksum(body, stored_length) == stored_checksum, "%s: checksum 0x%X, stored 0x%X", image_path,
+          AssetsTableChecksum(body, stored_length), stored_checksum);
+    uint32_t chunked = 0;
+    for (uint32_t offset = 0; offset < stored_length; offset += 1000) {
+        chunked += AssetsTableChecksum(body + offset, std::min<uint32_t>(1000, stored_length - offset));
+    }
+    CHECK((chunked & 0xFFFF) == stored_checksum, "%s: chunked checksum 0x%X", image_path, chunked & 0xFFFF);
+
+    auto table = (const mmap_assets_table*)body;
+    const char* data_start = body + sizeof(mmap_assets_table) * files;
+    CHECK(AssetsTableSorted(table, files), "%s: the packer did not sort the table", image_path);
+
+    int crc_index = AssetsTableFind(table, files, true, CRC_TABLE_NAME, strlen(CRC_TABLE_NAME));
+    CHECK(crc_index >= 0 && table[crc_index].asset_size == files * 4, "%s: no crc32.bin entry", image_path);
+    if (crc_index < 0) {
+        return;
+    }
+    const char* crc_table = data_start + table[crc_index].asset_offset + 2;
+
+    // Every file is found at its index, by binary and by linear search
+    for (const auto& entry : manifest) {
+        const char* name = entry.name.c_str();
+        int index = AssetsTableFind(table, files, true, name, entry.name.size());
+        CHECK(index == entry.index, "%s: %s found at %d, packed at %d", image_path, name, index, entry.index);
+        CHECK(AssetsTableFind(table, files, false, name, entry.name.size()) == entry.index, "%s: linear search of %s",
+              image_path, name);
+        if (index < 0) {
+            continue;
+        }
+        const auto& item = table[index];
+        const char* data = data_start + item.asset_offset;
+        CHECK(item.asset_size == entry.size, "%s: %s has size %u, packed %u", image_path, name, item.asset_size,
+              entry.size);
+        CHECK(data + 2 + item.asset_size <= image.data() + image.size() && data[0] == 'Z' && data[1] == 'Z',
+              "%s: %s has no 0x5A5A prefix", image_path, name);
+        uint32_t stored_crc;
+        memcpy(&stored_crc, crc_table + index * 4, 4);
+        if (entry.name != CRC_TABLE_NAME) {
+            CHECK(stored_crc == entry.crc32 && Crc32(data + 2, item.asset_size) == entry.crc32, "%s: CRC32 of %s",
+                  image_path, name);
+        }
+    }
+
+    // Names that are not in the table
+    std::string longest(sizeof(mmap_assets_table::asset_name), 'x');
+    const std::string missing[] = { "", "emoji_happy", "emoji_happy.png.", "zzzz", "0", longest + "x", "index.json\n" };
+    for (const auto& name : missing) {
+        bool packed = std::any_of(manifest.begin(), manifest.end(), [&](const auto& e) { return e.name == name; });
+        if (!packed) {
+            CHECK(AssetsTableFind(table, files, true, name.data(), name.size()) < 0, "%s: found missing \"%s\"",
+                  image_path, name.c_str());
+        }
+    }
+
+    // An unsorted table is detected
+    std::vector<mmap_assets_table> reversed(table, table + files);
+    std::reverse(reversed.begin(), reversed.end());
+    CHECK(files < 2 || !AssetsTableSorted(reversed.data(), files), "%s: reversed table reported sorted", image_path);
+    CHECK(AssetsTableFind(reversed.data(), files, false, CRC_TABLE_NAME, strlen(CRC_TABLE_NAME)) ==
+          (int)files - 1 - crc_index, "%s: linear search of the reversed table", image_path);
+
+    if (failures == failures_before) {
+        printf("%s: %u files ok\n", image_path, files);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3 || argc % 2 != 1) {
+        printf("Usage: %s <image.bin> <manifest.txt> ...\n", argv[0]);
+        return 2;
+    }
+    for (int i = 1; i + 1 < argc; i += 2) {
+        CheckImage(argv[i], argv[i + 1]);
+    }
+    if (failures != 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
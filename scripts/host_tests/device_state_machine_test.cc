@@ -0,0 +1,206 @@
+// Host test of DeviceStateMachine
+// Every (from, to) pair is driven through TransitionTo() and checked against the
+// state diagram written out below, then listeners are added and removed while
+// another thread keeps changing the state (run the asan/tsan targets for this part).
+
+#include "device_state_machine.h"
+
+#include <atomic>
+#include <cstdio>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#define STATE_COUNT (kDeviceStateFatalError + 1)
+
+static int failures = 0;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+// The state diagram, independent of the table in device_state_machine.cc
+static bool Expected(int from, int to) {
+    static const std::vector<std::pair<DeviceState, DeviceState>> edges = {
+        {kDeviceStateUnknown, kDeviceStateStarting},
+        {kDeviceStateStarting, kDeviceStateWifiConfiguring},
+        {kDeviceStateStarting, kDeviceStateActivating},
+        {kDeviceStateWifiConfiguring, kDeviceStateActivating},
+        {kDeviceStateWifiConfiguring, kDeviceStateAudioTesting},
+        {kDeviceStateAudioTesting, kDeviceStateWifiConfiguring},
+        {kDeviceStateActivating, kDeviceStateUpgrading},
+        {kDeviceStateActivating, kDeviceStateIdle},
+        {kDeviceStateActivating, kDeviceStateWifiConfiguring},
+        {kDeviceStateUpgrading, kDeviceStateIdle},
+        {kDeviceStateUpgrading, kDeviceStateActivating},
+        {kDeviceStateIdle, kDeviceStateConnecting},
+        {kDeviceStateIdle, kDeviceStateListening},
+        {kDeviceStateIdle, kDeviceStateSpeaking},
+        {kDeviceStateIdle, kDeviceStateActivating},
+        {kDeviceStateIdle, kDeviceStateUpgrading},
+        {kDeviceStateIdle, kDeviceStateWifiConfiguring},
+        {kDeviceStateConnecting, kDeviceStateIdle},
+        {kDeviceStateConnecting, kDeviceStateListening},
+        {kDeviceStateListening, kDeviceStateSpeaking},
+        {kDeviceStateListening, kDeviceStateIdle},
+        {kDeviceStateSpeaking, kDeviceStateListening},
+        {kDeviceStateSpeaking, kDeviceStateIdle},
+    };
+    if (from == to) {
+        return true;
+    }
+    for (const auto& [f, t] : edges) {
+        if (f == from && t == to) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Shortest path of valid transitions from kDeviceStateUnknown, empty if unreachable
+static std::vector<DeviceState> PathTo(int target) {
+    std::vector<int> previous(STATE_COUNT, -1);
+    std::queue<int> queue;
+    previous[kDeviceStateUnknown] = kDeviceStateUnknown;
+    queue.push(kDeviceStateUnknown);
+    while (!queue.empty()) {
+        int state = queue.front();
+        queue.pop();
+        for (int next = 0; next < STATE_COUNT; next++) {
+            if (previous[next] < 0 && Expected(state, next)) {
+                previous[next] = state;
+                queue.push(next);
+            }
+        }
+    }
+    std::vector<DeviceState> path;
+    if (previous[target] < 0) {
+        return path;
+    }
+    for (int state = target; state != kDeviceStateUnknown; state = previous[state]) {
+        path.insert(path.begin(), (DeviceState)state);
+    }
+    return path;
+}
+
+static void TestEveryTransition() {
+    int tested = 0;
+    for (int from = 0; from < STATE_COUNT; from++) {
+        auto path = PathTo(from);
+        if (from != kDeviceStateUnknown && path.empty()) {
+            // Nothing leads to kDeviceStateFatalError, its row is covered by the static_assert
+            printf("skip %s, not reachable\n", DeviceStateMachine::GetStateName((DeviceState)from));
+            continue;
+        }
+        for (int to = 0; to < STATE_COUNT; to++) {
+            DeviceStateMachine machine;
+            for (auto state : path) {
+                CHECK(machine.TransitionTo(state), "path to %s", DeviceStateMachine::GetStateName(state));
+            }
+            CHECK(machine.GetState() == from, "not in %s", DeviceStateMachine::GetStateName((DeviceState)from));
+
+            int calls = 0;
+            DeviceState seen_old = kDeviceStateUnknown, seen_new = kDeviceStateUnknown;
+            machine.AddStateChangeListener([&](DeviceState old_state, DeviceState new_state) {
+                calls++;
+                seen_old = old_state;
+                seen_new = new_state;
+            });
+
+            bool expected = Expected(from, to);
+            const char* from_name = DeviceStateMachine::GetStateName((DeviceState)from);
+            const char* to_name = DeviceStateMachine::GetStateName((DeviceState)to);
+            CHECK(machine.CanTransitionTo((DeviceState)to) == expected, "CanTransitionTo %s -> %s", from_name, to_name);
+            CHECK(machine.TransitionTo((DeviceState)to) == expected, "TransitionTo %s -> %s", from_name, to_name);
+            CHECK(machine.GetState() == (expected ? to : from), "state after %s -> %s", from_name, to_name);
+            if (expected && from != to) {
+                CHECK(calls == 1 && seen_old == from && seen_new == to, "listener of %s -> %s", from_name, to_name);
+            } else {
+                CHECK(calls == 0, "listener called for %s -> %s", from_name, to_name);
+            }
+            tested++;
+        }
+    }
+    printf("%d transitions checked\n", tested);
+}
+
+static void TestListeners() {
+    DeviceStateMachine machine;
+    int a = 0, b = 0;
+    int id_a = machine.AddStateChangeListener([&](DeviceState, DeviceState) { a++; });
+    int id_b = machine.AddStateChangeListener([&](DeviceState, DeviceState) { b++; });
+    CHECK(id_a != id_b, "listener ids must differ");
+    machine.TransitionTo(kDeviceStateStarting);
+    machine.RemoveStateChangeListener(id_a);
+    machine.TransitionTo(kDeviceStateActivating);
+    machine.RemoveStateChangeListener(id_a);
+    CHECK(a == 1 && b == 2, "a=%d b=%d", a, b);
+
+    // A listener may remove itself while being notified
+    int c = 0;
+    int id_c = -1;
+    id_c = machine.AddStateChangeListener([&](DeviceState, DeviceState) {
+        c++;
+        machine.RemoveStateChangeListener(id_c);
+    });
+    machine.TransitionTo(kDeviceStateIdle);
+    machine.TransitionTo(kDeviceStateListening);
+    CHECK(c == 1 && b == 4, "c=%d b=%d", c, b);
+    machine.RemoveStateChangeListener(id_b);
+}
+
+static void TestConcurrentListeners() {
+    DeviceStateMachine machine;
+    for (auto state : PathTo(kDeviceStateListening)) {
+        machine.TransitionTo(state);
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> rounds{0};
+    std::atomic<int> notified{0};
+    std::thread notifier([&]() {
+        while (!stop.load()) {
+            machine.TransitionTo(kDeviceStateSpeaking);
+            machine.TransitionTo(kDeviceStateListening);
+            rounds++;
+        }
+    });
+    while (rounds.load() == 0) {
+        std::this_thread::yield();
+    }
+
+    std::vector<std::thread> writers;
+    for (int i = 0; i < 4; i++) {
+        writers.emplace_back([&]() {
+            for (int n = 0; n < 2000; n++) {
+                int id = machine.AddStateChangeListener([&](DeviceState, DeviceState) { notified++; });
+                std::this_thread::yield();
+                machine.RemoveStateChangeListener(id);
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    stop = true;
+    notifier.join();
+    printf("%d rounds, %d notifications while listeners changed\n", rounds.load(), notified.load());
+}
+
+int main() {
+    TestEveryTransition();
+    TestListeners();
+    TestConcurrentListeners();
+    if (failures != 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("device_state_machine_test passed\n");
+    return 0;
+}
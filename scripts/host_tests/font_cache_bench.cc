@@ -0,0 +1,282 @@
+// Check and time the glyph caches of LvglCBinFont (main/display/lvgl_display/lvgl_font.cc)
+// The cbin font is faked: a sorted letter table searched like the fmt_txt cmaps and
+// run-length packed A8 bitmaps unpacked into the draw buffer, so the numbers show the
+// cost of a cache hit against a lookup and unpack, not the flash access of the device.
+// Usage: font_cache_bench [passes]
+
+#include "lvgl_font.h"
+
+#include <cbin_font.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#define GLYPH_COUNT 3500
+#define MAX_GLYPH_SIZE 32
+
+struct FakeGlyph {
+    uint16_t adv_w;
+    uint16_t box_w;
+    uint16_t box_h;
+    int16_t ofs_x;
+    int16_t ofs_y;
+    std::vector<uint8_t> runs;  // (count, value) pairs
+};
+
+struct FakeFontData {
+    std::vector<uint32_t> letters;  // Sorted
+    std::vector<FakeGlyph> glyphs;
+    bool kerning;
+};
+
+struct FakeFont {
+    lv_font_t font;
+    lv_font_fmt_txt_dsc_t fmt_dsc;
+};
+
+static int kerning_table = 0;
+static size_t bitmap_unpacks = 0;
+
+extern "C" bool lv_font_get_glyph_dsc_fmt_txt(const lv_font_t* font, lv_font_glyph_dsc_t* dsc, uint32_t letter,
+                                              uint32_t letter_next) {
+    auto data = static_cast<const FakeFontData*>(font->user_data);
+    auto it = std::lower_bound(data->letters.begin(), data->letters.end(), letter);
+    if (it == data->letters.end() || *it != letter) {
+        return false;
+    }
+    uint32_t index = it - data->letters.begin();
+    const auto& glyph = data->glyphs[index];
+    dsc->adv_w = glyph.adv_w;
+    if (data->kerning && ((letter + letter_next) % 3) == 0) {
+        dsc->adv_w--;
+    }
+    dsc->box_w = glyph.box_w;
+    dsc->box_h = glyph.box_h;
+    dsc->ofs_x = glyph.ofs_x;
+    dsc->ofs_y = glyph.ofs_y;
+    dsc->format = LV_FONT_GLYPH_FORMAT_A8;
+    dsc->is_placeholder = 0;
+    dsc->gid.index = index;
+    return true;
+}
+
+static const void* FakeGetGlyphBitmap(lv_font_glyph_dsc_t* dsc, lv_draw_buf_t* draw_buf) {
+    auto data = static_cast<const FakeFontData*>(dsc->resolved_font->user_data);
+    const auto& glyph = data->glyphs[dsc->gid.index];
+    if (lv_draw_buf_reshape(draw_buf, LV_COLOR_FORMAT_A8, glyph.box_w, glyph.box_h, glyph.box_w) == nullptr) {
+        return nullptr;
+    }
+    uint8_t* out = draw_buf->data;
+    for (size_t i = 0; i + 1 < glyph.runs.size(); i += 2) {
+        memset(out, glyph.runs[i + 1], glyph.runs[i]);
+        out += glyph.runs[i];
+    }
+    bitmap_unpacks++;
+    return draw_buf;
+}
+
+extern "C" lv_font_t* cbin_font_create(uint8_t* data) {
+    auto font_data = reinterpret_cast<FakeFontData*>(data);
+    auto fake = new FakeFont();
+    fake->fmt_dsc.kern_dsc = font_data->kerning ? &kerning_table : nullptr;
+    fake->font.get_glyph_dsc = lv_font_get_glyph_dsc_fmt_txt;
+    fake->font.get_glyph_bitmap = FakeGetGlyphBitmap;
+    fake->font.line_height = MAX_GLYPH_SIZE;
+    fake->font.dsc = &fake->fmt_dsc;
+    fake->font.user_data = font_data;
+    return &fake->font;
+}
+
+extern "C" void cbin_font_delete(lv_font_t* font) {
+    delete reinterpret_cast<FakeFont*>(font);
+}
+
+static FakeFontData MakeFontData(bool kerning) {
+    FakeFontData data;
+    data.kerning = kerning;
+    std::mt19937 rng(1);
+    for (int i = 0; i < GLYPH_COUNT; i++) {
+        data.letters.push_back(0x4E00 + i * 3);
+        FakeGlyph glyph;
+        glyph.box_w = 14 + rng() % 11;
+        glyph.box_h = 14 + rng() % 11;
+        glyph.adv_w = glyph.box_w + 2;
+        glyph.ofs_x = rng() % 3;
+        glyph.ofs_y = -(int)(rng() % 4);
+        int left = glyph.box_w * glyph.box_h;
+        while (left > 0) {
+            int count = std::min<int>(left, 1 + rng() % 6);
+            glyph.runs.push_back(count);
+            glyph.runs.push_back(rng() % 3 == 0 ? 0 : rng() % 256);
+            left -= count;
+        }
+        data.glyphs.push_back(std::move(glyph));
+    }
+    return data;
+}
+
+// Subtitle-like text: common letters repeat often, a few are not in the font
+static std::vector<uint32_t> MakeText(size_t length) {
+    std::mt19937 rng(2);
+    std::vector<double> weights;
+    for (int i = 0; i < GLYPH_COUNT; i++) {
+        weights.push_back(1.0 / (i + 1));
+    }
+    std::discrete_distribution<int> zipf(weights.begin(), weights.end());
+    std::vector<int> order(GLYPH_COUNT);
+    for (int i = 0; i < GLYPH_COUNT; i++) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), rng);
+
+    std::vector<uint32_t> text;
+    for (size_t i = 0; i < length; i++) {
+        if (rng() % 20 == 0) {
+            text.push_back(0x20 + rng() % 0x5F);
+        } else {
+            text.push_back(0x4E00 + order[zipf(rng)] * 3);
+        }
+    }
+    return text;
+}
+
+// A label showing lines of the text, each redrawn a few times as it updates or scrolls
+static std::vector<uint32_t> MakeRedraws(const std::vector<uint32_t>& text, size_t line_length, int redraws) {
+    std::vector<uint32_t> result;
+    for (size_t start = 0; start < text.size(); start += line_length) {
+        size_t end = std::min(text.size(), start + line_length);
+        for (int i = 0; i < redraws; i++) {
+            result.insert(result.end(), text.begin() + start, text.begin() + end);
+        }
+    }
+    return result;
+}
+
+struct DrawBuf {
+    std::vector<uint8_t> data = std::vector<uint8_t>(MAX_GLYPH_SIZE * MAX_GLYPH_SIZE);
+    lv_draw_buf_t buf = {};
+
+    DrawBuf() {
+        buf.data = data.data();
+        buf.data_size = data.size();
+    }
+};
+
+static int failures = 0;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+            return; \
+        } \
+    } while (0)
+
+// Every descriptor and bitmap of the cached font must match the uncached one
+static void Check(const char* name, FakeFontData& data, const std::vector<uint32_t>& text, size_t budget) {
+    auto reference = cbin_font_create(reinterpret_cast<uint8_t*>(&data));
+    LvglCBinFont cached(&data, budget);
+    auto font = cached.font();
+    DrawBuf ref_buf, cached_buf;
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < text.size(); i++) {
+            uint32_t next = i + 1 < text.size() ? text[i + 1] : 0;
+            lv_font_glyph_dsc_t a = {}, b = {};
+            bool found_a = reference->get_glyph_dsc(reference, &a, text[i], next);
+            bool found_b = font->get_glyph_dsc(font, &b, text[i], next);
+            CHECK(found_a == found_b, "%s: letter 0x%X found %d, cached %d", name, (unsigned)text[i], found_a, found_b);
+            if (!found_a) {
+                continue;
+            }
+            CHECK(a.adv_w == b.adv_w && a.box_w == b.box_w && a.box_h == b.box_h && a.ofs_x == b.ofs_x &&
+                  a.ofs_y == b.ofs_y && a.format == b.format && a.is_placeholder == b.is_placeholder &&
+                  a.gid.index == b.gid.index, "%s: descriptor of letter 0x%X differs", name, (unsigned)text[i]);
+
+            a.resolved_font = reference;
+            b.resolved_font = font;
+            memset(cached_buf.data.data(), 0xCD, cached_buf.data.size());
+            auto bitmap_a = reference->get_glyph_bitmap(&a, &ref_buf.buf);
+            auto bitmap_b = font->get_glyph_bitmap(&b, &cached_buf.buf);
+            CHECK(bitmap_a == &ref_buf.buf && bitmap_b == &cached_buf.buf, "%s: no bitmap of letter 0x%X", name,
+                  (unsigned)text[i]);
+            auto& ha = ref_buf.buf.header;
+            auto& hb = cached_buf.buf.header;
+            CHECK(ha.cf == hb.cf && ha.w == hb.w && ha.h == hb.h && ha.stride == hb.stride,
+                  "%s: bitmap header of letter 0x%X differs", name, (unsigned)text[i]);
+            CHECK(memcmp(ref_buf.data.data(), cached_buf.data.data(), ha.stride * ha.h) == 0,
+                  "%s: bitmap of letter 0x%X differs", name, (unsigned)text[i]);
+        }
+    }
+    cbin_font_delete(reference);
+    printf("%-28s ok\n", name);
+}
+
+// Look up and unpack every letter of the text, as a label redraw does
+static double Render(const lv_font_t* font, const std::vector<uint32_t>& text, int passes) {
+    DrawBuf draw_buf;
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        for (size_t i = 0; i < text.size(); i++) {
+            lv_font_glyph_dsc_t dsc = {};
+            uint32_t next = i + 1 < text.size() ? text[i + 1] : 0;
+            if (font->get_glyph_dsc(font, &dsc, text[i], next)) {
+                dsc.resolved_font = font;
+                font->get_glyph_bitmap(&dsc, &draw_buf.buf);
+            }
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / ((double)passes * text.size());
+}
+
+static void Bench(const char* name, FakeFontData& data, const std::vector<uint32_t>& text, size_t budget,
+                  int passes, double reference_ns) {
+    LvglCBinFont cached(&data, budget);
+    Render(cached.font(), text, 1);  // Warm up the caches
+    bitmap_unpacks = 0;
+    double ns = Render(cached.font(), text, passes);
+    printf("%-28s %7.1f ns/glyph  %.2fx  %5.1f%% unpacked\n", name, ns, reference_ns / ns,
+           100.0 * bitmap_unpacks / ((double)passes * text.size()));
+}
+
+int main(int argc, char** argv) {
+    int passes = argc > 1 ? atoi(argv[1]) : 20;
+    auto plain = MakeFontData(false);
+    auto kerning = MakeFontData(true);
+    auto text = MakeText(20000);
+
+    Check("default budget", plain, text, FONT_GLYPH_CACHE_BUDGET);
+    Check("4KB budget, evicting", plain, text, 4 * 1024);
+    Check("no bitmap cache", plain, text, 0);
+    Check("kerning font", kerning, text, FONT_GLYPH_CACHE_BUDGET);
+    Check("redrawn lines, 4KB budget", plain, MakeRedraws(text, 40, 2), 4 * 1024);
+    if (failures != 0) {
+        return 1;
+    }
+
+    auto redraws = MakeRedraws(std::vector<uint32_t>(text.begin(), text.begin() + 4000), 40, 5);
+    const std::pair<const char*, const std::vector<uint32_t>*> workloads[] = {
+        { "mixed text", &text },
+        { "40 letter lines, 5 redraws", &redraws },
+    };
+    for (const auto& [workload, letters] : workloads) {
+        printf("== %s\n", workload);
+        auto reference = cbin_font_create(reinterpret_cast<uint8_t*>(&plain));
+        double reference_ns = Render(reference, *letters, passes);
+        printf("%-28s %7.1f ns/glyph\n", "uncached", reference_ns);
+        cbin_font_delete(reference);
+        Bench("16KB budget", plain, *letters, 16 * 1024, passes, reference_ns);
+        Bench("128KB budget", plain, *letters, 128 * 1024, passes, reference_ns);
+        Bench("descriptors only", plain, *letters, 0, passes, reference_ns);
+    }
+    return 0;
+}
@@ -0,0 +1,204 @@
+// Compare and time main/display/lvgl_display/gif/gifdec.c against gifdec_reference.c,
+// the decoder before the LZW rewrite.
+// Usage: gifdec_bench [-n passes] <file.gif | directory> ...
+// Every frame of every GIF is rendered by both decoders into their canvas, as the
+// LVGL gif widget does, and must be identical. Then each decoder decodes and
+// renders all frames n times. Looping GIFs are played once.
+
+#include "gifdec.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// gifdec_reference.c is built with its gd_ functions renamed to ref_gd_
+gd_GIF * ref_gd_open_gif_data(const void * data);
+void ref_gd_render_frame(gd_GIF * gif, uint8_t * buffer);
+int ref_gd_get_frame(gd_GIF * gif);
+void ref_gd_close_gif(gd_GIF * gif);
+
+typedef struct {
+    gd_GIF * (*open)(const void * data);
+    int (*get_frame)(gd_GIF * gif);
+    void (*render_frame)(gd_GIF * gif, uint8_t * buffer);
+    void (*close)(gd_GIF * gif);
+} Decoder;
+
+static const Decoder new_decoder = { gd_open_gif_data, gd_get_frame, gd_render_frame, gd_close_gif };
+static const Decoder ref_decoder = { ref_gd_open_gif_data, ref_gd_get_frame, ref_gd_render_frame, ref_gd_close_gif };
+
+// Stop after this many frames, in case a broken file never reaches its trailer
+#define MAX_FRAMES 10000
+
+static gd_GIF * open_once(const Decoder * decoder, const void * data)
+{
+    gd_GIF * gif = decoder->open(data);
+    if(gif != NULL) {
+        gif->loop_count = 1;
+    }
+    return gif;
+}
+
+static int passes = 20;
+static int failed_files = 0;
+static double total_ref_ms = 0, total_new_ms = 0;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static char * read_file(const char * path, long * size)
+{
+    FILE * f = fopen(path, "rb");
+    if(f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char * data = malloc(*size);
+    if(fread(data, 1, *size, f) != (size_t)*size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+// Returns the number of frames, or -1 if the decoders disagree
+static int compare(const char * path, const char * data, int * width, int * height)
+{
+    gd_GIF * a = open_once(&ref_decoder, data);
+    gd_GIF * b = open_once(&new_decoder, data);
+    if(a == NULL || b == NULL) {
+        printf("%s: %s decoder failed to open it\n", path, a == NULL ? "reference" : "new");
+        if(a) ref_decoder.close(a);
+        if(b) new_decoder.close(b);
+        return -1;
+    }
+    *width = b->width;
+    *height = b->height;
+    size_t size = (size_t)b->width * b->height * 4;
+
+    int frames = 0;
+    int result = 0;
+    while(frames < MAX_FRAMES) {
+        int ra = ref_decoder.get_frame(a);
+        int rb = new_decoder.get_frame(b);
+        if(ra != rb) {
+            printf("%s: frame %d, get_frame returned %d (reference) and %d (new)\n", path, frames, ra, rb);
+            result = -1;
+            break;
+        }
+        if(ra != 1) {
+            break;
+        }
+        ref_decoder.render_frame(a, a->canvas);
+        new_decoder.render_frame(b, b->canvas);
+        if(memcmp(a->canvas, b->canvas, size) != 0) {
+            size_t i = 0;
+            while(a->canvas[i] == b->canvas[i]) i++;
+            printf("%s: frame %d differs at pixel (%d, %d)\n", path, frames,
+                   (int)(i / 4 % b->width), (int)(i / 4 / b->width));
+            result = -1;
+            break;
+        }
+        frames++;
+    }
+    ref_decoder.close(a);
+    new_decoder.close(b);
+    return result < 0 ? result : frames;
+}
+
+static double time_decoder(const Decoder * decoder, const char * data, int frames)
+{
+    double start = now_ms();
+    for(int pass = 0; pass < passes; pass++) {
+        gd_GIF * gif = open_once(decoder, data);
+        for(int i = 0; i < frames && decoder->get_frame(gif) == 1; i++) {
+            decoder->render_frame(gif, gif->canvas);
+        }
+        decoder->close(gif);
+    }
+    return now_ms() - start;
+}
+
+static void bench_file(const char * path)
+{
+    long size;
+    char * data = read_file(path, &size);
+    if(data == NULL) {
+        printf("%s: cannot read\n", path);
+        failed_files++;
+        return;
+    }
+    int width = 0, height = 0;
+    int frames = compare(path, data, &width, &height);
+    if(frames < 0) {
+        failed_files++;
+        free(data);
+        return;
+    }
+    double ref_ms = time_decoder(&ref_decoder, data, frames);
+    double new_ms = time_decoder(&new_decoder, data, frames);
+    total_ref_ms += ref_ms;
+    total_new_ms += new_ms;
+    printf("%-48s %4dx%-4d %4d frames  reference %8.1f ms  new %8.1f ms  %.2fx\n", path, width, height, frames,
+           ref_ms, new_ms, new_ms > 0 ? ref_ms / new_ms : 0);
+    free(data);
+}
+
+static void bench_path(const char * path)
+{
+    DIR * dir = opendir(path);
+    if(dir == NULL) {
+        bench_file(path);
+        return;
+    }
+    struct dirent * entry;
+    while((entry = readdir(dir)) != NULL) {
+        if(entry->d_name[0] == '.') {
+            continue;
+        }
+        char child[4096];
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        size_t len = strlen(entry->d_name);
+        DIR * sub = opendir(child);
+        if(sub != NULL) {
+            closedir(sub);
+            bench_path(child);
+        }
+        else if(len > 4 && strcasecmp(entry->d_name + len - 4, ".gif") == 0) {
+            bench_file(child);
+        }
+    }
+    closedir(dir);
+}
+
+int main(int argc, char ** argv)
+{
+    int arg = 1;
+    if(arg + 1 < argc && strcmp(argv[arg], "-n") == 0) {
+        passes = atoi(argv[arg + 1]);
+        arg += 2;
+    }
+    if(arg >= argc) {
+        printf("Usage: %s [-n passes] <file.gif | directory> ...\n", argv[0]);
+        return 2;
+    }
+    for(; arg < argc; arg++) {
+        bench_path(argv[arg]);
+    }
+    printf("%d passes: reference %.1f ms, new %.1f ms, %.2fx\n", passes, total_ref_ms, total_new_ms,
+           total_new_ms > 0 ? total_ref_ms / total_new_ms : 0);
+    if(failed_files != 0) {
+        printf("%d files differ or failed\n", failed_files);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""
+Pack test images with scripts/spiffs_assets/assets_table.py for assets_table_test:
+a full image, and an incremental one laid out against the first with some entries
+changed, added and removed. Each image gets a manifest with one line per file:
+<table index> <size> <crc32> <name>
+
+Usage: make_test_assets.py <output_dir>
+"""
+
+import os
+import random
+import sys
+import zlib
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'spiffs_assets'))
+import assets_table  # noqa: E402
+
+MAX_NAME_LEN = 32
+
+
+def random_files(rng, count):
+    names = set()
+    while len(names) < count:
+        stem = ''.join(rng.choice('abcdefghijklmnopqrstuvwxyz_0123456789') for _ in range(rng.randint(1, 24)))
+        names.add(stem + rng.choice(['.png', '.gif', '.bin', '.json', '']))
+    # Names at the limits of the fixed name field, and a prefix of another name
+    names.update(['a', 'x' * MAX_NAME_LEN, 'emoji_happy.png', 'emoji_happy.png.bak', 'index.json'])
+    files = []
+    for name in sorted(names):
+        data = bytes(rng.randrange(256) for _ in range(rng.randint(0, 3000)))
+        files.append((name, data, rng.randint(0, 480), rng.randint(0, 480)))
+    return files
+
+
+def write_image(out_dir, name, files, base=None):
+    image, entries, _, _ = assets_table.pack_assets_image(files, MAX_NAME_LEN, base)
+    path = os.path.join(out_dir, name + '.bin')
+    with open(path, 'wb') as f:
+        f.write(image)
+    data = {n: d for n, d, _, _ in files}
+    with open(os.path.join(out_dir, name + '.txt'), 'w') as f:
+        for index, (file_name, _, size, _, _) in enumerate(entries):
+            crc = zlib.crc32(data[file_name]) if file_name in data else 0
+            f.write(f'{index} {size} {crc} {file_name}\n')
+    return path
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__)
+        sys.exit(1)
+    out_dir = sys.argv[1]
+    os.makedirs(out_dir, exist_ok=True)
+    rng = random.Random(3)
+
+    files = random_files(rng, 200)
+    base = write_image(out_dir, 'full', files)
+
+    changed = []
+    for name, data, width, height in files:
+        roll = rng.random()
+        if roll < 0.1:
+            continue
+        if roll < 0.3:
+            data = bytes(rng.randrange(256) for _ in range(rng.randint(0, 3000)))
+        changed.append((name, data, width, height))
+    changed += random_files(rng, 20)[:20]
+    changed = list({f[0]: f for f in changed}.values())
+    write_image(out_dir, 'incremental', changed, base)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""
+Write synthetic GIFs for gifdec_bench: 1-8 bit palettes, local palettes,
+interlacing, transparency, every disposal mode and partial frames.
+GIFs embedded as C arrays in the given source directories (e.g. the emoji of
+managed_components/txp666__otto-emoji-gif-component) are written out as well.
+
+Usage: make_test_gifs.py <output_dir> [source_dir ...]
+"""
+
+import os
+import random
+import re
+import struct
+import sys
+
+
+def lzw_encode(indices, min_size):
+    clear = 1 << min_size
+    stop = clear + 1
+    size = min_size + 1
+    next_code = clear + 2
+    table = {bytes([i]): i for i in range(clear)}
+    out = bytearray()
+    bits = 0
+    nbits = 0
+
+    def emit(code):
+        nonlocal bits, nbits
+        bits |= code << nbits
+        nbits += size
+        while nbits >= 8:
+            out.append(bits & 0xFF)
+            bits >>= 8
+            nbits -= 8
+
+    emit(clear)
+    prefix = b''
+    for i in indices:
+        string = prefix + bytes([i])
+        if string in table:
+            prefix = string
+            continue
+        emit(table[prefix])
+        if next_code < 4096:
+            table[string] = next_code
+            next_code += 1
+            if next_code > (1 << size) and size < 12:
+                size += 1
+        else:
+            # Table full, start over
+            emit(clear)
+            table = {bytes([k]): k for k in range(clear)}
+            size = min_size + 1
+            next_code = clear + 2
+        prefix = bytes([i])
+    if prefix:
+        emit(table[prefix])
+    emit(stop)
+    if nbits:
+        out.append(bits & 0xFF)
+
+    result = bytearray([min_size])
+    for i in range(0, len(out), 255):
+        chunk = out[i:i + 255]
+        result.append(len(chunk))
+        result += chunk
+    result.append(0)
+    return bytes(result)
+
+
+def make_gif(path, width, height, frames, depth, seed, interlace=False, local=False, noise=0.5):
+    rng = random.Random(seed)
+    colors = 1 << depth
+    gif = bytearray(b'GIF89a' + struct.pack('<HH', width, height))
+    gif += bytes([0x80 | ((depth - 1) << 4) | (depth - 1), 1, 0])
+    gif += bytes(rng.randrange(256) for _ in range(3 * colors))
+    gif += b'\x21\xff\x0bNETSCAPE2.0\x03\x01\x00\x00\x00'
+    for frame in range(frames):
+        fw = rng.randint(1, width)
+        fh = rng.randint(1, height)
+        fx = rng.randint(0, width - fw)
+        fy = rng.randint(0, height - fh)
+        if frame == 0:
+            fx, fy, fw, fh = 0, 0, width, height
+        disposal = rng.choice([0, 1, 2, 3])
+        transparent = rng.random() < 0.5
+        gif += b'\x21\xf9\x04' + bytes([(disposal << 2) | (1 if transparent else 0)])
+        gif += struct.pack('<H', rng.randint(1, 10)) + bytes([rng.randrange(colors), 0])
+
+        flags = 0x40 if interlace else 0
+        if local:
+            flags |= 0x80 | (depth - 1)
+        gif += b',' + struct.pack('<HHHH', fx, fy, fw, fh) + bytes([flags])
+        if local:
+            gif += bytes(rng.randrange(256) for _ in range(3 * colors))
+
+        pixels = []
+        current = rng.randrange(colors)
+        for _ in range(fw * fh):
+            if rng.random() < noise:
+                current = rng.randrange(colors)
+            pixels.append(current)
+        if interlace:
+            rows = [pixels[y * fw:(y + 1) * fw] for y in range(fh)]
+            order = list(range(0, fh, 8)) + list(range(4, fh, 8)) + list(range(2, fh, 4)) + list(range(1, fh, 2))
+            pixels = [p for y in order for p in rows[y]]
+        gif += lzw_encode(pixels, max(2, depth))
+    gif += b';'
+    with open(path, 'wb') as f:
+        f.write(gif)
+
+
+# width, height, frames, depth, interlace, local palette, noise
+CASES = [
+    (64, 64, 8, 2, False, False, 0.5),
+    (128, 128, 12, 8, False, False, 0.9),
+    (160, 160, 24, 4, False, True, 0.05),
+    (97, 53, 10, 8, True, False, 0.3),
+    (240, 240, 6, 8, False, False, 1.0),
+    (33, 200, 15, 1, True, True, 0.5),
+    (120, 120, 30, 6, False, False, 0.02),
+    (200, 150, 5, 8, True, True, 0.7),
+]
+
+
+C_ARRAY = re.compile(r'(\w+)\s*\[\s*\w*\s*\]\s*=\s*\{([^}]*)\}', re.S)
+
+
+def extract_gifs(source_dir, out_dir):
+    """Write every C array of a source tree that holds a GIF, returns the count"""
+    count = 0
+    for root, _, files in os.walk(source_dir):
+        for name in sorted(files):
+            if not name.endswith(('.c', '.h')):
+                continue
+            with open(os.path.join(root, name), 'r', errors='ignore') as f:
+                source = f.read()
+            for match in C_ARRAY.finditer(source):
+                values = re.findall(r'0[xX][0-9a-fA-F]+|\d+', match.group(2)[:64])
+                if [int(v, 0) for v in values[:4]] != list(b'GIF8'):
+                    continue
+                data = bytes(int(v, 0) & 0xFF for v in re.findall(r'0[xX][0-9a-fA-F]+|\d+', match.group(2)))
+                with open(os.path.join(out_dir, f'{match.group(1)}.gif'), 'wb') as f:
+                    f.write(data)
+                count += 1
+    return count
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+    out_dir = sys.argv[1]
+    os.makedirs(out_dir, exist_ok=True)
+    for i, case in enumerate(CASES):
+        width, height, frames, depth, interlace, local, noise = case
+        make_gif(os.path.join(out_dir, f'test_{i}.gif'), width, height, frames, depth, i,
+                 interlace=interlace, local=local, noise=noise)
+    for source_dir in sys.argv[2:]:
+        print(f'{extract_gifs(source_dir, out_dir)} GIFs extracted from {source_dir}')
+
+
+if __name__ == '__main__':
+    main()
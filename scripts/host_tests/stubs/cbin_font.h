@@ -0,0 +1,15 @@
+// Host stand-in of cbin_font.h, the font is faked by the test
+#pragma once
+
+#include <lvgl.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+lv_font_t * cbin_font_create(uint8_t * data);
+void cbin_font_delete(lv_font_t * font);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
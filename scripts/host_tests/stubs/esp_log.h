@@ -0,0 +1,20 @@
+// Host stand-in of esp_log.h, only what the tested sources use
+#pragma once
+
+#include <stdio.h>
+
+#ifndef HOST_TEST_VERBOSE
+#define HOST_TEST_VERBOSE 0
+#endif
+
+#define HOST_LOG(level, tag, format, ...) \
+    do { \
+        if (HOST_TEST_VERBOSE || level[0] == 'E') { \
+            printf(level " (%s) " format "\n", tag, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG("D", tag, format, ##__VA_ARGS__)
@@ -0,0 +1,127 @@
+// Host stand-in of lvgl.h, only what the tested sources use
+#pragma once
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LV_GIF_CACHE_DECODE_DATA 0
+#define LV_USE_DRAW_SW_ASM 0
+#define LV_DRAW_SW_ASM_HELIUM 2
+
+static inline void * lv_malloc(size_t size) { return malloc(size); }
+static inline void * lv_realloc(void * p, size_t size) { return realloc(p, size); }
+static inline void lv_free(void * p) { free(p); }
+
+// File system, backed by stdio
+typedef FILE * lv_fs_file_t;
+typedef int lv_fs_res_t;
+#define LV_FS_RES_OK 0
+#define LV_FS_MODE_RD 1
+#define LV_FS_SEEK_SET SEEK_SET
+#define LV_FS_SEEK_CUR SEEK_CUR
+
+static inline lv_fs_res_t lv_fs_open(lv_fs_file_t * f, const char * path, int mode) {
+    *f = fopen(path, "rb");
+    return *f != NULL ? LV_FS_RES_OK : 1;
+}
+static inline lv_fs_res_t lv_fs_read(lv_fs_file_t * f, void * buf, uint32_t len, uint32_t * read) {
+    size_t n = fread(buf, 1, len, *f);
+    if (read != NULL) {
+        *read = (uint32_t)n;
+    }
+    return LV_FS_RES_OK;
+}
+static inline lv_fs_res_t lv_fs_seek(lv_fs_file_t * f, uint32_t pos, int whence) {
+    return fseek(*f, (long)pos, whence) == 0 ? LV_FS_RES_OK : 1;
+}
+static inline lv_fs_res_t lv_fs_tell(lv_fs_file_t * f, uint32_t * pos) {
+    *pos = (uint32_t)ftell(*f);
+    return LV_FS_RES_OK;
+}
+static inline lv_fs_res_t lv_fs_close(lv_fs_file_t * f) {
+    fclose(*f);
+    return LV_FS_RES_OK;
+}
+
+// Fonts and draw buffers
+typedef uint8_t lv_color_format_t;
+#define LV_COLOR_FORMAT_A8 0x0E
+
+typedef enum {
+    LV_FONT_GLYPH_FORMAT_NONE = 0,
+    LV_FONT_GLYPH_FORMAT_A1 = 0x01,
+    LV_FONT_GLYPH_FORMAT_A2 = 0x02,
+    LV_FONT_GLYPH_FORMAT_A4 = 0x04,
+    LV_FONT_GLYPH_FORMAT_A8 = 0x08,
+} lv_font_glyph_format_t;
+
+typedef struct {
+    uint32_t cf;
+    uint32_t w;
+    uint32_t h;
+    uint32_t stride;
+} lv_image_header_t;
+
+typedef struct {
+    lv_image_header_t header;
+    uint32_t data_size;
+    uint8_t * data;
+} lv_draw_buf_t;
+
+static inline lv_draw_buf_t * lv_draw_buf_reshape(lv_draw_buf_t * draw_buf, lv_color_format_t cf, uint32_t w,
+                                                  uint32_t h, uint32_t stride) {
+    if (draw_buf == NULL || (size_t)stride * h > draw_buf->data_size) {
+        return NULL;
+    }
+    draw_buf->header.cf = cf;
+    draw_buf->header.w = w;
+    draw_buf->header.h = h;
+    draw_buf->header.stride = stride;
+    return draw_buf;
+}
+
+struct _lv_font_t;
+
+typedef struct {
+    const struct _lv_font_t * resolved_font;
+    uint16_t adv_w;
+    uint16_t box_w;
+    uint16_t box_h;
+    int16_t ofs_x;
+    int16_t ofs_y;
+    lv_font_glyph_format_t format;
+    uint8_t is_placeholder : 1;
+    union {
+        uint32_t index;
+        const void * src;
+    } gid;
+} lv_font_glyph_dsc_t;
+
+typedef struct _lv_font_t {
+    bool (*get_glyph_dsc)(const struct _lv_font_t *, lv_font_glyph_dsc_t *, uint32_t letter, uint32_t letter_next);
+    const void * (*get_glyph_bitmap)(lv_font_glyph_dsc_t *, lv_draw_buf_t *);
+    int32_t line_height;
+    int32_t base_line;
+    const void * dsc;
+    void * user_data;
+} lv_font_t;
+
+typedef struct {
+    const void * kern_dsc;
+} lv_font_fmt_txt_dsc_t;
+
+// Provided by the test, the fake cbin font uses it as its lookup
+bool lv_font_get_glyph_dsc_fmt_txt(const lv_font_t * font, lv_font_glyph_dsc_t * dsc, uint32_t letter,
+                                   uint32_t letter_next);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
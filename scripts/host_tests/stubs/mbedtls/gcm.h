@@ -0,0 +1,76 @@
+// Host stand-in of mbedtls/gcm.h backed by OpenSSL libcrypto, only what the tested sources use
+#pragma once
+
+#include <openssl/evp.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MBEDTLS_GCM_ENCRYPT 1
+#define MBEDTLS_GCM_DECRYPT 0
+#define MBEDTLS_ERR_GCM_AUTH_FAILED -0x0012
+#define MBEDTLS_ERR_GCM_BAD_INPUT -0x0014
+
+typedef enum {
+    MBEDTLS_CIPHER_ID_NONE = 0,
+    MBEDTLS_CIPHER_ID_NULL,
+    MBEDTLS_CIPHER_ID_AES,
+} mbedtls_cipher_id_t;
+
+typedef struct {
+    EVP_CIPHER_CTX* encrypt;
+    EVP_CIPHER_CTX* decrypt;
+} mbedtls_gcm_context;
+
+static inline void mbedtls_gcm_init(mbedtls_gcm_context* ctx) {
+    ctx->encrypt = EVP_CIPHER_CTX_new();
+    ctx->decrypt = EVP_CIPHER_CTX_new();
+}
+
+static inline void mbedtls_gcm_free(mbedtls_gcm_context* ctx) {
+    EVP_CIPHER_CTX_free(ctx->encrypt);
+    EVP_CIPHER_CTX_free(ctx->decrypt);
+    ctx->encrypt = ctx->decrypt = NULL;
+}
+
+static inline int mbedtls_gcm_setkey(mbedtls_gcm_context* ctx, mbedtls_cipher_id_t cipher, const unsigned char* key,
+                                     unsigned int keybits) {
+    if (cipher != MBEDTLS_CIPHER_ID_AES || keybits != 128 ||
+        EVP_EncryptInit_ex(ctx->encrypt, EVP_aes_128_gcm(), NULL, key, NULL) != 1 ||
+        EVP_DecryptInit_ex(ctx->decrypt, EVP_aes_128_gcm(), NULL, key, NULL) != 1) {
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    }
+    return 0;
+}
+
+static inline int mbedtls_gcm_crypt_and_tag(mbedtls_gcm_context* ctx, int mode, size_t length, const unsigned char* iv,
+                                            size_t iv_len, const unsigned char* add, size_t add_len,
+                                            const unsigned char* input, unsigned char* output, size_t tag_len,
+                                            unsigned char* tag) {
+    EVP_CIPHER_CTX* c = ctx->encrypt;
+    int len = 0;
+    if (mode != MBEDTLS_GCM_ENCRYPT || EVP_CIPHER_CTX_ctrl(c, EVP_CTRL_GCM_SET_IVLEN, (int)iv_len, NULL) != 1 ||
+        EVP_EncryptInit_ex(c, NULL, NULL, NULL, iv) != 1 ||
+        (add_len > 0 && EVP_EncryptUpdate(c, NULL, &len, add, (int)add_len) != 1) ||
+        (length > 0 && EVP_EncryptUpdate(c, output, &len, input, (int)length) != 1) ||
+        EVP_EncryptFinal_ex(c, output + length, &len) != 1 ||
+        EVP_CIPHER_CTX_ctrl(c, EVP_CTRL_GCM_GET_TAG, (int)tag_len, tag) != 1) {
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    }
+    return 0;
+}
+
+static inline int mbedtls_gcm_auth_decrypt(mbedtls_gcm_context* ctx, size_t length, const unsigned char* iv,
+                                           size_t iv_len, const unsigned char* add, size_t add_len,
+                                           const unsigned char* tag, size_t tag_len, const unsigned char* input,
+                                           unsigned char* output) {
+    EVP_CIPHER_CTX* c = ctx->decrypt;
+    int len = 0;
+    if (EVP_CIPHER_CTX_ctrl(c, EVP_CTRL_GCM_SET_IVLEN, (int)iv_len, NULL) != 1 ||
+        EVP_DecryptInit_ex(c, NULL, NULL, NULL, iv) != 1 ||
+        (add_len > 0 && EVP_DecryptUpdate(c, NULL, &len, add, (int)add_len) != 1) ||
+        (length > 0 && EVP_DecryptUpdate(c, output, &len, input, (int)length) != 1) ||
+        EVP_CIPHER_CTX_ctrl(c, EVP_CTRL_GCM_SET_TAG, (int)tag_len, (void*)tag) != 1) {
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    }
+    return EVP_DecryptFinal_ex(c, output + length, &len) == 1 ? 0 : MBEDTLS_ERR_GCM_AUTH_FAILED;
+}
@@ -0,0 +1,222 @@
+// Check and time the UDP audio encryption of MqttProtocol (main/protocols/udp_audio_cipher.h)
+// mbedtls is replaced by stubs/mbedtls over OpenSSL, so the times compare the packet paths
+// and the two modes on the host CPU, not the AES peripheral of the device.
+// Usage: udp_cipher_bench [packets]
+
+#include "protocols/udp_audio_cipher.h"
+
+#include <arpa/inet.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+// Opus at 16 kHz, 60 ms frames
+#define PAYLOAD_SIZE 160
+
+static int failures = 0;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+struct Session {
+    mbedtls_aes_context aes;
+    mbedtls_gcm_context gcm;
+    std::string nonce;
+    uint32_t sequence = 0;
+    std::string send_buffer;
+
+    explicit Session(const uint8_t* key) : nonce(MQTT_UDP_HEADER_SIZE, '\0') {
+        mbedtls_aes_init(&aes);
+        mbedtls_gcm_init(&gcm);
+        mbedtls_aes_setkey_enc(&aes, key, 128);
+        mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, key, 128);
+        nonce[0] = 0x01;
+        for (int i = 4; i < 8; i++) {
+            nonce[i] = (char)(0x10 + i);
+        }
+    }
+
+    ~Session() {
+        mbedtls_aes_free(&aes);
+        mbedtls_gcm_free(&gcm);
+    }
+
+    // As MqttProtocol::SendAudio does, the datagram is built and encrypted in the reused buffer
+    const std::string& Send(const std::vector<uint8_t>& payload, uint32_t timestamp, bool gcm_mode) {
+        size_t tag_size = gcm_mode ? MQTT_UDP_GCM_TAG_SIZE : 0;
+        send_buffer.resize(MQTT_UDP_HEADER_SIZE + payload.size() + tag_size);
+        auto header = (uint8_t*)send_buffer.data();
+        memcpy(header, nonce.data(), MQTT_UDP_HEADER_SIZE);
+        if (gcm_mode) {
+            header[1] |= MQTT_UDP_FLAG_UPLINK;
+        }
+        *(uint16_t*)&header[2] = htons(payload.size());
+        *(uint32_t*)&header[8] = htonl(timestamp);
+        *(uint32_t*)&header[12] = htonl(++sequence);
+        if (UdpAudioEncrypt(&aes, gcm_mode ? &gcm : nullptr, header, payload.data(), payload.size(),
+                header + MQTT_UDP_HEADER_SIZE) != 0) {
+            send_buffer.clear();
+        }
+        return send_buffer;
+    }
+
+    // The send path before the in-place change: a nonce copy and an output string per packet
+    std::string SendAllocating(const std::vector<uint8_t>& payload, uint32_t timestamp) {
+        std::string counter(nonce);
+        *(uint16_t*)&counter[2] = htons(payload.size());
+        *(uint32_t*)&counter[8] = htonl(timestamp);
+        *(uint32_t*)&counter[12] = htonl(++sequence);
+
+        std::string encrypted;
+        encrypted.resize(counter.size() + payload.size());
+        memcpy(encrypted.data(), counter.data(), counter.size());
+        size_t nc_off = 0;
+        uint8_t stream_block[16] = {0};
+        if (mbedtls_aes_crypt_ctr(&aes, payload.size(), &nc_off, (uint8_t*)counter.data(), stream_block,
+                payload.data(), (uint8_t*)&encrypted[counter.size()]) != 0) {
+            encrypted.clear();
+        }
+        return encrypted;
+    }
+
+    // As the UDP receive handler does, decrypt into a new packet payload
+    bool Receive(const std::string& data, bool gcm_mode, std::vector<uint8_t>& payload) {
+        size_t tag_size = gcm_mode ? MQTT_UDP_GCM_TAG_SIZE : 0;
+        if (data.size() < MQTT_UDP_HEADER_SIZE + tag_size) {
+            return false;
+        }
+        auto header = (const uint8_t*)data.data();
+        size_t size = data.size() - MQTT_UDP_HEADER_SIZE - tag_size;
+        payload.resize(size);
+        return UdpAudioDecrypt(&aes, gcm_mode ? &gcm : nullptr, header, header + MQTT_UDP_HEADER_SIZE, size,
+            payload.data()) == 0;
+    }
+};
+
+// Keeps the stub honest: SP 800-38A F.5.1, the first block of CTR-AES128
+static void CheckCtrVector() {
+    const uint8_t key[16] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+    uint8_t counter[16] = {0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff};
+    const uint8_t plain[16] = {0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a};
+    const uint8_t expected[16] = {0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26, 0x1b, 0xef, 0x68, 0x64, 0x99, 0x0d, 0xb6, 0xce};
+    mbedtls_aes_context aes;
+    mbedtls_aes_init(&aes);
+    mbedtls_aes_setkey_enc(&aes, key, 128);
+    uint8_t out[16], stream_block[16];
+    size_t nc_off = 0;
+    mbedtls_aes_crypt_ctr(&aes, sizeof(plain), &nc_off, counter, stream_block, plain, out);
+    mbedtls_aes_free(&aes);
+    CHECK(memcmp(out, expected, sizeof(out)) == 0, "CTR-AES128 test vector");
+}
+
+static std::vector<uint8_t> RandomPayload(std::mt19937& rng, size_t size) {
+    std::vector<uint8_t> payload(size);
+    for (auto& b : payload) {
+        b = rng();
+    }
+    return payload;
+}
+
+static void Check(const uint8_t* key) {
+    CHECK(UdpAudioGcmSelfTest(), "GCM known answer test");
+    CheckCtrVector();
+
+    std::mt19937 rng(1);
+    const size_t sizes[] = { 0, 1, 15, 16, 17, PAYLOAD_SIZE, 1024 };
+    for (size_t size : sizes) {
+        auto payload = RandomPayload(rng, size);
+        std::vector<uint8_t> decrypted;
+
+        // CTR in place produces the same datagram as the previous code
+        Session a(key), b(key);
+        std::string datagram = a.Send(payload, 1234, false);
+        CHECK(datagram == b.SendAllocating(payload, 1234), "ctr %u bytes: differs from the previous send path",
+              (unsigned)size);
+        CHECK(a.Receive(datagram, false, decrypted) && decrypted == payload, "ctr %u bytes: round trip",
+              (unsigned)size);
+
+        datagram = a.Send(payload, 1234, true);
+        CHECK(datagram.size() == MQTT_UDP_HEADER_SIZE + size + MQTT_UDP_GCM_TAG_SIZE &&
+              (datagram[1] & MQTT_UDP_FLAG_UPLINK), "gcm %u bytes: datagram layout", (unsigned)size);
+        CHECK(a.Receive(datagram, true, decrypted) && decrypted == payload, "gcm %u bytes: round trip",
+              (unsigned)size);
+
+        // A flipped bit anywhere in the header, payload or tag fails authentication
+        for (size_t i = 0; i < datagram.size(); i++) {
+            std::string tampered = datagram;
+            tampered[i] ^= 0x04;
+            CHECK(!a.Receive(tampered, true, decrypted), "gcm %u bytes: byte %u tampered but accepted",
+                  (unsigned)size, (unsigned)i);
+        }
+        CHECK(!a.Receive(datagram.substr(0, datagram.size() - 1), true, decrypted),
+              "gcm %u bytes: truncated tag accepted", (unsigned)size);
+    }
+    if (failures == 0) {
+        printf("%-28s ok\n", "checks");
+    }
+}
+
+template <typename Function>
+static double Time(int packets, Function&& function) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < packets; i++) {
+        function(i);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / packets;
+}
+
+static void Bench(const uint8_t* key, int packets) {
+    std::mt19937 rng(2);
+    auto payload = RandomPayload(rng, PAYLOAD_SIZE);
+    std::vector<uint8_t> decrypted;
+    size_t sink = 0;
+
+    printf("== %d byte payloads, send and receive per packet\n", PAYLOAD_SIZE);
+    Session ctr_old(key), ctr(key), gcm(key);
+    double reference_ns = Time(packets, [&](int i) {
+        auto datagram = ctr_old.SendAllocating(payload, i);
+        ctr_old.Receive(datagram, false, decrypted);
+        sink += decrypted[0];
+    });
+    printf("%-28s %7.1f ns/packet\n", "ctr, allocating (previous)", reference_ns);
+
+    double ns = Time(packets, [&](int i) {
+        ctr.Receive(ctr.Send(payload, i, false), false, decrypted);
+        sink += decrypted[0];
+    });
+    printf("%-28s %7.1f ns/packet  %.2fx\n", "ctr, in place", ns, reference_ns / ns);
+
+    ns = Time(packets, [&](int i) {
+        gcm.Receive(gcm.Send(payload, i, true), true, decrypted);
+        sink += decrypted[0];
+    });
+    printf("%-28s %7.1f ns/packet  %.2fx\n", "gcm, in place", ns, reference_ns / ns);
+    if (sink == 1) {
+        printf("\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    int packets = argc > 1 ? atoi(argv[1]) : 200000;
+    const uint8_t key[16] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+
+    Check(key);
+    if (failures != 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    Bench(key, packets);
+    return 0;
+}
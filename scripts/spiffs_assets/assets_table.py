@@ -0,0 +1,192 @@
+"""
+Layout of the mmap assets partition image (assets.bin)
+
+Shared by spiffs_assets_gen.py and build_default_assets.py, so the on-flash
+table format has a single implementation:
+
+    |total_files 4|checksum 4|data_length 4|
+    |table: total_files * |name max_name_len|size 4|offset 4|width 2|height 2||
+    |data: every entry is 0x5A5A followed by the file, at offset from the table end|
+
+All integers are little endian. The checksum is the 16-bit sum of the table and
+the data. The table is sorted by its fixed-size name field so the device can
+binary search it in place, and the crc32.bin entry holds the CRC32 of every
+entry in table order.
+"""
+
+import os
+import struct
+import zlib
+from datetime import datetime
+
+# Per-entry CRC32 of the file data, in table order. Used by the device to verify
+# each asset on first use and to find unchanged entries during incremental updates.
+CRC_TABLE_NAME = 'crc32.bin'
+HEADER_SIZE = 12
+ENTRY_PREFIX = b'\x5A' * 2
+
+
+def table_entry_size(max_name_len=32):
+    return int(max_name_len) + 12
+
+
+def compute_checksum(data):
+    checksum = sum(data) & 0xFFFF
+    return checksum
+
+
+def sort_key(filename, max_name_len=32):
+    # The table is sorted by its fixed-size name field so the device can binary search it in place
+    return filename.ljust(int(max_name_len), '\0')[:int(max_name_len)].encode('utf-8')
+
+
+def read_base_assets(base_file, max_name_len=32):
+    """Parse an existing assets.bin, returns its bytes and {name: (offset, blob)}"""
+    max_name_len = int(max_name_len)
+    with open(base_file, 'rb') as f:
+        data = f.read()
+    entries = {}
+    if len(data) < HEADER_SIZE:
+        return data, entries
+    total_files = int.from_bytes(data[0:4], byteorder='little')
+    entry_size = table_entry_size(max_name_len)
+    data_start = HEADER_SIZE + total_files * entry_size
+    for i in range(total_files):
+        item = HEADER_SIZE + i * entry_size
+        name = data[item:item + max_name_len].rstrip(b'\0').decode('utf-8', 'ignore')
+        size = int.from_bytes(data[item + max_name_len:item + max_name_len + 4], byteorder='little')
+        offset = data_start + int.from_bytes(data[item + max_name_len + 4:item + max_name_len + 8], byteorder='little')
+        entries[name] = (offset, data[offset:offset + 2 + size])
+    return data, entries
+
+
+def layout_assets(blobs, data_start, base_assets=None, max_name_len=32):
+    """
+    Place the entry blobs (with the 0x5A5A prefix) after the table.
+    Returns the absolute offset of each entry and the partition image.
+
+    With base_assets, unchanged entries keep their offset and the gaps keep the old
+    bytes, so a device running the base only needs to download the changed entries.
+    """
+    offsets = {}
+    used = []
+    image = bytearray(data_start)
+    base_entries = {}
+    if base_assets:
+        base_data, base_entries = read_base_assets(base_assets, max_name_len)
+        image = bytearray(base_data)
+        if len(image) < data_start:
+            image.extend(b'\0' * (data_start - len(image)))
+        for name, blob in blobs:
+            if name in base_entries:
+                offset, old_blob = base_entries[name]
+                if old_blob == blob and offset >= data_start:
+                    offsets[name] = offset
+                    used.append((offset, offset + len(blob)))
+
+    def is_free(start, end):
+        return start >= data_start and all(end <= s or start >= e for s, e in used)
+
+    def first_fit(size):
+        start = data_start
+        for s, e in sorted(used):
+            if s - start >= size:
+                return start
+            start = max(start, e)
+        return start
+
+    for name, blob in blobs:
+        if name in offsets:
+            continue
+        # Prefer the old slot of a changed entry, then the first gap that fits
+        offset = None
+        if name in base_entries:
+            old_offset, _ = base_entries[name]
+            if is_free(old_offset, old_offset + len(blob)):
+                offset = old_offset
+        if offset is None:
+            offset = first_fit(len(blob))
+        offsets[name] = offset
+        used.append((offset, offset + len(blob)))
+        end = offset + len(blob)
+        if len(image) < end:
+            image.extend(b'\0' * (end - len(image)))
+        image[offset:end] = blob
+
+    end = max([data_start] + [e for _, e in used])
+    return offsets, image[:end]
+
+
+def pack_assets_image(files, max_name_len=32, base_assets=None):
+    """
+    Build the partition image from (name, data, width, height) tuples, the CRC table is added here.
+    Returns (image bytes, table entries as (name, offset, size, width, height), checksum, changed bytes).
+    changed is the number of entry bytes that differ from base_assets, or None without a base.
+    """
+    max_name_len = int(max_name_len)
+    files = sorted(list(files) + [(CRC_TABLE_NAME, None, 0, 0)], key=lambda f: sort_key(f[0], max_name_len))
+
+    crcs = [zlib.crc32(data) if data is not None else 0 for _, data, _, _ in files]
+    crc_table = struct.pack('<%dI' % len(crcs), *crcs)
+    blobs = [(name, ENTRY_PREFIX + (data if data is not None else crc_table)) for name, data, _, _ in files]
+
+    total_files = len(blobs)
+    data_start = HEADER_SIZE + total_files * table_entry_size(max_name_len)
+    offsets, image = layout_assets(blobs, data_start, base_assets, max_name_len)
+
+    entries = []
+    mmap_table = bytearray()
+    for (file_name, _, width, height), (_, blob) in zip(files, blobs):
+        if len(file_name) > max_name_len:
+            print(f'Warning: "{file_name}" exceeds {max_name_len} bytes and will be truncated.')
+        offset = offsets[file_name] - data_start
+        file_size = len(blob) - len(ENTRY_PREFIX)
+        entries.append((file_name, offset, file_size, width, height))
+        fixed_name = file_name.ljust(max_name_len, '\0')[:max_name_len]
+        mmap_table.extend(fixed_name.encode('utf-8'))
+        mmap_table.extend(file_size.to_bytes(4, byteorder='little'))
+        mmap_table.extend(offset.to_bytes(4, byteorder='little'))
+        mmap_table.extend(width.to_bytes(2, byteorder='little'))
+        mmap_table.extend(height.to_bytes(2, byteorder='little'))
+
+    combined_data = mmap_table + image[data_start:]
+    checksum = compute_checksum(combined_data)
+    header_data = total_files.to_bytes(4, byteorder='little') + checksum.to_bytes(4, byteorder='little')
+    final_data = header_data + len(combined_data).to_bytes(4, byteorder='little') + combined_data
+
+    changed = None
+    if base_assets:
+        _, base_entries = read_base_assets(base_assets, max_name_len)
+        changed = sum(len(blob) for name, blob in blobs
+                      if name not in base_entries or base_entries[name] != (offsets[name], blob))
+    return bytes(final_data), entries, checksum, changed
+
+
+def write_mmap_header(include_path, assets_path, entries, checksum):
+    """Write mmap_generate_<name>.h with the file count, checksum and entry indexes"""
+    os.makedirs(include_path, exist_ok=True)
+    current_year = datetime.now().year
+    asset_name = os.path.basename(assets_path)
+    header_file_path = os.path.join(include_path, f'mmap_generate_{asset_name}.h')
+    with open(header_file_path, 'w') as output_header:
+        output_header.write('/*\n')
+        output_header.write(' * SPDX-FileCopyrightText: 2022-{} Espressif Systems (Shanghai) CO LTD\n'.format(current_year))
+        output_header.write(' *\n')
+        output_header.write(' * SPDX-License-Identifier: Apache-2.0\n')
+        output_header.write(' */\n\n')
+        output_header.write('/**\n')
+        output_header.write(' * @file\n')
+        output_header.write(" * @brief This file was generated by esp_mmap_assets, don't modify it\n")
+        output_header.write(' */\n\n')
+        output_header.write('#pragma once\n\n')
+        output_header.write("#include \"esp_mmap_assets.h\"\n\n")
+        output_header.write(f'#define MMAP_{asset_name.upper()}_FILES           {len(entries)}\n')
+        output_header.write(f'#define MMAP_{asset_name.upper()}_CHECKSUM        0x{checksum:04X}\n\n')
+        output_header.write(f'enum MMAP_{asset_name.upper()}_LISTS {{\n')
+
+        for i, (file_name, _, _, _, _) in enumerate(entries):
+            enum_name = file_name.replace('.', '_')
+            output_header.write(f'    MMAP_{asset_name.upper()}_{enum_name.upper()} = {i},        /*!< {file_name} */\n')
+
+        output_header.write('};\n')
+    return header_file_path
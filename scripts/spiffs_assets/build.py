@@ -305,7 +305,7 @@ def generate_index_json(assets_dir, srmodels, text_font, emoji_collection, icon_
     print(f"Generated: {index_path}")
 
 
-def generate_config_json(build_dir, assets_dir):
+def generate_config_json(build_dir, assets_dir, base_assets=None):
     """Generate config.json file"""
     # Get absolute path of current working directory
     workspace_dir = os.path.abspath(os.path.join(os.path.dirname(__file__)))
@@ -327,6 +327,8 @@ def generate_config_json(build_dir, assets_dir):
         "support_raw_dither": False,
         "support_raw_bgr": False
     }
+    if base_assets:
+        config_data["base_assets"] = os.path.abspath(base_assets)
     
     # Write config.json
     config_path = os.path.join(build_dir, "config.json")
@@ -345,6 +347,7 @@ def main():
 
     parser.add_argument('--res_path', help='Path to res directory')
     parser.add_argument('--target_board', help='Path to target board directory')
+    parser.add_argument('--base_assets', help='Previous assets.bin, unchanged entries keep their offsets for incremental updates')
     
     args = parser.parse_args()
     
@@ -378,7 +381,7 @@ def main():
     generate_index_json(assets_dir, srmodels, text_font, emoji_collection, icon_collection, layout_json)
     
     # Generate config.json
-    config_path = generate_config_json(build_dir, assets_dir)
+    config_path = generate_config_json(build_dir, assets_dir, args.base_assets)
     
     # Use spiffs_assets_gen.py to package final build/assets.bin
     try:
@@ -20,6 +20,8 @@ from typing import List
 from pathlib import Path
 from packaging import version
 
+from assets_table import CRC_TABLE_NAME, pack_assets_image, write_mmap_header
+
 sys.dont_write_bytecode = True
 
 GREEN = '\033[1;32m'
@@ -45,6 +47,7 @@ class PackModelsConfig:
     image_file: str
     assets_path: str
     name_length: int
+    base_assets: str = None
 
 def generate_header_filename(path):
     asset_name = os.path.basename(path)
@@ -52,14 +55,6 @@ def generate_header_filename(path):
     header_filename = f'mmap_generate_{asset_name}.h'
     return header_filename
 
-def compute_checksum(data):
-    checksum = sum(data) & 0xFFFF
-    return checksum
-
-def sort_key(filename):
-    basename, extension = os.path.splitext(filename)
-    return extension, basename
-
 def download_v8_script(convert_path):
     """
     Ensure that the lvgl_image_converter repository is present at the specified path.
@@ -399,18 +394,15 @@ def pack_assets(config: PackModelsConfig):
     assets_path = config.assets_path
     max_name_len = config.name_length
 
-    merged_data = bytearray()
-    file_info_list = []
-    skip_files = ['config.json', 'lvgl_image_converter']
+    skip_files = ['config.json', 'lvgl_image_converter', CRC_TABLE_NAME]
 
-    file_list = sorted(os.listdir(target_path), key=sort_key)
-    for filename in file_list:
+    files = []
+    for filename in os.listdir(target_path):
         if filename in skip_files:
             continue
 
         file_path = os.path.join(target_path, filename)
         file_name = os.path.basename(file_path)
-        file_size = os.path.getsize(file_path)
 
         try:
             img = Image.open(file_path)
@@ -429,63 +421,15 @@ def pack_assets(config: PackModelsConfig):
             else:
                 width, height = 0, 0
 
-        file_info_list.append((file_name, len(merged_data), file_size, width, height))
-        # Add 0x5A5A prefix to merged_data
-        merged_data.extend(b'\x5A' * 2)
-
         with open(file_path, 'rb') as bin_file:
-            bin_data = bin_file.read()
-
-        merged_data.extend(bin_data)
-
-    total_files = len(file_info_list)
-
-    mmap_table = bytearray()
-    for file_name, offset, file_size, width, height in file_info_list:
-        if len(file_name) > int(max_name_len):
-            print(f'\033[1;33mWarn:\033[0m "{file_name}" exceeds {max_name_len} bytes and will be truncated.')
-        fixed_name = file_name.ljust(int(max_name_len), '\0')[:int(max_name_len)]
-        mmap_table.extend(fixed_name.encode('utf-8'))
-        mmap_table.extend(file_size.to_bytes(4, byteorder='little'))
-        mmap_table.extend(offset.to_bytes(4, byteorder='little'))
-        mmap_table.extend(width.to_bytes(2, byteorder='little'))
-        mmap_table.extend(height.to_bytes(2, byteorder='little'))
+            files.append((file_name, bin_file.read(), width, height))
 
-    combined_data = mmap_table + merged_data
-    combined_checksum = compute_checksum(combined_data)
-    combined_data_length = len(combined_data).to_bytes(4, byteorder='little')
-    header_data = total_files.to_bytes(4, byteorder='little') + combined_checksum.to_bytes(4, byteorder='little')
-    final_data = header_data + combined_data_length + combined_data
+    final_data, entries, checksum, _ = pack_assets_image(files, max_name_len, config.base_assets)
 
     with open(out_file, 'wb') as output_bin:
         output_bin.write(final_data)
 
-    os.makedirs(assets_include_path, exist_ok=True)
-    current_year = datetime.now().year
-
-    asset_name = os.path.basename(assets_path)
-    file_path = os.path.join(assets_include_path, f'mmap_generate_{asset_name}.h')
-    with open(file_path, 'w') as output_header:
-        output_header.write('/*\n')
-        output_header.write(' * SPDX-FileCopyrightText: 2022-{} Espressif Systems (Shanghai) CO LTD\n'.format(current_year))
-        output_header.write(' *\n')
-        output_header.write(' * SPDX-License-Identifier: Apache-2.0\n')
-        output_header.write(' */\n\n')
-        output_header.write('/**\n')
-        output_header.write(' * @file\n')
-        output_header.write(" * @brief This file was generated by esp_mmap_assets, don't modify it\n")
-        output_header.write(' */\n\n')
-        output_header.write('#pragma once\n\n')
-        output_header.write("#include \"esp_mmap_assets.h\"\n\n")
-        output_header.write(f'#define MMAP_{asset_name.upper()}_FILES           {total_files}\n')
-        output_header.write(f'#define MMAP_{asset_name.upper()}_CHECKSUM        0x{combined_checksum:04X}\n\n')
-        output_header.write(f'enum MMAP_{asset_name.upper()}_LISTS {{\n')
-
-        for i, (file_name, _, _, _, _) in enumerate(file_info_list):
-            enum_name = file_name.replace('.', '_')
-            output_header.write(f'    MMAP_{asset_name.upper()}_{enum_name.upper()} = {i},        /*!< {file_name} */\n')
-
-        output_header.write('};\n')
+    write_mmap_header(assets_include_path, assets_path, entries, checksum)
 
     print(f'All bin files have been merged into {os.path.basename(out_file)}')
 
@@ -557,7 +501,8 @@ def process_assets_build(config_data):
         include_path=include_path,
         image_file=image_file,
         assets_path=assets_path,
-        name_length=name_length
+        name_length=name_length,
+        base_assets=config_data.get('base_assets')
     )
 
     print('--support_format:', support_format)